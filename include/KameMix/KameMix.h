@@ -21,12 +21,48 @@ extern "C" {
 
 struct KameMix_Sound;
 struct KameMix_Stream;
+struct KameMix_Reverb;
 
 enum KameMix_OutputFormat {
   KameMix_OutputFloat,
   KameMix_OutputS16
 };
 
+/* Options for how loaded Sounds are stored, combined with bitwise or. */
+enum KameMix_SoundFlags {
+  KameMix_SoundDefault = 0,
+  /* Keep OGG Vorbis files compressed in memory, and decode them in small
+     chunks while playing. Each playing channel decodes separately, so the 
+     Sound can still be played multiple times at different positions. Uses 
+     about a tenth of the memory of a decoded Sound, at the cost of decoding 
+     in the audio thread. WAV files are loaded normally. */
+  KameMix_SoundCompressed = 1,
+  /* Store decoded samples as 16-bit integers, using half the memory of 
+     float output format. Samples are converted to float while mixing, so 
+     mixing quality is the same. Ignored for compressed OGG files. */
+  KameMix_SoundS16 = 2,
+  /* Keep decoded samples at the file's sample rate, instead of converting 
+     them to the output frequency when loaded. Playing channels resample 
+     while mixing, with KameMix_InitOptions.resample_quality. Saves memory 
+     for sounds with a lower sample rate than the output, such as 22050 Hz 
+     effects. OGG files with multiple sample rates are stored at the rate 
+     of the first logical stream. Ignored for compressed OGG files. */
+  KameMix_SoundNativeRate = 4,
+  /* Encode decoded samples as 4-bit IMA ADPCM, using a quarter of the 
+     memory of 16-bit samples. Playing channels decode a sample at a time
+     while mixing, which is much cheaper than KameMix_SoundCompressed, but
+     with some loss of quality. Ignored for compressed OGG files. WAV files 
+     already in IMA or Microsoft ADPCM format are always supported, and are 
+     decoded when loaded without this flag. */
+  KameMix_SoundADPCM = 8,
+  /* Return from loading an OGG file once its buffer is allocated, and 
+     decode it in a background thread. The Sound can be played right away, 
+     and playing channels stop at the decoded position until more is 
+     decoded. Only for OGG files loaded by file name, and ignored with 
+     KameMix_SoundCompressed or KameMix_SoundADPCM. */
+  KameMix_SoundProgressive = 16
+};
+
 /* KameMix_Channel is used to refer to a playing Sound/Stream. Each time 
    played, a new unique id is created to identify the Sound/Stream in a 
    channel. idx and id should not be manually set. When a Sound/Stream 
@@ -39,14 +75,279 @@ struct KameMix_Channel {
   unsigned int id; 
 };
 
-#define KameMix_isChannelSet(channel) (channel).idx >= 0
+#define KameMix_isChannelSet(channel) ((channel).idx >= 0)
 #define KameMix_unsetChannel(channel) (channel).idx = -1
 
 typedef void* (*KameMix_MallocFunc)(size_t len);
 typedef void (*KameMix_FreeFunc)(void *ptr);
 typedef void* (*KameMix_ReallocFunc)(void *ptr, size_t len);
 
-/* Must be called before KameMix_init if using custom allocator. 
+/* Callbacks for reading audio files from a custom source, used by
+   KameMix_loadSoundIO and KameMix_loadStreamIO. read, seek, and tell must
+   behave the same as stdio.h's fread, fseek, and ftell, but take userdata
+   instead of a FILE*: seek takes SEEK_SET, SEEK_CUR, or SEEK_END for whence
+   and returns 0 on success, and tell returns -1 on error. close is called
+   once when KameMix is done with userdata, including on load errors. It
+   can be NULL if userdata doesn't need to be released. */
+typedef size_t (*KameMix_ReadFunc)(void *ptr, size_t size, size_t nmemb,
+                                   void *userdata);
+typedef int (*KameMix_SeekFunc)(void *userdata, int64_t offset, int whence);
+typedef int64_t (*KameMix_TellFunc)(void *userdata);
+typedef int (*KameMix_CloseFunc)(void *userdata);
+
+struct KameMix_IO {
+  KameMix_ReadFunc read;
+  KameMix_SeekFunc seek;
+  KameMix_TellFunc tell;
+  KameMix_CloseFunc close;
+};
+
+/* Called for each Sound in the cache by KameMix_forEachCachedSound. path 
+   and flags are what the Sound was loaded with, refcount is its number of 
+   references, and mem_size is the size of its audio data in bytes. */
+typedef void (*KameMix_CachedSoundFunc)(const char *path, int flags, 
+                                        int refcount, size_t mem_size, 
+                                        void *userdata);
+
+/* What KameMix_playSound does with a cached Sound that was evicted by the 
+   cache budget, and is still being reloaded. */
+enum KameMix_ReloadPolicy {
+  /* Sound isn't played, and an unset channel is returned. */
+  KameMix_ReloadSkip,
+  /* Channel is returned immediately, and the Sound starts playing once 
+     reloaded. Compressed Sounds are blocked instead, since their decoder 
+     can't be opened in the audio thread. */
+  KameMix_ReloadDelay,
+  /* Blocks until the Sound is reloaded. */
+  KameMix_ReloadBlock
+};
+
+/* Counters of the Sound cache, from KameMix_getSoundCacheStats. */
+struct KameMix_SoundCacheStats {
+  /* Loads and plays of cached Sounds that had their audio data loaded */
+  unsigned hits;
+  /* Loads of Sounds not in the cache, and plays of evicted Sounds */
+  unsigned misses;
+  /* Sounds that had their audio data freed to stay under budget */
+  unsigned evictions;
+  /* Evicted Sounds that were loaded again */
+  unsigned reloads;
+  /* Size in bytes of audio data of all cached Sounds that are loaded */
+  size_t resident_bytes;
+  /* Budget from KameMix_setSoundCacheBudget, or 0 if unlimited */
+  size_t budget;
+};
+
+/* SIMD instruction sets used for mixing, from KameMix_getSimdLevel. */
+enum KameMix_SimdLevel {
+  /* Plain C++, used when the CPU isn't x86 */
+  KameMix_SimdNone,
+  KameMix_SimdSSE2,
+  KameMix_SimdAVX2,
+  KameMix_SimdAVX512
+};
+
+/* Types of KameMix_Event, from KameMix_pollEvents. */
+enum KameMix_EventType {
+  /* Channel stopped playing, by reaching its end, a fadeout or 
+     KameMix_stopAt, or by being halted. The channel is now unset for 
+     functions that take it. */
+  KameMix_EventFinished,
+  /* Channel reached the end of its Sound/Stream, and started over to 
+     loop. */
+  KameMix_EventLooped,
+  /* Stream's next buffer wasn't read in time, so it's silent until it is. 
+     Sent once each time it starts waiting. */
+  KameMix_EventStarved,
+  /* Stream failed to read or decode. Followed by KameMix_EventFinished. */
+  KameMix_EventError
+};
+
+/* Something that happened to a playing channel, sent by the mixer without
+   locking it. */
+struct KameMix_Event {
+  KameMix_EventType type;
+  KameMix_Channel channel;
+};
+
+/* Processes a bus's mixed audio in place, before it's mixed into its 
+   parent. buf has frames stereo float sample frames. Called on the thread 
+   mixing, once per block, with the mixer locked, so it must not call 
+   KameMix functions, allocate or block. */
+typedef void (*KameMix_BusEffectFunc)(float *buf, int frames, 
+                                      void *userdata);
+
+/* Options for KameMix_loadReverb, combined with bitwise or. */
+enum KameMix_ReverbFlags {
+  KameMix_ReverbDefault = 0,
+  /* Sum all partitions of the impulse response on the thread running the 
+     effect, instead of the later ones on a background thread. For 
+     processing faster than real time, such as benchmarks, where the 
+     background thread would fall behind. */
+  KameMix_ReverbNoThread = 1
+};
+
+/* Filters of a Sound/Stream, from KameMix_setFilter. */
+enum KameMix_FilterType {
+  /* No filtering. Filters set before fade to this instead of cutting off. */
+  KameMix_FilterNone,
+  /* Gentle 6 dB per octave low pass. Cheap muffling, like for distance. */
+  KameMix_FilterLowPass1,
+  /* Gentle 6 dB per octave high pass */
+  KameMix_FilterHighPass1,
+  /* 12 dB per octave low pass, with resonance at cutoff set by q. q of 
+     0.707 has no resonance. Like for occlusion behind walls. */
+  KameMix_FilterLowPass,
+  /* 12 dB per octave high pass, with q like KameMix_FilterLowPass. Like 
+     for telephones and radios. */
+  KameMix_FilterHighPass,
+  /* Passes frequencies around cutoff, narrower with higher q */
+  KameMix_FilterBandPass
+};
+
+/* Interpolation used for Sounds/Streams played at a pitch from 
+   KameMix_setPitch, or stored at a different rate than the output, from 
+   KameMix_InitOptions.resample_quality. */
+enum KameMix_ResampleQuality {
+  /* Straight line between sample frames. Cheapest, but dulls high 
+     frequencies and adds some aliasing. */
+  KameMix_ResampleLinear,
+  /* Curve through the 4 frames around each position */
+  KameMix_ResampleCubic
+};
+
+/* Shape of a change automated over time by KameMix_rampVolume, 
+   KameMix_rampPos and KameMix_rampGroupVolume. */
+enum KameMix_RampCurve {
+  /* Changes at a constant rate */
+  KameMix_RampLinear,
+  /* Starts and ends slowly, with no sudden change in rate */
+  KameMix_RampSmooth,
+  /* Changes volume by the same number of decibels each second, which 
+     sounds even to the ear. Volumes below 0.001 (-60 dB) start or end the 
+     ramp at 0.001, and 0.0f is set when the ramp ends. Same as 
+     KameMix_RampLinear for positions. */
+  KameMix_RampExponential
+};
+
+/* Options for KameMix_initEx. Fill with KameMix_getDefaultInitOptions 
+   before setting options, so options added later have their defaults. */
+struct KameMix_InitOptions {
+  /* Same as the parameters of KameMix_init. Defaults are 44100 freq, 2048
+     sample_buf_size, and KameMix_OutputFloat. */
+  int freq;
+  int sample_buf_size;
+  KameMix_OutputFormat format;
+  /* 1 to allocate KameMix_Sounds, KameMix_Streams, their decoders and 
+     stream buffers from pools of fixed size blocks. Freed blocks are kept 
+     for reuse instead of being returned to the allocator from 
+     KameMix_setAlloc, which avoids heap fragmentation and allocation time 
+     when Sounds and Streams are often loaded and freed. Pool memory is 
+     only returned by KameMix_shutdown. Default is 0. */
+  int use_pool;
+  /* Number of stream buffers allocated by KameMix_initEx when use_pool is 
+     1, so that many Streams can be loaded without allocating them. Default 
+     is 0. */
+  int pool_streams;
+  /* Max number of Sounds and Streams playing at once, including paused. 
+     When greater than 0, all voices are allocated by KameMix_initEx, so 
+     playing, stopping and changing playing channels never allocate. Playing
+     when all voices are used fails, returning an unset channel. Default is 
+     0, to grow as needed. */
+  int max_voices;
+  /* Max number of groups, preallocated like max_voices. 
+     KameMix_createGroup returns -1 when all are created. Default is 0, to 
+     grow as needed. */
+  int max_groups;
+  /* 1 to assert if the KameMix_setAlloc functions are called while the 
+     lock shared with the audio thread is held, which would stall audio. 
+     Needs max_voices and max_groups, and a build with asserts enabled. 
+     Allocations by SDL and libvorbis aren't checked, so compressed Sounds 
+     still allocate their decoder when played. Default is 0. */
+  int debug_alloc_check;
+  /* Most advanced instruction set to mix with. KameMix_initEx uses the best
+     one supported by the CPU up to max_simd. Lower it to compare output or
+     speed with simpler mixing. Default is KameMix_SimdAVX512. */
+  KameMix_SimdLevel max_simd;
+  /* Number of threads started to mix voices in parallel with the audio 
+     thread, for when too many are playing to mix on one core. Voices are 
+     handed out most expensive first, like Streams and resampled Sounds, 
+     and each thread mixes into its own buffer, which the audio thread adds
+     together. The lock shared with the audio thread is held while they 
+     mix, instead of between voices. At most 15. Default is 0, to mix only 
+     on the audio thread. */
+  int mix_threads;
+  /* When greater than 0, audio is mixed ahead of the audio device on its 
+     own thread, up to mix_ahead_frames sample frames, in blocks of 
+     mix_block_frames. The audio callback then only copies mixed audio, so 
+     a small sample_buf_size can be used for low latency, while mixing 
+     blocks that occasionally take too long doesn't cause dropouts. Changes 
+     like playing a Sound are heard after up to mix_ahead_frames plus 
+     sample_buf_size frames. At least sample_buf_size plus mix_block_frames
+     is used, so each callback can be filled while a block is mixing, and 
+     rounded up to a multiple of mix_block_frames. Default is 0, to mix in 
+     the audio callback. */
+  int mix_ahead_frames;
+  /* Sample frames mixed at once. Each audio callback is mixed in blocks of
+     this size, and fades, pausing, volume and position changes are updated
+     once per block, so large values of sample_buf_size don't make them lag.
+     0 mixes the whole callback at once, or blocks of 128 when 
+     mix_ahead_frames is set. Default is 128. */
+  int mix_block_frames;
+  /* Number of events kept for KameMix_pollEvents, rounded up to a power of
+     2. Events sent while it's full are dropped, and counted by 
+     KameMix_getDroppedEvents. Default is 256. */
+  int max_events;
+  /* Interpolation of resampled Sounds/Streams. Default is 
+     KameMix_ResampleCubic. */
+  KameMix_ResampleQuality resample_quality;
+};
+
+/* State of the audio mixed ahead with KameMix_InitOptions.mix_ahead_frames,
+   from KameMix_getMixAheadStats. */
+struct KameMix_MixAheadStats {
+  /* Sample frames mixed and waiting to be played */
+  int fill_frames;
+  /* Fewest frames waiting after an audio callback since stats were reset.
+     Close to 0 means the ring almost ran out. */
+  int min_fill_frames;
+  /* Most frames that can be mixed ahead */
+  int capacity_frames;
+  /* Frames mixed at once */
+  int block_frames;
+  /* Audio callbacks that ran out of mixed audio, and played silence for 
+     the rest */
+  unsigned underruns;
+  /* Blocks mixed since stats were reset */
+  unsigned blocks_mixed;
+};
+
+/* Stats of a size class of the pools enabled by 
+   KameMix_InitOptions.use_pool, from KameMix_getPoolStats. */
+struct KameMix_PoolStats {
+  /* Size in bytes of each block */
+  size_t block_size;
+  /* Blocks allocated, either used or free for reuse */
+  int blocks_total;
+  /* Blocks in use */
+  int blocks_used;
+  /* Most blocks in use at once */
+  int peak_used;
+  /* Number of blocks taken from the pool */
+  unsigned allocs;
+  /* Number of times the allocator was called to add blocks to the pool */
+  unsigned slab_allocs;
+};
+
+/* Called for each call site found by real-time safety checks, from 
+   KameMix_forEachRtViolation. what is the operation, like "km_malloc" or 
+   "blocking lock", file and line are where it was called, and count is the 
+   number of times it was called on the audio thread. */
+typedef void (*KameMix_RtViolationFunc)(const char *what, const char *file,
+                                        int line, unsigned count, 
+                                        void *userdata);
+
+/* Must be called before KameMix_init if using custom allocator.
    Functions must have same behavior as stdlib.h versions: free accepts NULL,
    malloc returns max_aligned address, or NULL on failure, etc. */
 KAMEMIX_DECLSPEC
@@ -66,6 +367,48 @@ void KameMix_setAlloc(KameMix_MallocFunc malloc_,
 KAMEMIX_DECLSPEC
 int KameMix_init(int freq, int sample_buf_size, KameMix_OutputFormat format);
 
+/* Sets options to the defaults used by KameMix_init. */
+KAMEMIX_DECLSPEC 
+void KameMix_getDefaultInitOptions(KameMix_InitOptions *options);
+
+/* Same as KameMix_init, with more options. */
+KAMEMIX_DECLSPEC int KameMix_initEx(const KameMix_InitOptions *options);
+
+/* Fills stats for up to max_classes size classes of the pools, smallest 
+   first, and returns the number of size classes. Returns 0 if pools aren't
+   enabled with KameMix_InitOptions.use_pool. */
+KAMEMIX_DECLSPEC 
+int KameMix_getPoolStats(KameMix_PoolStats *stats, int max_classes);
+
+/* Fills stats and returns 1 if mixing ahead is enabled with 
+   KameMix_InitOptions.mix_ahead_frames, else returns 0. */
+KAMEMIX_DECLSPEC int KameMix_getMixAheadStats(KameMix_MixAheadStats *stats);
+
+/* Resets min_fill_frames to current fill, and underruns and blocks_mixed 
+   to 0. */
+KAMEMIX_DECLSPEC void KameMix_resetMixAheadStats();
+
+/* Copies up to max_events events, oldest first, to events and removes them
+   from the queue. Returns the number copied. Cost is proportional to the 
+   number of events, so it's cheaper than checking each channel with 
+   KameMix_isPlaying when many are playing. */
+KAMEMIX_DECLSPEC 
+int KameMix_pollEvents(KameMix_Event *events, int max_events);
+
+/* Returns number of events dropped because the queue was full, since 
+   KameMix_init. See KameMix_InitOptions.max_events */
+KAMEMIX_DECLSPEC unsigned KameMix_getDroppedEvents();
+
+/* When KameMix is built with KAMEMIX_RT_CHECK defined, the audio thread 
+   records every allocation, free, wait on a lock, and thread start or join
+   it makes, since they can cause audio glitches. It also enables flush to
+   zero and denormals are zero while mixing. Calls func with userdata for 
+   each recorded call site, and returns the number of sites. Always returns
+   0 if not built with KAMEMIX_RT_CHECK. */
+KAMEMIX_DECLSPEC 
+int KameMix_forEachRtViolation(KameMix_RtViolationFunc func, 
+                               void *userdata);
+
 /* Releases all KameMix resources, except KameMix_Sounds and KameMix_Streams,
    which must be released before calling this. */
 KAMEMIX_DECLSPEC void KameMix_shutdown();
@@ -76,7 +419,8 @@ KAMEMIX_DECLSPEC float KameMix_getMasterVolume();
 KAMEMIX_DECLSPEC void KameMix_setMasterVolume(float volume);
 
 /* Returns unique id of new group. This is used with other group functions.
-   groups live until KameMix_shutdown is called. */
+   groups live until KameMix_shutdown is called. Returns -1 if 
+   KameMix_InitOptions.max_groups groups were already created. */
 KAMEMIX_DECLSPEC int KameMix_createGroup();
 
 /* group must be valid id returned from KameMix_createGroup */
@@ -85,12 +429,113 @@ KAMEMIX_DECLSPEC void KameMix_setGroupVolume(int group, float volume);
 /* group must be valid id returned from KameMix_createGroup */
 KAMEMIX_DECLSPEC float KameMix_getGroupVolume(int group);
 
+/* Changes group volume to volume over secs on the audio thread, along 
+   curve. KameMix_setGroupVolume cancels the ramp. group must be valid id 
+   returned from KameMix_createGroup */
+KAMEMIX_DECLSPEC 
+void KameMix_rampGroupVolume(int group, float volume, float secs,
+                             KameMix_RampCurve curve);
+
+/* Creates a group that's a submix bus. Voices in it are mixed into the 
+   bus's own buffer, which is processed by its effect, and mixed into its 
+   parent bus, or the output if parent is -1. Group volume is applied once
+   to the whole bus, ramped over each block, instead of to each voice. 
+   parent must be -1 or a group returned from KameMix_createBus. Returns 
+   group id for use with other group functions, or -1 if 
+   KameMix_InitOptions.max_groups groups were already created or the bus's
+   buffer couldn't be allocated. */
+KAMEMIX_DECLSPEC int KameMix_createBus(int parent);
+
+/* Sets effect run on the audio of bus each block, or NULL to remove it. 
+   Effects of buses run before their parent's. group must be id returned 
+   from KameMix_createBus. */
+KAMEMIX_DECLSPEC 
+void KameMix_setBusEffect(int group, KameMix_BusEffectFunc effect, 
+                          void *userdata);
+
+/* Sends audio of group to bus at level, in addition to its usual output, 
+   such as to share one reverb between many sounds. Use -1 for bus to stop
+   sending. Each voice in a group that isn't a bus sends at level times its
+   volume, unless set with KameMix_setSend. A bus sends its mixed audio 
+   after its effect and volume, and bus must be created before it, since 
+   buses are processed from last created to first. group must be valid id 
+   returned from KameMix_createGroup or KameMix_createBus, and bus must be 
+   -1 or id returned from KameMix_createBus. */
+KAMEMIX_DECLSPEC void KameMix_setGroupSend(int group, int bus, float level);
+
+/* Loads impulse response from a WAV or OGG file, for a convolution reverb 
+   run by KameMix_reverbEffect. A mono file is used for both channels, and 
+   a stereo file convolves each channel with its own. The response is 
+   split into partitions of at least 256 frames, and the reverb is delayed 
+   by one. Its first partitions are summed by the effect, and the rest on a
+   background thread, unless flags has KameMix_ReverbNoThread. Cost grows 
+   with the length of the response. Returns NULL on error. */
+KAMEMIX_DECLSPEC 
+KameMix_Reverb* KameMix_loadReverb(const char *ir_file, int flags);
+
+/* Frees reverb. It must not be the effect of a bus. reverb can be NULL */
+KAMEMIX_DECLSPEC void KameMix_freeReverb(KameMix_Reverb *reverb);
+
+/* Returns length of reverb's impulse response in seconds. */
+KAMEMIX_DECLSPEC float KameMix_getReverbLength(KameMix_Reverb *reverb);
+
+/* Returns number of partitions output without their later part, because 
+   the background thread didn't sum it in time. */
+KAMEMIX_DECLSPEC 
+unsigned KameMix_getReverbLateBlocks(KameMix_Reverb *reverb);
+
+/* KameMix_BusEffectFunc that replaces buf with its convolution by the 
+   impulse response of reverb, a KameMix_Reverb. Set it on a bus with 
+   KameMix_setBusEffect, and send to the bus with KameMix_setSend and 
+   KameMix_setGroupSend, so one reverb is shared by everything sending to 
+   it. Bus volume sets the level of the reverb. A reverb must only be the 
+   effect of one bus. */
+KAMEMIX_DECLSPEC 
+void KameMix_reverbEffect(float *buf, int frames, void *reverb);
+
+/* Adds an emitter: sound looped forever at x, y, for ambient sounds placed
+   in a level. It only plays on a voice while the listener is within 
+   max_distance of it, as of the last KameMix_updateEmitters, so thousands 
+   can be added without using voices or mixing time for far ones. While not
+   playing it keeps its place in the loop, so it resumes where it would be
+   if it had kept playing, except for Sounds loaded with 
+   KameMix_SoundCompressed, which start over. A reference to sound is kept 
+   until removed. Returns id of emitter, or -1 if sound is NULL or 
+   max_distance isn't greater than 0.0f. */
+KAMEMIX_DECLSPEC 
+int KameMix_addEmitter(KameMix_Sound *sound, float x, float y, 
+                       float max_distance, float volume, int group);
+
+/* Stops and removes emitter. Its id can be returned by a later 
+   KameMix_addEmitter. emitter must be an id returned from 
+   KameMix_addEmitter that wasn't removed. */
+KAMEMIX_DECLSPEC void KameMix_removeEmitter(int emitter);
+
+/* Moves emitter, and its voice if playing. emitter must be an id returned 
+   from KameMix_addEmitter that wasn't removed. */
+KAMEMIX_DECLSPEC void KameMix_setEmitterPos(int emitter, float x, float y);
+
+/* Sets volume of emitter, and its voice if playing. emitter must be an id 
+   returned from KameMix_addEmitter that wasn't removed. */
+KAMEMIX_DECLSPEC void KameMix_setEmitterVolume(int emitter, float volume);
+
+/* Plays emitters within range of the listener from KameMix_setListenerPos,
+   and stops playing ones that are out of range. Call after moving the 
+   listener, such as once per frame. Cost is proportional to emitters near
+   the listener, not all emitters. Emitters in range that can't get a voice
+   with KameMix_InitOptions.max_voices are tried again next call. Returns 
+   number of emitters playing. */
+KAMEMIX_DECLSPEC int KameMix_updateEmitters();
+
 KAMEMIX_DECLSPEC int KameMix_getFrequency();
 KAMEMIX_DECLSPEC int KameMix_getChannels();
 KAMEMIX_DECLSPEC KameMix_OutputFormat KameMix_getFormat();
 
 /* Size in bytes of sample output format */
-KAMEMIX_DECLSPEC int KameMix_getFormatSize(); 
+KAMEMIX_DECLSPEC int KameMix_getFormatSize();
+
+/* Instruction set picked by KameMix_init for mixing. */
+KAMEMIX_DECLSPEC KameMix_SimdLevel KameMix_getSimdLevel(); 
 
 KAMEMIX_DECLSPEC KameMix_MallocFunc KameMix_getMalloc();
 KAMEMIX_DECLSPEC KameMix_FreeFunc KameMix_getFree();
@@ -114,6 +559,18 @@ KAMEMIX_DECLSPEC void KameMix_halt(KameMix_Channel c);
    from a KameMix function or unset with KameMix_unsetChannel. */
 KAMEMIX_DECLSPEC void KameMix_stop(KameMix_Channel c);
 
+/* Stops Sound/Stream without fade just before mixer clock frame 
+   clock_frame, from KameMix_getClock. Stops at the start of the next block
+   mixed if clock_frame has passed. c must be a valid KameMix_Channel 
+   returned from a KameMix function or unset with KameMix_unsetChannel. */
+KAMEMIX_DECLSPEC void KameMix_stopAt(KameMix_Channel c, uint64_t clock_frame);
+
+/* Mixer clock: number of sample frames mixed since KameMix_init, which is 
+   the frame of the next one mixed. Advances a block at a time, so schedule
+   with KameMix_playSoundAt and KameMix_stopAt at least a block or callback
+   ahead, plus KameMix_InitOptions.mix_ahead_frames if set. */
+KAMEMIX_DECLSPEC uint64_t KameMix_getClock();
+
 /* Stops Sound/Stream with fade. c must be a valid KameMix_Channel returned
    from a KameMix function or unset with KameMix_unsetChannel. */
 KAMEMIX_DECLSPEC void KameMix_fadeout(KameMix_Channel c, float fade_secs);
@@ -188,6 +645,45 @@ KameMix_Channel KameMix_setGroup(KameMix_Channel c, int group);
 KAMEMIX_DECLSPEC 
 int KameMix_getGroup(KameMix_Channel c);
 
+/* Sends Sound/Stream to bus at level times its volume, in addition to its
+   usual output, overriding the send of its group from 
+   KameMix_setGroupSend. Use -1 for bus to send like its group again. bus 
+   must be -1 or id returned from KameMix_createBus. c must be a valid 
+   KameMix_Channel returned from a KameMix function or unset with 
+   KameMix_unsetChannel. 
+   Returns passed in channel if channel wasn't finished, otherwise returns 
+   unset channel. */
+KAMEMIX_DECLSPEC 
+KameMix_Channel KameMix_setSend(KameMix_Channel c, int bus, float level);
+
+/* Filters Sound/Stream with type at cutoff Hz. q is used by 
+   KameMix_FilterLowPass, KameMix_FilterHighPass and KameMix_FilterBandPass.
+   Changes are smoothed over about 10 ms, so cutoff can be set every frame, 
+   like from distance, without clicks. Filtered voices are processed 
+   several at a time with SIMD, so many filtered voices cost little more 
+   than a few. c must be a valid KameMix_Channel returned from a KameMix 
+   function or unset with KameMix_unsetChannel. Returns passed in channel 
+   if channel wasn't finished, otherwise returns unset channel. */
+KAMEMIX_DECLSPEC 
+KameMix_Channel KameMix_setFilter(KameMix_Channel c, KameMix_FilterType type,
+                                  float cutoff, float q);
+
+/* Plays Sound/Stream ratio times as fast, changing its pitch with it: 2.0f
+   is an octave up, and 0.5f an octave down. Clamped so it reads at most 16
+   sample frames per output frame. Default is 1.0f. A voice is resampled 
+   from then on, even if set back to 1.0f, so it doesn't skip frames read 
+   ahead. c must be a valid KameMix_Channel returned from a KameMix 
+   function or unset with KameMix_unsetChannel. Returns passed in channel 
+   if channel wasn't finished, otherwise returns unset channel. */
+KAMEMIX_DECLSPEC 
+KameMix_Channel KameMix_setPitch(KameMix_Channel c, float ratio);
+
+/* Returns pitch ratio of Sound/Stream from KameMix_setPitch, or 0.0f if it 
+   was finished. c must be a valid KameMix_Channel returned from a KameMix 
+   function or unset with KameMix_unsetChannel */
+KAMEMIX_DECLSPEC 
+float KameMix_getPitch(KameMix_Channel c);
+
 /* Sets volume of Sound/Stream. c must be a valid KameMix_Channel returned 
    from a KameMix function or unset with KameMix_unsetChannel. Returns passed 
    in channel if channel wasn't finished, otherwise returns unset channel. */
@@ -200,6 +696,63 @@ KameMix_Channel KameMix_setVolume(KameMix_Channel c, float volume);
 KAMEMIX_DECLSPEC 
 float KameMix_getVolume(KameMix_Channel c);
 
+/* Starts a batch of channel changes on this thread. Until
+   KameMix_commitBatch, KameMix_setPos, KameMix_setVolume and
+   KameMix_setMaxDistance from this thread are recorded instead of applied,
+   and return the passed in channel without checking if it's finished.
+   Batches can be nested, and are committed by the outermost
+   KameMix_commitBatch. */
+KAMEMIX_DECLSPEC void KameMix_beginBatch();
+
+/* Applies the changes recorded since KameMix_beginBatch all at once at the
+   start of the next block mixed, so they're heard together in the same
+   callback, locking the mixer only once. Until then getters return the
+   previous values. Changes to channels finished by then are ignored, and 
+   so are changes overridden by setting or ramping the same channel 
+   directly before then. */
+KAMEMIX_DECLSPEC void KameMix_commitBatch();
+
+/* Sets 2d positions of n Sounds/Streams in one batch, like KameMix_setPos
+   between KameMix_beginBatch and KameMix_commitBatch. channels[i] is moved
+   to xs[i], ys[i]. */
+KAMEMIX_DECLSPEC
+void KameMix_setPositions(const KameMix_Channel *channels,
+                          const float *xs, const float *ys, int n);
+
+/* Sets volumes of n Sounds/Streams in one batch, like KameMix_setVolume
+   between KameMix_beginBatch and KameMix_commitBatch. */
+KAMEMIX_DECLSPEC
+void KameMix_setVolumes(const KameMix_Channel *channels,
+                        const float *volumes, int n);
+
+/* Changes volume of Sound/Stream to volume over secs, along curve. The ramp
+   is advanced by the audio thread each block mixed, and waits while 
+   paused. KameMix_getVolume returns the volume reached so far, and 
+   KameMix_setVolume cancels the ramp. c must be a valid KameMix_Channel 
+   returned from a KameMix function or unset with KameMix_unsetChannel. 
+   Returns passed in channel if channel wasn't finished, otherwise returns 
+   unset channel. */
+KAMEMIX_DECLSPEC
+KameMix_Channel KameMix_rampVolume(KameMix_Channel c, float volume, 
+                                   float secs, KameMix_RampCurve curve);
+
+/* Moves Sound/Stream to x, y over secs, along curve. Advanced like 
+   KameMix_rampVolume, and canceled by KameMix_setPos. Velocity from 
+   KameMix_setVelocity isn't applied while ramping. Returns passed in 
+   channel if channel wasn't finished, otherwise returns unset channel. */
+KAMEMIX_DECLSPEC
+KameMix_Channel KameMix_rampPos(KameMix_Channel c, float x, float y, 
+                                float secs, KameMix_RampCurve curve);
+
+/* Sets velocity of Sound/Stream in units per second. Its position is moved
+   by the audio thread each block mixed, so it moves smoothly between calls
+   to KameMix_setPos, which can set the position where the game has it 
+   without changing velocity. Use 0.0f, 0.0f to stop moving. Returns passed 
+   in channel if channel wasn't finished, otherwise returns unset 
+   channel. */
+KAMEMIX_DECLSPEC
+KameMix_Channel KameMix_setVelocity(KameMix_Channel c, float vx, float vy);
+
 /*
  * Sound functions
 */
@@ -207,6 +760,23 @@ float KameMix_getVolume(KameMix_Channel c);
 /* Loads OGG Vorbis and WAV files. Returns NULL on error. */
 KAMEMIX_DECLSPEC KameMix_Sound* KameMix_loadSound(const char *file);
 
+/* Loads OGG Vorbis and WAV file data from memory. The file type is detected
+   from its header. data is only used while loading, so it can be freed
+   after return. Returns NULL on error. */
+KAMEMIX_DECLSPEC
+KameMix_Sound* KameMix_loadSoundMem(const void *data, size_t len);
+
+/* Loads OGG Vorbis and WAV files read with io callbacks. The file type is
+   detected from its header. io->close is called with userdata before
+   return. Returns NULL on error. */
+KAMEMIX_DECLSPEC
+KameMix_Sound* KameMix_loadSoundIO(const KameMix_IO *io, void *userdata);
+
+/* Sets KameMix_SoundFlags used by all KameMix_loadSound functions called 
+   after this. Default is KameMix_SoundDefault. */
+KAMEMIX_DECLSPEC void KameMix_setSoundFlags(int flags);
+KAMEMIX_DECLSPEC int KameMix_getSoundFlags();
+
 /* Decrements refcount, and free when count reaches 0. sound can be NULL */
 KAMEMIX_DECLSPEC void KameMix_freeSound(KameMix_Sound *sound);
 
@@ -214,6 +784,68 @@ KAMEMIX_DECLSPEC void KameMix_freeSound(KameMix_Sound *sound);
    thread safety. */
 KAMEMIX_DECLSPEC void KameMix_incSoundRef(KameMix_Sound *sound);
 
+/* Returns size in bytes of sound's audio data, or 0 if it was evicted by 
+   the Sound cache budget. */
+KAMEMIX_DECLSPEC size_t KameMix_getSoundMemory(KameMix_Sound *sound);
+
+/* Returns 1 if sound was loaded with KameMix_SoundProgressive and is still 
+   being decoded, or 0 otherwise. */
+KAMEMIX_DECLSPEC int KameMix_isSoundLoading(KameMix_Sound *sound);
+
+/* Limits voices used by sound when it's played many times at once, such as
+   explosions or hits in a burst. Plays starting within window_secs of the 
+   last voice started for sound are merged into it: its volume is increased
+   by the play's volume, and its channel is returned, instead of mixing 
+   another copy of the same samples. Only plays from startpos_sec 0.0 that 
+   aren't paused are merged, and only if their position, max_distance, 
+   group, loops and fade_secs are the same as the merged voice's. Voices of
+   emitters from KameMix_addEmitter are never merged. max_voices limits 
+   voices playing sound at once: when all are used, a play replaces the 
+   quietest voice, after position and group volume, if it's louder, or else
+   unset channel is returned. 0.0f window_secs and 0 max_voices disable 
+   each, which is the default. */
+KAMEMIX_DECLSPEC 
+void KameMix_setSoundCoalesce(KameMix_Sound *sound, float window_secs, 
+                              int max_voices);
+
+/* Enables or disables the Sound cache, which is disabled by default. When
+   enabled, KameMix_loadSound returns the already loaded KameMix_Sound for
+   the same file path and KameMix_SoundFlags, with its refcount incremented,
+   instead of loading the file again. If multiple threads load the same
+   file at once, it's only loaded once. Sounds stay in the cache until their
+   refcount reaches 0. Sounds loaded from memory or KameMix_IO are never
+   cached. Paths aren't normalized, so different paths to the same file are
+   loaded separately. */
+KAMEMIX_DECLSPEC void KameMix_setSoundCacheEnabled(int enabled);
+KAMEMIX_DECLSPEC int KameMix_isSoundCacheEnabled();
+
+/* Calls func with userdata for each Sound in the cache. func must not load
+   or free Sounds. func can be NULL to only count Sounds. Returns number of
+   cached Sounds. */
+KAMEMIX_DECLSPEC 
+int KameMix_forEachCachedSound(KameMix_CachedSoundFunc func, void *userdata);
+
+/* Returns total size in bytes of audio data of all cached Sounds. */
+KAMEMIX_DECLSPEC size_t KameMix_getSoundCacheMemory();
+
+/* Sets max bytes of audio data the Sound cache keeps loaded, or 0 for no 
+   limit, which is the default. When over budget, the audio data of the 
+   least recently used cached Sounds that aren't playing is freed. An evicted 
+   Sound stays valid, and is reloaded from its file in a background thread 
+   the next time it's played, as set by KameMix_setReloadPolicy. Only 
+   Sounds loaded while the cache is enabled count against the budget. */
+KAMEMIX_DECLSPEC void KameMix_setSoundCacheBudget(size_t bytes);
+KAMEMIX_DECLSPEC size_t KameMix_getSoundCacheBudget();
+
+/* Default is KameMix_ReloadDelay */
+KAMEMIX_DECLSPEC void KameMix_setReloadPolicy(KameMix_ReloadPolicy policy);
+KAMEMIX_DECLSPEC KameMix_ReloadPolicy KameMix_getReloadPolicy();
+
+/* Fills stats with counters since KameMix_init or the last reset. */
+KAMEMIX_DECLSPEC 
+void KameMix_getSoundCacheStats(KameMix_SoundCacheStats *stats);
+KAMEMIX_DECLSPEC void KameMix_resetSoundCacheStats();
+
 /* Play sound with options. sound can be played multiple times. c must be a 
    valid KameMix_Channel returned from a KameMix function or unset with 
    KameMix_unsetChannel. If it's valid then the previous sound is stopped. 
@@ -231,6 +863,16 @@ KameMix_playSound(KameMix_Sound *sound, KameMix_Channel c,
                   float vol, float fade_secs, float x, float y, 
                   float max_distance, int group, int paused);
 
+/* Same as KameMix_playSound, but starts playing at mixer clock frame 
+   clock_frame, from KameMix_getClock, instead of at the start of the next 
+   block mixed. Plays right away if clock_frame has passed. */
+KAMEMIX_DECLSPEC 
+KameMix_Channel 
+KameMix_playSoundAt(KameMix_Sound *sound, KameMix_Channel c, 
+                    uint64_t clock_frame, double startpos_sec, int loops, 
+                    float vol, float fade_secs, float x, float y, 
+                    float max_distance, int group, int paused);
+
 /*
  * Stream functions
 */
@@ -238,6 +880,19 @@ KameMix_playSound(KameMix_Sound *sound, KameMix_Channel c,
 /* Loads OGG Vorbis and WAV files. Returns NULL on error. */
 KAMEMIX_DECLSPEC KameMix_Stream* KameMix_loadStream(const char *file);
 
+/* Loads OGG Vorbis and WAV file data from memory. The file type is detected
+   from its header. data is read while streaming, so it must stay valid
+   until the stream is freed. Returns NULL on error. */
+KAMEMIX_DECLSPEC
+KameMix_Stream* KameMix_loadStreamMem(const void *data, size_t len);
+
+/* Loads OGG Vorbis and WAV files read with io callbacks. The file type is
+   detected from its header. Callbacks are called from a separate reading
+   thread, and io->close is called with userdata when the stream is freed,
+   or before return on error. Returns NULL on error. */
+KAMEMIX_DECLSPEC
+KameMix_Stream* KameMix_loadStreamIO(const KameMix_IO *io, void *userdata);
+
 /* Decrements private refcount used by KameMix, and frees when count reaches 0. 
    stream can be NULL */
 KAMEMIX_DECLSPEC void KameMix_freeStream(KameMix_Stream *stream);
@@ -14,6 +14,8 @@ public:
   ~Sound();
 
   bool load(const char *filename);
+  bool loadMem(const void *data, size_t len);
+  bool loadIO(const KameMix_IO *io, void *userdata);
   void release(); 
   bool isLoaded() const;
 
@@ -116,6 +118,22 @@ bool Sound::load(const char *filename)
   return sound != nullptr;
 }
 
+inline
+bool Sound::loadMem(const void *data, size_t len) 
+{ 
+  release();
+  sound = KameMix_loadSoundMem(data, len);
+  return sound != nullptr;
+}
+
+inline
+bool Sound::loadIO(const KameMix_IO *io, void *userdata) 
+{ 
+  release();
+  sound = KameMix_loadSoundIO(io, userdata);
+  return sound != nullptr;
+}
+
 inline
 void Sound::release() 
 { 
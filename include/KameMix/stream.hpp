@@ -14,6 +14,8 @@ public:
   Stream& operator=(const Stream &other) = delete;
 
   bool load(const char *filename);
+  bool loadMem(const void *data, size_t len);
+  bool loadIO(const KameMix_IO *io, void *userdata);
   void release(); 
   bool isLoaded() const;
 
@@ -86,6 +88,22 @@ bool Stream::load(const char *filename)
   return stream != nullptr;
 }
 
+inline
+bool Stream::loadMem(const void *data, size_t len) 
+{ 
+  release();
+  stream = KameMix_loadStreamMem(data, len);
+  return stream != nullptr;
+}
+
+inline
+bool Stream::loadIO(const KameMix_IO *io, void *userdata) 
+{ 
+  release();
+  stream = KameMix_loadStreamIO(io, userdata);
+  return stream != nullptr;
+}
+
 inline
 void Stream::release() 
 { 
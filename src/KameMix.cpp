@@ -1,8 +1,24 @@
 #include "KameMix.h"
 #include "sound_buffer.h"
+#include "sound_handle.h"
+#include "sound_cache.h"
+#include "audio_guard.h"
+#include "mem_pool.h"
+#include "mix_kernels.h"
+#include "mix_workers.h"
+#include "mix_ahead.h"
+#include "event_queue.h"
+#include "emitters.h"
+#include "convolver.h"
+#include "voice_filter.h"
+#include "resampler.h"
 #include "stream_buffer.h"
 #include "audio_mem.h"
 #include "sdl_helper.h"
+#include "data_source.h"
+#include "vorbis_decoder.h"
+#include "adpcm.h"
+#include "rt_check.h"
 #include <SDL.h>
 #include <cstring>
 #include <cassert>
@@ -17,18 +33,25 @@
 using namespace KameMix;
 #define PI_F 3.141592653589793f
 
-struct KameMix_Sound {
-  KameMix_Sound(const char *file) : buffer{file}, refcount{1} { }
-  SoundBuffer buffer;
-  std::atomic<int> refcount;
-};
-
 struct KameMix_Stream {
+  KameMix_Stream() : refcount{1} { }
   KameMix_Stream(const char *file) : buffer{file}, refcount{1}  { }
   StreamBuffer buffer;
   std::atomic<int> refcount;
 };
 
+// Impulse response from KameMix_loadReverb
+struct KameMix_Reverb {
+  KameMix_Reverb(const float *ir, int frames, int channels, int block_frames,
+                 float block_secs, bool tail_thread, 
+                 const MixKernels &kernels) 
+    : convolver{ir, frames, channels, block_frames, block_secs, tail_thread,
+                kernels}
+  { }
+  Convolver convolver;
+  float length; // secs
+};
+
 namespace {
 
 enum PlayingType : uint8_t {
@@ -45,20 +68,6 @@ enum PlayState : uint8_t {
   UnpausingState
 };
 
-struct VolumeData {
-  float left_volume;
-  float right_volume;
-  float lfade; // fade_percent
-  float rfade; // fade_percent
-  // increment/decrement to add to fade each time after applying fade to 
-  // audio stream 
-  float lmod; 
-  float rmod; 
-  // number of times to add mod to fade; 0 means apply fade once to 
-  // audio stream without adding mod after
-  int mod_times; 
-};
-
 struct CopyResult {
   int target_amount;
   int src_amount;
@@ -73,8 +82,55 @@ struct Position2d {
   float x, y;
 };
 
+// Progress of a value automated on the audio thread. Each block, advance 
+// gives how far along the ramp the value should be.
+struct Ramp {
+  void start(float secs, KameMix_RampCurve curve_) 
+  { 
+    time = 0.0f;
+    total = secs;
+    curve = curve_;
+  }
+  void unset() { total = 0.0f; }
+  bool isActive() const { return total > 0.0f; }
+  // Advances by secs, and returns fraction of ramp done from 0 to 1. Unsets
+  // when done.
+  float advance(float secs);
+
+  float time; // elapsed secs
+  float total; // secs, 0.0f if not ramping
+  KameMix_RampCurve curve;
+};
+
+// Submix of the voices in a group from KameMix_createBus
+struct Bus {
+  Bus() : buf{nullptr}, parent{-1}, last_volume{1.0f}, effect{nullptr}, 
+    effect_data{nullptr} 
+  { 
+    lock.clear();
+  }
+
+  float *buf; // block of stereo float, zeroed before each block
+  int parent; // group of parent bus, or -1 to mix into output
+  float last_volume; // group volume mixed at end of last block
+  KameMix_BusEffectFunc effect;
+  void *effect_data;
+  std::atomic_flag lock; // held by mix workers adding a voice to buf
+};
+
+// Volume of voices in a group from KameMix_createGroup
+struct Group {
+  float volume;
+  Ramp ramp; // from KameMix_rampGroupVolume
+  float ramp_start;
+  float ramp_target;
+  Bus *bus; // nullptr if not a bus
+  int send; // bus from KameMix_setGroupSend, or -1
+  float send_level;
+};
+
 struct PlayingSound {
-  PlayingSound() : tag{InvalidType} { }
+  PlayingSound() : decoder{nullptr}, tag{InvalidType} { }
   PlayingSound(KameMix_Sound *s, int loops, int buf_pos, int paused, 
                float fade, float vol, float x, float y, float max_distance, 
                int group, unsigned id);
@@ -105,7 +161,10 @@ struct PlayingSound {
   void decrementLoopCount();
   Position2d getRelativePos() const;
   float volumeInGroup() const;
-  VolumeData getVolumeData();
+  // Advances volume and position ramps and velocity by secs.
+  void advanceAutomation(float secs);
+  // Returns volume to mix next secs with, and advances fades by secs.
+  VolumeData getVolumeData(float secs);
 
   bool streamSwapNeeded();
   bool streamSwapBuffers();
@@ -124,9 +183,27 @@ struct PlayingSound {
     KameMix_Sound *sound_;
     KameMix_Stream *stream_;
   };
+  VorbisDecoder *decoder; // only used for compressed Sounds, else nullptr
+  AdpcmDecoder adpcm; // only used for ADPCM Sounds
   int buffer_pos; // byte pos in sound/stream
+  // Sound is waiting for its data to be reloaded by SoundCache, and will 
+  // start at start_sec
+  bool waiting_reload;
+  double start_sec;
+  bool starved; // Stream's next buffer wasn't ready; sent EventStarved
+  // false for emitter voices, which the app didn't play, so has no 
+  // channel to get events about
+  bool send_events;
+  // mixer clock frames to start playing at, and stop before. start_frame is
+  // 0 to start right away, and stop_frame is UINT64_MAX to not stop.
+  uint64_t start_frame;
+  uint64_t stop_frame;
+  float pitch; // from KameMix_setPitch
+  VoiceResampler resampler;
   int loop_count; // -1 for infinite loop, 0 to play once, n to loop n times
   int group;
+  int send; // bus from KameMix_setSend, or -1 to use group's
+  float send_level;
   unsigned id;
   float fade_total; // fadein/out total time in sec, negative for fadeout
   float fade_time; // elapsed time for fadein, time left for fadeout
@@ -135,6 +212,15 @@ struct PlayingSound {
   float rvolume;
   float x, y; // absolute position
   float max_distance;
+  // volume and position automation, advanced by getVolumeData
+  Ramp volume_ramp;
+  float volume_start;
+  float volume_target;
+  Ramp pos_ramp;
+  Position2d pos_start;
+  Position2d pos_target;
+  Position2d velocity; // units per sec
+  VoiceFilter filter; // from KameMix_setFilter
   PlayingType tag;
   PlayState state;
 };
@@ -142,19 +228,65 @@ struct PlayingSound {
 typedef std::vector<PlayingSound, Alloc<PlayingSound>> SoundBuf;
 typedef std::vector<int, Alloc<int>> FreeList;
 
+// Voice to mix in parallel mode
+struct MixJob {
+  int cost; // from voiceCost
+  int idx; // in kame_mix.sounds
+  int start; // frames of block to mix, from scheduledFrames
+  int end;
+};
+typedef std::vector<MixJob, Alloc<MixJob>> MixJobs;
+
+// How a voice copied for a block is mixed, kept until mixed so filtered 
+// voices can wait for their batch
+struct VoiceMix {
+  int idx; // in kame_mix.sounds
+  unsigned id;
+  int start; // frame of block
+  int len; // float samples
+  VolumeData vdata;
+  Bus *bus; // from voiceBus_locked
+  Bus *send; // from voiceSend_locked
+  float send_level;
+};
+
+// Filtered voices batched by one mixing thread
+struct FilterJobs {
+  FilterBatch batch;
+  VoiceMix voices[FilterBatch::MAX_VOICES];
+};
+
+enum ParamType : uint8_t {
+  PosParam,
+  VolumeParam,
+  MaxDistanceParam
+};
+
+// Channel change recorded between KameMix_beginBatch and KameMix_commitBatch
+struct ParamUpdate {
+  KameMix_Channel channel;
+  ParamType type;
+  float a, b; // x and y for PosParam, else new value in a
+};
+typedef std::vector<ParamUpdate, Alloc<ParamUpdate>> ParamUpdates;
+
 struct KameMixData {
   SDL_AudioDeviceID dev_id;
-  // for copying sound/stream data before mixing
+  // for copying sound/stream data as float before mixing
   uint8_t *audio_tmp_buf; 
   int audio_tmp_buf_len;
-  int32_t *audio_mix_buf; // for mixing int16_t audio
+  float *audio_mix_buf; // for mixing before converting to int16_t output
   int audio_mix_buf_len;
   std::mutex audio_mutex;
-  float secs_per_callback;
+  float secs_per_block; // time of block_len of output
+  int block_len; // bytes of output mixed at once by mixBlock
+  // Frames mixed since init, advanced by mixBlock. The next frame mixed is
+  // at this time.
+  std::atomic<uint64_t> clock;
   SoundBuf *sounds;
   FreeList *free_list;
   int number_playing;
-  std::vector<float> *groups;
+  std::vector<Group> *groups;
   float master_volume;
   float listener_x;
   float listener_y;
@@ -165,101 +297,339 @@ struct KameMixData {
   KameMix_MallocFunc user_malloc;
   KameMix_FreeFunc user_free;
   KameMix_ReallocFunc user_realloc;
+  std::atomic<int> sound_flags;
+  SoundCache *sound_cache;
+  std::atomic<bool> sound_cache_enabled;
+  MemPool *mem_pool; // nullptr if not enabled in KameMix_initEx
+  int max_voices; // 0 if sounds can grow
+  int max_groups; // 0 if groups can grow
+  // user allocator wrapped by checkedMalloc/checkedRealloc, if 
+  // debug_alloc_check is set in KameMix_initEx
+  KameMix_MallocFunc checked_malloc;
+  KameMix_ReallocFunc checked_realloc;
+  const MixKernels *kernels; // for instruction set picked in KameMix_initEx
+  KameMix_SimdLevel simd_level;
+  KameMix_ResampleQuality resample_quality;
+  // nullptr unless KameMix_InitOptions.mix_threads is set
+  MixWorkers *mix_workers;
+  MixJobs *mix_jobs; // reserved to capacity of sounds
+  // committed batches, applied at the start of the next block
+  ParamUpdates *pending_updates;
+  // nullptr unless KameMix_InitOptions.mix_ahead_frames is set
+  MixAhead *mix_ahead;
+  EventQueue *events; // read by KameMix_pollEvents
+  Emitters *emitters;
+  // a batch of filtered voices for each thread mixing
+  FilterJobs *filter_jobs;
+  int num_filter_jobs;
+  float filter_smoothing; // of coefficients each block, from secs_per_block
 } kame_mix;
 
+// Number of AudioGuards with kame_mix.audio_mutex locked in this thread
+thread_local int audio_lock_depth = 0;
+
+// Nesting of KameMix_beginBatch in this thread, and changes recorded while
+// it's above 0
+thread_local int batch_depth = 0;
+thread_local ParamUpdates batch_updates;
+
+// Used as user allocator with KameMix_InitOptions.debug_alloc_check. The
+// audio thread would wait on allocations with audio_mutex locked.
+void* checkedMalloc(size_t len)
+{
+  assert(audio_lock_depth == 0 && "allocated with audio_mutex locked");
+  return kame_mix.checked_malloc(len);
+}
+
+void* checkedRealloc(void *ptr, size_t len)
+{
+  assert(audio_lock_depth == 0 && "allocated with audio_mutex locked");
+  return kame_mix.checked_realloc(ptr, len);
+}
+
 inline unsigned getNextID_locked() { return kame_mix.next_id++; }
 
 void audioCallback(void *udata, uint8_t *stream, const int len);
+void mixBlock(uint8_t *stream, const int len);
+bool startReloadedSound_locked(PlayingSound &sound);
 VolumeFade applyPosition(float rel_x, float rel_y);
-void clamp(float *buf, int len);
-void clamp(int16_t *target, int32_t *src, int len);
-template <class T, class U>
-void mixStream(T *target, U *source, int len);
-template <class T>
-void applyVolume(T *stream, int len, float left_vol, float right_vol);
-template <class T>
-void applyVolume(T *stream, int len_, const VolumeData &vdata);
 template <class CopyFunc>
 int copySound(CopyFunc copy, uint8_t *buffer, const int buf_len, 
               PlayingSound &sound, SoundBuffer &sound_buf);
 template <class CopyFunc>
+int copySound(CopyFunc copy, uint8_t *buffer, const int buf_len, 
+              PlayingSound &sound, VorbisDecoder &decoder);
+template <class CopyFunc>
 int copyStream(CopyFunc copy, uint8_t *buffer, const int buf_len, 
                PlayingSound &stream, StreamBuffer &stream_buf);
-int copySound(PlayingSound &sound, SoundBuffer &sound_buf, 
-              uint8_t *buf, int len);
-int copyStream(PlayingSound &sound, StreamBuffer &stream_buf,
-              uint8_t *buf, int len);
+int copyADPCM(uint8_t *buffer, const int buf_len, 
+              PlayingSound &sound, SoundBuffer &sound_buf);
+// Copies next len bytes of a voice to buf as stereo float, and returns 
+// bytes copied
+typedef int (*CopyVoiceFunc)(PlayingSound &sound, uint8_t *buf, int len);
+CopyVoiceFunc copyVoiceFunc(PlayingSound &sound);
+void applyUpdates_locked();
+void dropUpdates_locked(KameMix_Channel c, ParamType type);
+// Copy functions convert mono or stereo samples of type T to stereo float
 template <class T>
 struct CopyMono {
   CopyResult operator()(uint8_t *dst_, int target_len, uint8_t *src_,
                         int src_len);
 };
+template <class T>
 struct CopyStereo {
-  CopyResult operator()(uint8_t *dst, int dst_len, uint8_t *src,
+  CopyResult operator()(uint8_t *dst_, int target_len, uint8_t *src_,
                         int src_len);
 };
 
 } // end anon namespace
 
+void AudioGuard::lock() 
+{ 
+  rtLock(kame_mix.audio_mutex); // reports waiting in audio thread
+  locked = true;
+  ++audio_lock_depth;
+}
+
+void AudioGuard::unlock() 
+{ 
+  --audio_lock_depth;
+  locked = false;
+  kame_mix.audio_mutex.unlock(); 
+}
+
 extern "C" {
 
 void KameMix_setListenerPos(float x, float y)
 {
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+  AudioGuard guard;
   kame_mix.listener_x = x;
   kame_mix.listener_y = y;
 }
 
 void KameMix_getListenerPos(float *x, float *y)
 {
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+  AudioGuard guard;
   *x = kame_mix.listener_x;
   *y = kame_mix.listener_y;
 }
 
 float KameMix_getMasterVolume()
 {
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+  AudioGuard guard;
   return kame_mix.master_volume;
 }
 
 void KameMix_setMasterVolume(float volume)
 {
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+  AudioGuard guard;
   kame_mix.master_volume = volume;
 }
 
-int KameMix_createGroup()
+// Returns index of new group with bus, or -1 if max_groups are created.
+static
+int addGroup_locked(Bus *bus)
 {
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
-  kame_mix.groups->push_back(1.0f); // group start at 100% volume
+  if (kame_mix.max_groups > 0 && 
+      (int)kame_mix.groups->size() == kame_mix.max_groups) {
+    return -1; // don't reallocate preallocated groups
+  }
+  Group group = { 1.0f }; // group start at 100% volume
+  group.ramp.unset();
+  group.bus = bus;
+  group.send = -1;
+  group.send_level = 0.0f;
+  kame_mix.groups->push_back(group);
   return kame_mix.groups->size() - 1; // idx to group
 }
 
+int KameMix_createGroup()
+{
+  AudioGuard guard;
+  return addGroup_locked(nullptr);
+}
+
+int KameMix_createBus(int parent)
+{
+  // allocated before locking, so the audio thread doesn't wait on it
+  Bus *bus = km_new<Bus>();
+  bus->buf = (float*)km_malloc(kame_mix.audio_tmp_buf_len);
+  if (!bus->buf) {
+    km_delete(bus);
+    return -1;
+  }
+  memset(bus->buf, 0, kame_mix.audio_tmp_buf_len);
+  bus->parent = parent;
+
+  AudioGuard guard;
+  assert((parent == -1 || (parent >= 0 && 
+          parent < (int)kame_mix.groups->size() && 
+          (*kame_mix.groups)[parent].bus)) && "parent must be a bus");
+  const int group = addGroup_locked(bus);
+  if (group == -1) {
+    guard.unlock();
+    km_free(bus->buf);
+    km_delete(bus);
+  }
+  return group;
+}
+
+void KameMix_setBusEffect(int group, KameMix_BusEffectFunc effect, 
+                          void *userdata)
+{
+  AudioGuard guard;
+  assert(group >= 0 && group < (int)kame_mix.groups->size());
+  Bus *bus = (*kame_mix.groups)[group].bus;
+  assert(bus && "group must be a bus");
+  bus->effect = effect;
+  bus->effect_data = userdata;
+}
+
+void KameMix_setGroupSend(int group, int bus, float level)
+{
+  AudioGuard guard;
+  assert(group >= 0 && group < (int)kame_mix.groups->size());
+  assert((bus == -1 || (bus >= 0 && bus < (int)kame_mix.groups->size() && 
+          (*kame_mix.groups)[bus].bus)) && "bus must be a bus");
+  // buses are processed last to first, so sends must go to earlier ones
+  assert((bus == -1 || !(*kame_mix.groups)[group].bus || bus < group) && 
+         "bus must be created before group");
+  (*kame_mix.groups)[group].send = bus;
+  (*kame_mix.groups)[group].send_level = level;
+}
+
+KameMix_Reverb* KameMix_loadReverb(const char *ir_file, int flags)
+{
+  SoundBuffer buffer;
+  if (!buffer.load(ir_file, KameMix_SoundDefault)) {
+    return NULL;
+  }
+  const int channels = buffer.numChannels();
+  const int frames = buffer.size() / buffer.sampleBlockSize();
+  std::vector<float, Alloc<float>> ir(frames * channels);
+  if (buffer.format() == KameMix_OutputFloat) {
+    memcpy(ir.data(), buffer.data(), ir.size() * sizeof(float));
+  } else {
+    const int16_t *src = (const int16_t*)buffer.data();
+    for (size_t i = 0; i < ir.size(); ++i) {
+      ir[i] = src[i] / 32768.0f;
+    }
+  }
+
+  // Larger partitions cost less per second, but delay the reverb by a 
+  // partition. A partition is processed each block when mix blocks are 
+  // the same size.
+  const int min_partition_frames = 256;
+  const int block_frames = 
+    kame_mix.audio_tmp_buf_len / (kame_mix.channels * sizeof(float));
+  int partition = min_partition_frames;
+  while (partition < block_frames) {
+    partition *= 2;
+  }
+  KameMix_Reverb *reverb = (KameMix_Reverb*)km_malloc(sizeof(KameMix_Reverb));
+  if (!reverb) {
+    return NULL;
+  }
+  new (reverb) KameMix_Reverb(ir.data(), frames, channels, partition, 
+                              (float)partition / kame_mix.frequency,
+                              !(flags & KameMix_ReverbNoThread), 
+                              *kame_mix.kernels);
+  reverb->length = (float)frames / kame_mix.frequency;
+  return reverb;
+}
+
+void KameMix_freeReverb(KameMix_Reverb *reverb)
+{
+  if (reverb) {
+    km_delete(reverb);
+  }
+}
+
+float KameMix_getReverbLength(KameMix_Reverb *reverb)
+{
+  return reverb->length;
+}
+
+unsigned KameMix_getReverbLateBlocks(KameMix_Reverb *reverb)
+{
+  return reverb->convolver.lateBlocks();
+}
+
+void KameMix_reverbEffect(float *buf, int frames, void *reverb)
+{
+  ((KameMix_Reverb*)reverb)->convolver.process(buf, frames);
+}
+
 void KameMix_setGroupVolume(int group, float volume)
 {
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+  AudioGuard guard;
+  assert(group >= 0 && group < (int)kame_mix.groups->size());
+  (*kame_mix.groups)[group].volume = volume;
+  (*kame_mix.groups)[group].ramp.unset();
+}
+
+void KameMix_rampGroupVolume(int group, float volume, float secs,
+                             KameMix_RampCurve curve)
+{
+  AudioGuard guard;
   assert(group >= 0 && group < (int)kame_mix.groups->size());
-  (*kame_mix.groups)[group] = volume;
+  Group &g = (*kame_mix.groups)[group];
+  if (secs > 0.0f) {
+    g.ramp_start = g.volume;
+    g.ramp_target = volume;
+    g.ramp.start(secs, curve);
+  } else {
+    g.volume = volume;
+    g.ramp.unset();
+  }
 }
 
 float KameMix_getGroupVolume(int group)
 {
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+  AudioGuard guard;
   assert(group >= 0 && group < (int)kame_mix.groups->size());
-  return (*kame_mix.groups)[group];
+  return (*kame_mix.groups)[group].volume;
+}
+
+int KameMix_addEmitter(KameMix_Sound *sound, float x, float y, 
+                       float max_distance, float volume, int group)
+{
+  return kame_mix.emitters->add(sound, x, y, max_distance, volume, group);
+}
+
+void KameMix_removeEmitter(int emitter)
+{
+  kame_mix.emitters->remove(emitter);
+}
+
+void KameMix_setEmitterPos(int emitter, float x, float y)
+{
+  kame_mix.emitters->setPos(emitter, x, y);
+}
+
+void KameMix_setEmitterVolume(int emitter, float volume)
+{
+  kame_mix.emitters->setVolume(emitter, volume);
+}
+
+int KameMix_updateEmitters()
+{
+  float x, y;
+  KameMix_getListenerPos(&x, &y);
+  return kame_mix.emitters->update(x, y);
 }
 
 // May include stopped/finished kame_mix.sounds if called far away from update
 int KameMix_numberPlaying() 
 { 
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+  AudioGuard guard;
   return kame_mix.number_playing; 
 }
 
 int KameMix_getFrequency() { return kame_mix.frequency; }
 int KameMix_getChannels() { return kame_mix.channels; }
 KameMix_OutputFormat KameMix_getFormat() { return kame_mix.format; }
+KameMix_SimdLevel KameMix_getSimdLevel() { return kame_mix.simd_level; }
 
 int KameMix_getFormatSize()
 { 
@@ -288,8 +658,39 @@ KameMix_MallocFunc KameMix_getMalloc() { return kame_mix.user_malloc; }
 KameMix_FreeFunc KameMix_getFree() { return kame_mix.user_free; }
 KameMix_ReallocFunc KameMix_getRealloc() { return kame_mix.user_realloc; }
 
+void KameMix_getDefaultInitOptions(KameMix_InitOptions *options)
+{
+  options->freq = 44100;
+  options->sample_buf_size = 2048;
+  options->format = KameMix_OutputFloat;
+  options->use_pool = 0;
+  options->pool_streams = 0;
+  options->max_voices = 0;
+  options->max_groups = 0;
+  options->debug_alloc_check = 0;
+  options->max_simd = KameMix_SimdAVX512;
+  options->mix_threads = 0;
+  options->mix_ahead_frames = 0;
+  options->mix_block_frames = 128;
+  options->max_events = 256;
+  options->resample_quality = KameMix_ResampleCubic;
+}
+
 int KameMix_init(int freq, int sample_buf_size, KameMix_OutputFormat format_)
 {
+  KameMix_InitOptions options;
+  KameMix_getDefaultInitOptions(&options);
+  options.freq = freq;
+  options.sample_buf_size = sample_buf_size;
+  options.format = format_;
+  return KameMix_initEx(&options);
+}
+
+int KameMix_initEx(const KameMix_InitOptions *options)
+{
+  const int freq = options->freq;
+  const int sample_buf_size = options->sample_buf_size;
+
   if (SDL_Init(SDL_INIT_AUDIO) < 0) {
     return false;
   }
@@ -301,7 +702,16 @@ int KameMix_init(int freq, int sample_buf_size, KameMix_OutputFormat format_)
     kame_mix.user_realloc = realloc;
   }
 
-  kame_mix.format = format_;
+  kame_mix.format = options->format;
+  kame_mix.kernels = &selectMixKernels(options->max_simd, kame_mix.simd_level);
+  kame_mix.resample_quality = options->resample_quality;
+
+  if (options->debug_alloc_check) {
+    kame_mix.checked_malloc = kame_mix.user_malloc;
+    kame_mix.checked_realloc = kame_mix.user_realloc;
+    kame_mix.user_malloc = checkedMalloc;
+    kame_mix.user_realloc = checkedRealloc;
+  }
 
   int allowed_changes = SDL_AUDIO_ALLOW_FREQUENCY_CHANGE;
   SDL_AudioSpec spec_want = { 0 };
@@ -322,29 +732,101 @@ int KameMix_init(int freq, int sample_buf_size, KameMix_OutputFormat format_)
   kame_mix.frequency = dev_spec.freq;
   kame_mix.channels = dev_spec.channels;
 
-  // kame_mix.format must have already been set above
+  // The device's buffer is mixed in blocks of block_frames, so fades and
+  // volume changes are updated more often than once per callback. When 
+  // mixing ahead, blocks can be larger than the device's buffer.
+  const bool mix_ahead = options->mix_ahead_frames > 0;
+  int block_frames = options->mix_block_frames;
+  if (block_frames <= 0) {
+    block_frames = mix_ahead ? 128 : dev_spec.samples;
+  } else if (!mix_ahead && block_frames > dev_spec.samples) {
+    block_frames = dev_spec.samples;
+  }
+
+  // all sounds/streams are converted to float before mixing
   kame_mix.audio_tmp_buf_len = 
-    dev_spec.samples * dev_spec.channels * KameMix_getFormatSize();
+    block_frames * dev_spec.channels * sizeof(float);
   kame_mix.audio_tmp_buf = (uint8_t*)km_malloc(kame_mix.audio_tmp_buf_len);
   
-  // kame_mix.audio_mix_buf is only used for OutputS16
+  // kame_mix.audio_mix_buf is only used for OutputS16, since float output
+  // is mixed directly into the audio device's buffer
   if (kame_mix.format == KameMix_OutputS16) {
-    kame_mix.audio_mix_buf_len = dev_spec.samples * dev_spec.channels;
+    kame_mix.audio_mix_buf_len = block_frames * dev_spec.channels;
     kame_mix.audio_mix_buf = 
-      (int32_t*)km_malloc(kame_mix.audio_mix_buf_len * sizeof(int32_t));
+      (float*)km_malloc(kame_mix.audio_mix_buf_len * sizeof(float));
   }
 
   kame_mix.master_volume = 1.0f;
   kame_mix.listener_x = 0;
   kame_mix.listener_y = 0;
-  kame_mix.secs_per_callback = (float)dev_spec.samples / kame_mix.frequency;
+  kame_mix.secs_per_block = (float)block_frames / kame_mix.frequency;
+  kame_mix.clock.store(0, std::memory_order_relaxed);
+  kame_mix.block_len = 
+    block_frames * dev_spec.channels * KameMix_getFormatSize();
   kame_mix.next_id = 1;
 
+  // With fixed capacity, everything used while playing is allocated here
+  kame_mix.max_voices = options->max_voices > 0 ? options->max_voices : 0;
+  kame_mix.max_groups = options->max_groups > 0 ? options->max_groups : 0;
+  const int voices_reserved = 
+    kame_mix.max_voices > 0 ? kame_mix.max_voices : 128;
   kame_mix.sounds = km_new<SoundBuf>();
-  kame_mix.sounds->reserve(128);
+  kame_mix.sounds->reserve(voices_reserved);
   kame_mix.free_list = km_new<FreeList>();
-  kame_mix.free_list->reserve(128);
-  kame_mix.groups = km_new<std::vector<float>>();
+  kame_mix.free_list->reserve(voices_reserved);
+  // room for a few changes to each voice committed during a block
+  kame_mix.pending_updates = km_new<ParamUpdates>();
+  kame_mix.pending_updates->reserve(voices_reserved * 4);
+  kame_mix.groups = km_new<std::vector<Group>>();
+  if (kame_mix.max_groups > 0) {
+    kame_mix.groups->reserve(kame_mix.max_groups);
+  }
+  kame_mix.sound_cache = (SoundCache*)km_malloc(sizeof(SoundCache));
+  new (kame_mix.sound_cache) SoundCache();
+  kame_mix.events = (EventQueue*)km_malloc(sizeof(EventQueue));
+  new (kame_mix.events) EventQueue(options->max_events > 0 ? 
+                                   options->max_events : 256);
+  kame_mix.emitters = km_new<Emitters>();
+
+  if (options->use_pool) {
+    kame_mix.mem_pool = (MemPool*)km_malloc(sizeof(MemPool));
+    new (kame_mix.mem_pool) MemPool(StreamBuffer::dataSize());
+    // failing to reserve isn't an error, they're allocated when needed
+    kame_mix.mem_pool->reserve(StreamBuffer::dataSize(), 
+                               options->pool_streams);
+  }
+
+  if (options->mix_threads > 0) {
+    kame_mix.mix_jobs = km_new<MixJobs>();
+    kame_mix.mix_jobs->reserve(kame_mix.sounds->capacity());
+    kame_mix.mix_workers = (MixWorkers*)km_malloc(sizeof(MixWorkers));
+    new (kame_mix.mix_workers) MixWorkers(options->mix_threads + 1, 
+                                          kame_mix.audio_tmp_buf_len);
+  }
+  kame_mix.num_filter_jobs = 
+    kame_mix.mix_workers ? kame_mix.mix_workers->numWorkers() : 1;
+  kame_mix.filter_jobs = km_new_n<FilterJobs>(kame_mix.num_filter_jobs);
+  for (int i = 0; i < kame_mix.num_filter_jobs; ++i) {
+    kame_mix.filter_jobs[i].batch.init(block_frames);
+  }
+  // coefficients get about 2/3 of the way to a new filter in 10 ms
+  kame_mix.filter_smoothing = 
+    1.0f - std::exp(-kame_mix.secs_per_block / 0.01f);
+
+  // started last, since it starts mixing right away
+  if (mix_ahead) {
+    const int frame_size = dev_spec.channels * KameMix_getFormatSize();
+    // A callback reads dev_spec.samples frames at once, and a block may be
+    // mixing, so the ring must hold both or every callback underruns.
+    const int ahead_frames = std::max(options->mix_ahead_frames, 
+                                      dev_spec.samples + block_frames);
+    const int blocks = (ahead_frames + block_frames - 1) / block_frames;
+    kame_mix.mix_ahead = (MixAhead*)km_malloc(sizeof(MixAhead));
+    new (kame_mix.mix_ahead) MixAhead(mixBlock, 
+                                      blocks * block_frames * frame_size, 
+                                      kame_mix.block_len, frame_size,
+                                      kame_mix.secs_per_block);
+  }
 
   SDL_PauseAudioDevice(kame_mix.dev_id, 0);
   return 1;
@@ -355,6 +837,17 @@ void KameMix_shutdown()
   SDL_CloseAudioDevice(kame_mix.dev_id);
   SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
+  // stop mixing before voices are released
+  if (kame_mix.mix_ahead) {
+    km_delete(kame_mix.mix_ahead);
+    kame_mix.mix_ahead = nullptr;
+  }
+
+  // stops their voices and frees their Sounds, so before voices are 
+  // released
+  km_delete(kame_mix.emitters);
+  kame_mix.emitters = nullptr;
+
   for (PlayingSound &sound : *kame_mix.sounds) {
     sound.release();
   }
@@ -373,31 +866,135 @@ void KameMix_shutdown()
   km_delete(kame_mix.free_list);
   kame_mix.free_list = nullptr;
 
+  km_delete(kame_mix.pending_updates);
+  kame_mix.pending_updates = nullptr;
+
+  for (Group &group : *kame_mix.groups) {
+    if (group.bus) {
+      km_free(group.bus->buf);
+      km_delete(group.bus);
+    }
+  }
   km_delete(kame_mix.groups);
   kame_mix.groups = nullptr;
+
+  km_delete(kame_mix.sound_cache);
+  kame_mix.sound_cache = nullptr;
+  // Sounds freed on the audio thread leave their decoding to stop on its own
+  SoundBuffer::waitForReleasedLoads();
+
+  km_delete(kame_mix.events);
+  kame_mix.events = nullptr;
+
+  if (kame_mix.mix_workers) {
+    km_delete(kame_mix.mix_workers);
+    kame_mix.mix_workers = nullptr;
+    km_delete(kame_mix.mix_jobs);
+    kame_mix.mix_jobs = nullptr;
+  }
+  km_delete_n(kame_mix.filter_jobs, kame_mix.num_filter_jobs);
+  kame_mix.filter_jobs = nullptr;
+  kame_mix.num_filter_jobs = 0;
+
+  // after sounds are released, since their decoders can be in the pool
+  if (kame_mix.mem_pool) {
+    km_delete(kame_mix.mem_pool);
+    kame_mix.mem_pool = nullptr;
+  }
+
+  if (kame_mix.user_malloc == checkedMalloc) {
+    kame_mix.user_malloc = kame_mix.checked_malloc;
+    kame_mix.user_realloc = kame_mix.checked_realloc;
+  }
+}
+
+int KameMix_forEachRtViolation(KameMix_RtViolationFunc func, 
+                               void *userdata)
+{
+  return rtForEachViolation(func, userdata);
+}
+
+int KameMix_getMixAheadStats(KameMix_MixAheadStats *stats)
+{
+  if (!kame_mix.mix_ahead) {
+    return 0;
+  }
+  kame_mix.mix_ahead->getStats(*stats);
+  return 1;
+}
+
+void KameMix_resetMixAheadStats()
+{
+  if (kame_mix.mix_ahead) {
+    kame_mix.mix_ahead->resetStats();
+  }
+}
+
+int KameMix_pollEvents(KameMix_Event *events, int max_events)
+{
+  return kame_mix.events->pop(events, max_events);
+}
+
+unsigned KameMix_getDroppedEvents()
+{
+  return kame_mix.events->dropped();
+}
+
+int KameMix_getPoolStats(KameMix_PoolStats *stats, int max_classes)
+{
+  if (!kame_mix.mem_pool) {
+    return 0;
+  }
+  return kame_mix.mem_pool->getStats(stats, max_classes);
 }
 
 //
 // Static functions used by Sound/Stream/Channel functions
 //
 
+// Returns index of unused PlayingSound, or -1 if max_voices are used.
 static inline 
 int findFreeChannel_locked()
 {
-  kame_mix.number_playing += 1;
   if (!kame_mix.free_list->empty()) {
+    kame_mix.number_playing += 1;
     int idx = kame_mix.free_list->back();
     kame_mix.free_list->pop_back();
     return idx;
   }
 
+  if (kame_mix.max_voices > 0 && 
+      (int)kame_mix.sounds->size() == kame_mix.max_voices) {
+    return -1; // don't reallocate preallocated voices
+  }
+  kame_mix.number_playing += 1;
   kame_mix.sounds->push_back(PlayingSound()); // add uninitialized
+  if (kame_mix.mix_jobs) {
+    // so audio thread doesn't allocate jobs
+    kame_mix.mix_jobs->reserve(kame_mix.sounds->capacity());
+  }
   return kame_mix.sounds->size() - 1;
 }
 
+// Sends event about sound to KameMix_pollEvents. Doesn't need 
+// kame_mix.audio_mutex, so can be called from mix workers.
+static
+void sendEvent(KameMix_EventType type, const PlayingSound &sound)
+{
+  if (!sound.send_events) {
+    return;
+  }
+  KameMix_Event event;
+  event.type = type;
+  event.channel.idx = (int)(&sound - kame_mix.sounds->data());
+  event.channel.id = sound.id;
+  kame_mix.events->push(event); // dropped if full
+}
+
 static inline
 void freeChannel_locked(int idx, PlayingSound &sound)
 {
+  sendEvent(KameMix_EventFinished, sound); // before id is reset
   kame_mix.free_list->push_back(idx);
   kame_mix.number_playing -= 1;
   sound.state = FinishedState;
@@ -434,10 +1031,17 @@ KameMix_Channel nullChannel()
   return c;
 }
 
+static inline
+void batchUpdate(KameMix_Channel c, ParamType type, float a, float b = 0.0f)
+{
+  ParamUpdate update = { c, type, a, b };
+  batch_updates.push_back(update);
+}
+
 void KameMix_halt(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     haltChannel_locked(c);
   }
 }
@@ -447,10 +1051,26 @@ void KameMix_stop(KameMix_Channel c)
   KameMix_fadeout(c, -1.0f);
 }
 
+void KameMix_stopAt(KameMix_Channel c, uint64_t clock_frame)
+{
+  AudioGuard guard;
+  if (KameMix_isChannelSet(c)) {
+    PlayingSound &sound = (*kame_mix.sounds)[c.idx];
+    if (sound.id == c.id && sound.tag != InvalidType) {
+      sound.stop_frame = clock_frame;
+    }
+  }
+}
+
+uint64_t KameMix_getClock()
+{
+  return kame_mix.clock.load(std::memory_order_relaxed);
+}
+
 void KameMix_fadeout(KameMix_Channel c, float fade_secs)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     fadeoutChannel_locked(c, fade_secs);
   }
 }
@@ -458,7 +1078,7 @@ void KameMix_fadeout(KameMix_Channel c, float fade_secs)
 int KameMix_isPlaying(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id && (sound.isPlaying() || sound.isUnpausing())) {
       return 1;
@@ -470,7 +1090,7 @@ int KameMix_isPlaying(KameMix_Channel c)
 int KameMix_isPaused(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id && (sound.isPaused() || sound.isPausing())) {
       return 1;
@@ -482,7 +1102,7 @@ int KameMix_isPaused(KameMix_Channel c)
 int KameMix_isFinished(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       if (sound.isFinished()) {
@@ -497,7 +1117,7 @@ int KameMix_isFinished(KameMix_Channel c)
 void KameMix_pause(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (c.id == sound.id) {
       if (sound.isPlaying()) { 
@@ -512,7 +1132,7 @@ void KameMix_pause(KameMix_Channel c)
 void KameMix_unpause(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (c.id == sound.id) {
       if (sound.isPaused()) { 
@@ -527,7 +1147,7 @@ void KameMix_unpause(KameMix_Channel c)
 KameMix_Channel KameMix_setLoopCount(KameMix_Channel c, int loops)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       sound.loop_count = loops;
@@ -540,7 +1160,7 @@ KameMix_Channel KameMix_setLoopCount(KameMix_Channel c, int loops)
 int KameMix_getLoopCount(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       return sound.loop_count;
@@ -552,11 +1172,18 @@ int KameMix_getLoopCount(KameMix_Channel c)
 KameMix_Channel KameMix_setPos(KameMix_Channel c, float x, float y)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    if (batch_depth > 0) {
+      batchUpdate(c, PosParam, x, y);
+      return c;
+    }
+    AudioGuard guard;
+    // so batches committed before this don't overwrite it
+    dropUpdates_locked(c, PosParam);
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       sound.x = x;
       sound.y = y;
+      sound.pos_ramp.unset();
       return c;
     }
   }
@@ -566,7 +1193,7 @@ KameMix_Channel KameMix_setPos(KameMix_Channel c, float x, float y)
 void KameMix_getPos(KameMix_Channel c, float *x, float *y)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       *x = sound.x;
@@ -581,7 +1208,13 @@ void KameMix_getPos(KameMix_Channel c, float *x, float *y)
 KameMix_Channel KameMix_setMaxDistance(KameMix_Channel c, float distance)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    if (batch_depth > 0) {
+      batchUpdate(c, MaxDistanceParam, distance);
+      return c;
+    }
+    AudioGuard guard;
+    // so batches committed before this don't overwrite it
+    dropUpdates_locked(c, MaxDistanceParam);
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       sound.max_distance = distance;
@@ -594,7 +1227,7 @@ KameMix_Channel KameMix_setMaxDistance(KameMix_Channel c, float distance)
 float KameMix_getMaxDistance(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       return sound.max_distance;
@@ -606,7 +1239,7 @@ float KameMix_getMaxDistance(KameMix_Channel c)
 KameMix_Channel KameMix_setGroup(KameMix_Channel c, int group)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       sound.group = group;
@@ -619,7 +1252,7 @@ KameMix_Channel KameMix_setGroup(KameMix_Channel c, int group)
 int KameMix_getGroup(KameMix_Channel c)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
       return sound.group;
@@ -628,102 +1261,635 @@ int KameMix_getGroup(KameMix_Channel c)
   return -1;
 }
 
-KameMix_Channel KameMix_setVolume(KameMix_Channel c, float volume)
+KameMix_Channel KameMix_setFilter(KameMix_Channel c, KameMix_FilterType type,
+                                  float cutoff, float q)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
-      sound.new_volume = volume;
+      sound.filter.set(type, cutoff, q, kame_mix.frequency);
       return c;
     }
   }
   return nullChannel();
 }
 
-float KameMix_getVolume(KameMix_Channel c)
+KameMix_Channel KameMix_setSend(KameMix_Channel c, int bus, float level)
 {
   if (KameMix_isChannelSet(c)) {
-    std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+    AudioGuard guard;
+    assert((bus == -1 || (bus >= 0 && bus < (int)kame_mix.groups->size() && 
+            (*kame_mix.groups)[bus].bus)) && "bus must be a bus");
     PlayingSound &sound = (*kame_mix.sounds)[c.idx];
     if (sound.id == c.id) {
-      return sound.new_volume;
+      sound.send = bus;
+      sound.send_level = level;
+      return c;
     }
   }
-  return 1.0f;
+  return nullChannel();
 }
 
-//
-// Sound functions
-//
-
-KameMix_Sound* KameMix_loadSound(const char *file)
+KameMix_Channel KameMix_setPitch(KameMix_Channel c, float ratio)
 {
-  using KameMix::km_malloc_;
-  KameMix_Sound *sound = (KameMix_Sound*)km_malloc_(sizeof(KameMix_Sound));
-  if (sound) {
-    new (sound) KameMix_Sound(file);
-    if (sound->buffer.isLoaded()) {
-      return sound;
+  if (KameMix_isChannelSet(c)) {
+    AudioGuard guard;
+    PlayingSound &sound = (*kame_mix.sounds)[c.idx];
+    if (sound.id == c.id) {
+      sound.pitch = ratio > 0.0f ? ratio : 1.0f;
+      return c;
     }
-    KameMix_freeSound(sound);
   }
-  return NULL;
+  return nullChannel();
 }
 
-void KameMix_freeSound(KameMix_Sound *sound)
+float KameMix_getPitch(KameMix_Channel c)
 {
-  if (sound) {
-    if (sound->refcount.fetch_sub(1, std::memory_order_release) == 1) {
-      std::atomic_thread_fence(std::memory_order_acquire);
-      sound->~KameMix_Sound();
-      KameMix::km_free(sound);
+  if (KameMix_isChannelSet(c)) {
+    AudioGuard guard;
+    PlayingSound &sound = (*kame_mix.sounds)[c.idx];
+    if (sound.id == c.id) {
+      return sound.pitch;
     }
   }
+  return 0.0f;
 }
 
-void KameMix_incSoundRef(KameMix_Sound *sound)
+KameMix_Channel KameMix_setVolume(KameMix_Channel c, float volume)
 {
-  assert(sound != NULL);
-  sound->refcount.fetch_add(1, std::memory_order_relaxed);
+  if (KameMix_isChannelSet(c)) {
+    if (batch_depth > 0) {
+      batchUpdate(c, VolumeParam, volume);
+      return c;
+    }
+    AudioGuard guard;
+    // so batches committed before this don't overwrite it
+    dropUpdates_locked(c, VolumeParam);
+    PlayingSound &sound = (*kame_mix.sounds)[c.idx];
+    if (sound.id == c.id) {
+      sound.new_volume = volume;
+      sound.volume_ramp.unset();
+      return c;
+    }
+  }
+  return nullChannel();
 }
 
-static inline
-int soundTimeToBytePos(KameMix_Sound *sound, double secs)
+float KameMix_getVolume(KameMix_Channel c)
 {
-  if (secs == 0) {
-    return 0;
-  }
-  SoundBuffer &buffer = sound->buffer;
-  int sample_pos = (int) (secs * KameMix_getFrequency());
-  int byte_pos = sample_pos * buffer.sampleBlockSize();
-  if (byte_pos < 0 || byte_pos >= buffer.size()) {
-    byte_pos = 0;
+  if (KameMix_isChannelSet(c)) {
+    AudioGuard guard;
+    PlayingSound &sound = (*kame_mix.sounds)[c.idx];
+    if (sound.id == c.id) {
+      return sound.new_volume;
+    }
   }
-  return byte_pos;
+  return 1.0f;
 }
 
-KameMix_Channel 
-KameMix_playSound(KameMix_Sound *sound, KameMix_Channel c, double start_sec, 
-                  int loops, float vol, float fade_secs, float x, float y, 
-                  float max_distance, int group, int paused)
+void KameMix_beginBatch()
+{
+  ++batch_depth;
+}
+
+void KameMix_commitBatch()
+{
+  assert(batch_depth > 0 && "KameMix_commitBatch without KameMix_beginBatch");
+  if (--batch_depth > 0 || batch_updates.empty()) {
+    return;
+  }
+
+  ParamUpdates spare; // declared first, so it's freed after unlocking
+  AudioGuard guard;
+  ParamUpdates &pending = *kame_mix.pending_updates;
+  // If batches are committed faster than blocks are mixed, grow pending 
+  // with audio_mutex unlocked, so the audio thread doesn't wait on it.
+  while (pending.size() + batch_updates.size() > pending.capacity()) {
+    const size_t needed = (pending.size() + batch_updates.size()) * 2;
+    guard.unlock();
+    spare.reserve(needed);
+    guard.lock();
+    if (pending.size() + batch_updates.size() <= spare.capacity()) {
+      spare.assign(pending.begin(), pending.end());
+      pending.swap(spare);
+    }
+  }
+  pending.insert(pending.end(), batch_updates.begin(), batch_updates.end());
+  guard.unlock();
+  // keeps its capacity for the next batch
+  batch_updates.clear();
+}
+
+void KameMix_setPositions(const KameMix_Channel *channels, 
+                          const float *xs, const float *ys, int n)
+{
+  KameMix_beginBatch();
+  for (int i = 0; i < n; ++i) {
+    KameMix_setPos(channels[i], xs[i], ys[i]);
+  }
+  KameMix_commitBatch();
+}
+
+void KameMix_setVolumes(const KameMix_Channel *channels, 
+                        const float *volumes, int n)
+{
+  KameMix_beginBatch();
+  for (int i = 0; i < n; ++i) {
+    KameMix_setVolume(channels[i], volumes[i]);
+  }
+  KameMix_commitBatch();
+}
+
+KameMix_Channel KameMix_rampVolume(KameMix_Channel c, float volume, 
+                                   float secs, KameMix_RampCurve curve)
+{
+  if (KameMix_isChannelSet(c)) {
+    AudioGuard guard;
+    // so batches committed before this don't overwrite it
+    dropUpdates_locked(c, VolumeParam);
+    PlayingSound &sound = (*kame_mix.sounds)[c.idx];
+    if (sound.id == c.id) {
+      if (secs > 0.0f) {
+        sound.volume_start = sound.new_volume;
+        sound.volume_target = volume;
+        sound.volume_ramp.start(secs, curve);
+      } else {
+        sound.new_volume = volume;
+        sound.volume_ramp.unset();
+      }
+      return c;
+    }
+  }
+  return nullChannel();
+}
+
+KameMix_Channel KameMix_rampPos(KameMix_Channel c, float x, float y, 
+                                float secs, KameMix_RampCurve curve)
 {
-  std::lock_guard<std::mutex> guard(kame_mix.audio_mutex);
+  if (KameMix_isChannelSet(c)) {
+    AudioGuard guard;
+    // so batches committed before this don't overwrite it
+    dropUpdates_locked(c, PosParam);
+    PlayingSound &sound = (*kame_mix.sounds)[c.idx];
+    if (sound.id == c.id) {
+      if (secs > 0.0f) {
+        sound.pos_start.x = sound.x;
+        sound.pos_start.y = sound.y;
+        sound.pos_target.x = x;
+        sound.pos_target.y = y;
+        // decibels don't apply to positions
+        if (curve == KameMix_RampExponential) {
+          curve = KameMix_RampLinear;
+        }
+        sound.pos_ramp.start(secs, curve);
+      } else {
+        sound.x = x;
+        sound.y = y;
+        sound.pos_ramp.unset();
+      }
+      return c;
+    }
+  }
+  return nullChannel();
+}
+
+KameMix_Channel KameMix_setVelocity(KameMix_Channel c, float vx, float vy)
+{
+  if (KameMix_isChannelSet(c)) {
+    AudioGuard guard;
+    PlayingSound &sound = (*kame_mix.sounds)[c.idx];
+    if (sound.id == c.id) {
+      sound.velocity.x = vx;
+      sound.velocity.y = vy;
+      return c;
+    }
+  }
+  return nullChannel();
+}
+
+//
+// Sound functions
+//
+
+void KameMix_setSoundFlags(int flags) 
+{ 
+  kame_mix.sound_flags.store(flags, std::memory_order_relaxed); 
+}
+
+int KameMix_getSoundFlags() 
+{ 
+  return kame_mix.sound_flags.load(std::memory_order_relaxed); 
+}
+
+static
+KameMix_Sound* loadSoundFile(const char *file, int flags)
+{
+  using KameMix::km_pool_alloc;
+  KameMix_Sound *sound = 
+    (KameMix_Sound*)km_pool_alloc(sizeof(KameMix_Sound));
+  if (sound) {
+    new (sound) KameMix_Sound(file, flags);
+    if (sound->buffer.isLoaded()) {
+      return sound;
+    }
+    KameMix_freeSound(sound);
+  }
+  return NULL;
+}
+
+KameMix_Sound* KameMix_loadSound(const char *file)
+{
+  const int flags = KameMix_getSoundFlags();
+  if (KameMix_isSoundCacheEnabled()) {
+    return kame_mix.sound_cache->load(file, flags, loadSoundFile);
+  }
+  return loadSoundFile(file, flags);
+}
+
+// src is always closed
+static
+KameMix_Sound* loadSoundSource(DataSource &src)
+{
+  using KameMix::km_pool_alloc;
+  KameMix_Sound *sound = 
+    (KameMix_Sound*)km_pool_alloc(sizeof(KameMix_Sound));
+  if (sound) {
+    new (sound) KameMix_Sound();
+    if (sound->buffer.load(src, KameMix_getSoundFlags())) {
+      sound->mem_size.store(sound->buffer.size(), std::memory_order_relaxed);
+      return sound;
+    }
+    KameMix_freeSound(sound);
+  } else {
+    closeSource(src);
+  }
+  return NULL;
+}
+
+KameMix_Sound* KameMix_loadSoundMem(const void *data, size_t len)
+{
+  DataSource src;
+  if (!openMemSource(src, data, len)) {
+    return NULL;
+  }
+  return loadSoundSource(src);
+}
+
+KameMix_Sound* KameMix_loadSoundIO(const KameMix_IO *io, void *userdata)
+{
+  DataSource src;
+  openUserSource(src, *io, userdata);
+  return loadSoundSource(src);
+}
+
+void KameMix_freeSound(KameMix_Sound *sound)
+{
+  if (sound) {
+    if (sound->refcount.fetch_sub(1, std::memory_order_release) == 1) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sound->cached) {
+        kame_mix.sound_cache->remove(sound);
+      }
+      KameMix::km_pool_delete(sound);
+    }
+  }
+}
+
+void KameMix_incSoundRef(KameMix_Sound *sound)
+{
+  assert(sound != NULL);
+  sound->refcount.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t KameMix_getSoundMemory(KameMix_Sound *sound)
+{
+  return sound->mem_size.load(std::memory_order_relaxed);
+}
+
+int KameMix_isSoundLoading(KameMix_Sound *sound)
+{
+  // buffer can be swapped by SoundCache with audio_mutex locked
+  AudioGuard guard;
+  return sound->buffer.isLoading() ? 1 : 0;
+}
+
+void KameMix_setSoundCacheBudget(size_t bytes)
+{
+  kame_mix.sound_cache->setBudget(bytes);
+}
+
+size_t KameMix_getSoundCacheBudget()
+{
+  return kame_mix.sound_cache->getBudget();
+}
+
+void KameMix_setReloadPolicy(KameMix_ReloadPolicy policy)
+{
+  kame_mix.sound_cache->setReloadPolicy(policy);
+}
+
+KameMix_ReloadPolicy KameMix_getReloadPolicy()
+{
+  return kame_mix.sound_cache->getReloadPolicy();
+}
+
+void KameMix_getSoundCacheStats(KameMix_SoundCacheStats *stats)
+{
+  kame_mix.sound_cache->getStats(*stats);
+}
+
+void KameMix_resetSoundCacheStats()
+{
+  kame_mix.sound_cache->resetStats();
+}
+
+void KameMix_setSoundCacheEnabled(int enabled)
+{
+  kame_mix.sound_cache_enabled.store(enabled != 0, std::memory_order_relaxed);
+}
+
+int KameMix_isSoundCacheEnabled()
+{
+  return kame_mix.sound_cache_enabled.load(std::memory_order_relaxed);
+}
+
+int KameMix_forEachCachedSound(KameMix_CachedSoundFunc func, void *userdata)
+{
+  return kame_mix.sound_cache->forEach(func, userdata);
+}
+
+size_t KameMix_getSoundCacheMemory()
+{
+  return kame_mix.sound_cache->memoryUsed();
+}
+
+static inline
+int soundTimeToBytePos(KameMix_Sound *sound, double secs)
+{
+  if (secs == 0) {
+    return 0;
+  }
+  SoundBuffer &buffer = sound->buffer;
+  int sample_pos = (int) (secs * buffer.rate());
+  int byte_pos = sample_pos * buffer.sampleBlockSize();
+  if (byte_pos < 0 || byte_pos >= buffer.size()) {
+    byte_pos = 0;
+  }
+  return byte_pos;
+}
+
+// Returns new decoder for compressed sound starting at 'secs' position, 
+// or nullptr on error.
+static
+VorbisDecoder* newSoundDecoder(KameMix_Sound *sound, double secs)
+{
+  using KameMix::km_pool_alloc;
+  SoundBuffer &buffer = sound->buffer;
+  VorbisDecoder *decoder = 
+    (VorbisDecoder*)km_pool_alloc(sizeof(VorbisDecoder));
+  if (decoder) {
+    new (decoder) VorbisDecoder();
+    if (decoder->open(buffer.data(), buffer.size(), buffer.numChannels(), 
+                      secs)) {
+      return decoder;
+    }
+    km_pool_delete(decoder);
+  }
+  return nullptr;
+}
+
+// Sets start position of playing sound. Its data must be resident.
+static
+void setSoundStart_locked(PlayingSound &playing, double start_sec)
+{
+  SoundBuffer &buffer = playing.sound().buffer;
+  if (buffer.isADPCM()) {
+    AdpcmDecoder &adpcm = playing.adpcm;
+    adpcm.open(buffer.data(), buffer.numADPCMFrames(), buffer.numChannels());
+    adpcm.seek((int)(start_sec * buffer.rate())); // seeks to 0 if past end
+  } else if (!playing.decoder) {
+    playing.buffer_pos = soundTimeToBytePos(&playing.sound(), start_sec);
+  }
+}
+
+void KameMix_setSoundCoalesce(KameMix_Sound *sound, float window_secs, 
+                              int max_voices)
+{
+  AudioGuard guard;
+  sound->coalesce_frames = 
+    window_secs > 0.0f ? (uint64_t)(window_secs * kame_mix.frequency) : 0;
+  sound->voice_limit = max_voices > 0 ? max_voices : 0;
+}
+
+// Returns volume of a voice after group volume and position, for comparing
+// how loud voices are.
+static
+float audibleVolume(float vol, float x, float y, float max_distance, 
+                    int group)
+{
+  if (group >= 0) {
+    vol *= (*kame_mix.groups)[group].volume;
+  }
+  if (max_distance > 0) {
+    VolumeFade vfade = applyPosition((x - kame_mix.listener_x) / max_distance,
+                                     (y - kame_mix.listener_y) / max_distance);
+    vol *= std::max(vfade.left_fade, vfade.right_fade);
+  }
+  return vol;
+}
+
+// Merges a play of sound at mixer clock frame start into the last voice 
+// started for it, if within its coalesce window and played the same way, 
+// so only its volume differs. Returns that voice's channel, or unset 
+// channel if not merged.
+static
+KameMix_Channel coalescePlay_locked(KameMix_Sound *sound, uint64_t start,
+                                    int loops, float vol, float fade_secs, 
+                                    float x, float y, float max_distance, 
+                                    int group)
+{
+  const KameMix_Channel last = sound->last_channel;
+  if (!KameMix_isChannelSet(last)) {
+    return nullChannel();
+  }
+  PlayingSound &playing = (*kame_mix.sounds)[last.idx];
+  if (playing.id != last.id || playing.tag != SoundType || 
+      playing.isFinished() || playing.isFadingOut() || 
+      !playing.send_events) {
+    return nullChannel();
+  }
+  // fadein is at least a block, as in setFadein
+  const bool same_fade = fade_secs == 0.0f ? !playing.isFading() :
+    playing.isFadingIn() && 
+    playing.fadeinTotal() == std::max(fade_secs, kame_mix.secs_per_block);
+  if (playing.x != x || playing.y != y || 
+      playing.max_distance != max_distance || playing.group != group || 
+      playing.send != -1 || playing.loop_count != loops || !same_fade) {
+    return nullChannel();
+  }
+  const uint64_t diff = start > sound->last_start ? 
+    start - sound->last_start : sound->last_start - start;
+  if (diff > sound->coalesce_frames) {
+    return nullChannel();
+  }
+  playing.new_volume += vol;
+  return last;
+}
+
+// If sound's voice limit is reached, makes room for a play with audible 
+// volume by stopping its quietest voice, if quieter. Returns false if the 
+// play shouldn't start.
+static
+bool limitVoices_locked(KameMix_Sound *sound, float volume)
+{
+  if (sound->voice_limit == 0) {
+    return true;
+  }
+  // voices fading out are already being replaced
+  int count = 0;
+  int quietest = -1;
+  float quietest_volume = volume;
+  for (int i = 0; i < (int)kame_mix.sounds->size(); ++i) {
+    PlayingSound &playing = (*kame_mix.sounds)[i];
+    if (playing.tag != SoundType || playing.sound_ != sound || 
+        playing.isFinished() || playing.isFadingOut()) {
+      continue;
+    }
+    count += 1;
+    const float v = audibleVolume(playing.new_volume, playing.x, playing.y,
+                                  playing.max_distance, playing.group);
+    if (v < quietest_volume) {
+      quietest = i;
+      quietest_volume = v;
+    }
+  }
+  if (count < sound->voice_limit) {
+    return true;
+  } else if (quietest == -1) {
+    return false;
+  }
+  (*kame_mix.sounds)[quietest].setFadeout(-1.0f);
+  return true;
+}
+
+// Plays sound for KameMix_playSoundAt. send_events is false for emitter 
+// voices.
+static
+KameMix_Channel playSoundAt(KameMix_Sound *sound, KameMix_Channel c, 
+                            uint64_t clock_frame, double start_sec, 
+                            int loops, float vol, float fade_secs, float x, 
+                            float y, float max_distance, int group, 
+                            int paused, bool send_events)
+{
+  // when started, for merging plays
+  const uint64_t start = std::max(clock_frame, KameMix_getClock());
+  if (start_sec == 0.0 && !paused) {
+    AudioGuard guard;
+    // emitters own their voices, so aren't merged
+    if (sound->coalesce_frames > 0 && send_events) {
+      KameMix_Channel merged = 
+        coalescePlay_locked(sound, start, loops, vol, fade_secs, x, y, 
+                            max_distance, group);
+      if (KameMix_isChannelSet(merged)) {
+        if (KameMix_isChannelSet(c) && c.idx != merged.idx) {
+          fadeoutChannel_locked(c, -1.0f);
+        }
+        return merged;
+      }
+    }
+  }
+
+  if (sound->cached) {
+    // starts reloading sound if evicted
+    if (!kame_mix.sound_cache->prepareToPlay(sound)) {
+      KameMix_halt(c);
+      return nullChannel();
+    }
+    // Count as playing, so sound isn't evicted while opening decoder
+    AudioGuard guard;
+    sound->voices += 1;
+  }
+
+  // Open decoder before locking, since it parses the file headers
+  VorbisDecoder *decoder = nullptr;
+  if (sound->isResident() && sound->buffer.isCompressed()) {
+    decoder = newSoundDecoder(sound, start_sec);
+    if (!decoder) {
+      AudioGuard guard;
+      if (sound->cached) {
+        sound->voices -= 1;
+      }
+      if (KameMix_isChannelSet(c)) {
+        haltChannel_locked(c);
+      }
+      return nullChannel();
+    }
+  }
+
+  AudioGuard guard;
+  if (sound->cached) {
+    sound->voices -= 1; // PlayingSound ctor counts it
+  }
   if (KameMix_isChannelSet(c)) {
     fadeoutChannel_locked(c, -1.0f);
   }
 
-  c.idx = findFreeChannel_locked();
+  if (!limitVoices_locked(sound, 
+                          audibleVolume(vol, x, y, max_distance, group))) {
+    c.idx = -1; // quieter than all voices of sound
+  } else {
+    c.idx = findFreeChannel_locked();
+  }
+  if (c.idx == -1) {
+    if (decoder) {
+      km_pool_delete(decoder);
+    }
+    return nullChannel();
+  }
   c.id = getNextID_locked();
+  if (sound->coalesce_frames > 0 && send_events) {
+    sound->last_channel = c;
+    sound->last_start = start;
+  }
 
-  int byte_pos = soundTimeToBytePos(sound, start_sec);
   // PlayingSound ctor increments refcount
-  (*kame_mix.sounds)[c.idx] = 
-    PlayingSound(sound, loops, byte_pos, paused, fade_secs, vol,
-                 x, y, max_distance, group, c.id);
+  PlayingSound &playing = (*kame_mix.sounds)[c.idx];
+  playing = PlayingSound(sound, loops, 0, paused, fade_secs, vol,
+                         x, y, max_distance, group, c.id);
+  // owned by PlayingSound, and deleted in release
+  playing.decoder = decoder;
+  playing.send_events = send_events;
+  playing.start_frame = clock_frame;
+  if (sound->isResident()) {
+    setSoundStart_locked(playing, start_sec);
+  } else { 
+    // started in audioCallback when reloaded
+    playing.waiting_reload = true;
+    playing.start_sec = start_sec;
+  }
   return c;
 }
 
+KameMix_Channel 
+KameMix_playSound(KameMix_Sound *sound, KameMix_Channel c, double start_sec, 
+                  int loops, float vol, float fade_secs, float x, float y, 
+                  float max_distance, int group, int paused)
+{
+  return KameMix_playSoundAt(sound, c, 0, start_sec, loops, vol, fade_secs, 
+                             x, y, max_distance, group, paused);
+}
+
+KameMix_Channel 
+KameMix_playSoundAt(KameMix_Sound *sound, KameMix_Channel c, 
+                    uint64_t clock_frame, double start_sec, int loops, 
+                    float vol, float fade_secs, float x, float y, 
+                    float max_distance, int group, int paused)
+{
+  return playSoundAt(sound, c, clock_frame, start_sec, loops, vol, fade_secs,
+                     x, y, max_distance, group, paused, true);
+}
+
 //
 // Stream functions
 //
@@ -738,6 +1904,7 @@ void KameMix_incStreamRef(KameMix_Stream *stream)
 static inline
 void streamReadMore(KameMix_Stream *stream)
 {
+  RT_CHECK("thread spawn");
   KameMix_incStreamRef(stream);
   std::thread thrd([stream]() mutable { 
     stream->buffer.readMore(); 
@@ -748,8 +1915,9 @@ void streamReadMore(KameMix_Stream *stream)
 
 KameMix_Stream* KameMix_loadStream(const char *file)
 {
-  using KameMix::km_malloc_;
-  KameMix_Stream *stream = (KameMix_Stream*)km_malloc_(sizeof(KameMix_Stream));
+  using KameMix::km_pool_alloc;
+  KameMix_Stream *stream = 
+    (KameMix_Stream*)km_pool_alloc(sizeof(KameMix_Stream));
   if (stream) {
     new (stream) KameMix_Stream(file);
 
@@ -762,13 +1930,49 @@ KameMix_Stream* KameMix_loadStream(const char *file)
   return NULL;
 }
 
+// src is owned by returned stream, or closed on error
+static
+KameMix_Stream* loadStreamSource(DataSource &src)
+{
+  using KameMix::km_pool_alloc;
+  KameMix_Stream *stream = 
+    (KameMix_Stream*)km_pool_alloc(sizeof(KameMix_Stream));
+  if (stream) {
+    new (stream) KameMix_Stream();
+
+    if (stream->buffer.load(src)) {
+      streamReadMore(stream); // read into 2nd buffer in different thread
+      return stream;
+    }
+    KameMix_freeStream(stream);
+  } else {
+    closeSource(src);
+  }
+  return NULL;
+}
+
+KameMix_Stream* KameMix_loadStreamMem(const void *data, size_t len)
+{
+  DataSource src;
+  if (!openMemSource(src, data, len)) {
+    return NULL;
+  }
+  return loadStreamSource(src);
+}
+
+KameMix_Stream* KameMix_loadStreamIO(const KameMix_IO *io, void *userdata)
+{
+  DataSource src;
+  openUserSource(src, *io, userdata);
+  return loadStreamSource(src);
+}
+
 void KameMix_freeStream(KameMix_Stream *stream)
 {
   if (stream) {
     if (stream->refcount.fetch_sub(1, std::memory_order_release) == 1) {
       std::atomic_thread_fence(std::memory_order_acquire);
-      stream->~KameMix_Stream();
-      KameMix::km_free(stream);
+      KameMix::km_pool_delete(stream);
     }
   }
 }
@@ -779,7 +1983,7 @@ KameMix_playStream(KameMix_Stream *stream, KameMix_Channel c,
                    float fade_secs, float x, float y, float max_distance, 
                    int group, int paused)
 {
-  std::unique_lock<std::mutex> guard(kame_mix.audio_mutex);
+  AudioGuard guard;
   if (KameMix_isChannelSet(c)) {
     haltChannel_locked(c);
   }
@@ -811,6 +2015,10 @@ KameMix_playStream(KameMix_Stream *stream, KameMix_Channel c,
 
   // audio_mutex must be locked here
   c.idx = findFreeChannel_locked();
+  if (c.idx == -1) {
+    KameMix_unsetChannel(c);
+    return c;
+  }
   c.id = getNextID_locked();
 
   // PlayingSound ctor increments refcount
@@ -822,6 +2030,35 @@ KameMix_playStream(KameMix_Stream *stream, KameMix_Channel c,
 
 } // end extern "C"
 
+namespace KameMix {
+
+KameMix_Channel playEmitterSound(KameMix_Sound *sound, KameMix_Channel c, 
+                                 double start_sec, float vol, float x, 
+                                 float y, float max_distance, int group)
+{
+  return playSoundAt(sound, c, 0, start_sec, -1, vol, 0.0f, x, y, 
+                     max_distance, group, 0, false);
+}
+
+void* poolAlloc(size_t len)
+{
+  if (kame_mix.mem_pool) {
+    return kame_mix.mem_pool->alloc(len);
+  }
+  return km_malloc_(len);
+}
+
+void poolFree(void *ptr, size_t len)
+{
+  if (kame_mix.mem_pool) {
+    kame_mix.mem_pool->free(ptr, len);
+  } else {
+    km_free(ptr);
+  }
+}
+
+} // end namespace KameMix
+
 namespace {
 
 //
@@ -835,10 +2072,21 @@ PlayingSound::PlayingSound(KameMix_Sound *sound, int loops, int buf_pos,
   tag = SoundType;
   sound_ = sound;
   KameMix_incSoundRef(sound_);
+  sound_->voices += 1;
+  decoder = nullptr;
+  waiting_reload = false;
+  starved = false;
+  send_events = true;
+  start_frame = 0;
+  stop_frame = UINT64_MAX;
 
   buffer_pos = buf_pos; 
+  pitch = 1.0f;
+  resampler.reset();
   loop_count = loops; 
   group = group_;
+  send = -1;
+  send_level = 0.0f;
   id = id_;
   new_volume = vol; 
   lvolume = vol;
@@ -846,6 +2094,11 @@ PlayingSound::PlayingSound(KameMix_Sound *sound, int loops, int buf_pos,
   x = x_;
   y = y_; 
   max_distance = max_distance_;
+  volume_ramp.unset();
+  pos_ramp.unset();
+  velocity.x = 0.0f;
+  velocity.y = 0.0f;
+  filter.reset();
 
   if (fade == 0) {
     unsetFade();
@@ -867,10 +2120,20 @@ PlayingSound::PlayingSound(KameMix_Stream *stream, int loops, int buf_pos,
   tag = StreamType;
   stream_ = stream;
   KameMix_incStreamRef(stream);
+  decoder = nullptr;
+  waiting_reload = false;
+  starved = false;
+  send_events = true;
+  start_frame = 0;
+  stop_frame = UINT64_MAX;
 
   buffer_pos = buf_pos; 
+  pitch = 1.0f;
+  resampler.reset();
   loop_count = loops; 
   group = group_;
+  send = -1;
+  send_level = 0.0f;
   id = id_;
   new_volume = vol; 
   lvolume = vol;
@@ -878,6 +2141,11 @@ PlayingSound::PlayingSound(KameMix_Stream *stream, int loops, int buf_pos,
   x = x_;
   y = y_; 
   max_distance = max_distance_;
+  volume_ramp.unset();
+  pos_ramp.unset();
+  velocity.x = 0.0f;
+  velocity.y = 0.0f;
+  filter.reset();
 
   if (fade == 0) {
     unsetFade();
@@ -896,6 +2164,7 @@ void PlayingSound::release()
 {
   switch (tag) {
   case SoundType:
+    sound_->voices -= 1;
     KameMix_freeSound(sound_);
     break;
   case StreamType:
@@ -904,6 +2173,10 @@ void PlayingSound::release()
   case InvalidType:
     break;
   }
+  if (decoder) {
+    km_pool_delete(decoder);
+    decoder = nullptr;
+  }
   tag = InvalidType;
   id = 0;
 }
@@ -912,8 +2185,9 @@ inline
 float PlayingSound::volumeInGroup() const
 {
   float v = new_volume * kame_mix.master_volume;
-  if (group >= 0) {
-    v *= (*kame_mix.groups)[group];
+  // bus volume is applied to the whole bus after mixing
+  if (group >= 0 && !(*kame_mix.groups)[group].bus) {
+    v *= (*kame_mix.groups)[group].volume;
   }
   return v;
 }
@@ -934,22 +2208,22 @@ Position2d PlayingSound::getRelativePos() const
 
 void PlayingSound::setFadein(float fade) 
 {
-  if (fade > kame_mix.secs_per_callback) {
+  if (fade > kame_mix.secs_per_block) {
     fade_total = fade;
   } else {
-    fade_total = kame_mix.secs_per_callback;
+    fade_total = kame_mix.secs_per_block;
   }
   fade_time = 0.0f;
 }
 
 // set fade_total to negative for fadeout
 void PlayingSound::setFadeout(float fade) {
-  if (fade > kame_mix.secs_per_callback) {
+  if (fade > kame_mix.secs_per_block) {
     fade_total = -fade;
     fade_time = fade; 
   } else {
-    fade_total = -kame_mix.secs_per_callback;
-    fade_time = kame_mix.secs_per_callback; 
+    fade_total = -kame_mix.secs_per_block;
+    fade_time = kame_mix.secs_per_block; 
   }
 }
 
@@ -958,8 +2232,11 @@ void PlayingSound::decrementLoopCount()
 {
   if (loop_count == 0) {
     state = FinishedState;
-  } else if (loop_count > 0) {
-    loop_count -= 1;
+  } else {
+    if (loop_count > 0) {
+      loop_count -= 1;
+    }
+    sendEvent(KameMix_EventLooped, *this);
   }
 }
 
@@ -974,6 +2251,7 @@ bool PlayingSound::streamSwapBuffers()
   StreamBuffer &sbuf = stream().buffer;
   StreamResult result = sbuf.swapBuffers();
   if (result == StreamReady) {
+    starved = false;
     if (sbuf.endPos() == 0) { // EOF seen immediately on read
       decrementLoopCount();
     }
@@ -983,17 +2261,74 @@ bool PlayingSound::streamSwapBuffers()
     }
     return true;
   } else if (result == StreamError) {
+    sendEvent(KameMix_EventError, *this);
     state = FinishedState; 
   } else {
     assert(result != StreamNoData); // readMore never called
     buffer_pos = sbuf.size();
+    if (!starved) {
+      starved = true;
+      sendEvent(KameMix_EventStarved, *this);
+    }
   }
   return false;
 }
 
+float Ramp::advance(float secs)
+{
+  time += secs;
+  if (time >= total) {
+    unset();
+    return 1.0f;
+  }
+  return time / total;
+}
+
+// Returns value t of the way from start to target along curve, where t is 
+// from Ramp::advance.
+float rampValue(float start, float target, float t, KameMix_RampCurve curve)
+{
+  if (t >= 1.0f) {
+    return target; // exactly
+  }
+  switch (curve) {
+  case KameMix_RampLinear:
+    break;
+  case KameMix_RampSmooth:
+    t = t * t * (3.0f - 2.0f * t);
+    break;
+  case KameMix_RampExponential: {
+    const float min_volume = 0.001f; // -60 dB, since 0 is never reached
+    const float a = std::max(start, min_volume);
+    const float b = std::max(target, min_volume);
+    return a * std::pow(b / a, t);
+  }
+  }
+  return start + (target - start) * t;
+}
+
+void PlayingSound::advanceAutomation(float secs)
+{
+  if (volume_ramp.isActive()) {
+    const float t = volume_ramp.advance(secs);
+    new_volume = rampValue(volume_start, volume_target, t, volume_ramp.curve);
+  }
+  if (pos_ramp.isActive()) {
+    const float t = pos_ramp.advance(secs);
+    x = rampValue(pos_start.x, pos_target.x, t, pos_ramp.curve);
+    y = rampValue(pos_start.y, pos_target.y, t, pos_ramp.curve);
+  } else {
+    x += velocity.x * secs;
+    y += velocity.y * secs;
+  }
+}
+
 // kame_mix.audio_mutex must be locked
-VolumeData PlayingSound::getVolumeData()
+VolumeData PlayingSound::getVolumeData(float secs)
 {
+  // ramps reach their value for the end of this block, which the block's 
+  // volume is faded to
+  advanceAutomation(secs);
   float new_lvol = volumeInGroup(); // new_volume * group * master
   float new_rvol = new_lvol;
   Position2d rel_pos = getRelativePos();
@@ -1011,13 +2346,13 @@ VolumeData PlayingSound::getVolumeData()
     if (isFadingIn()) {
       start_lfade = fade_time / fade_total;
       start_rfade = start_lfade;
-      end_lfade = (fade_time + kame_mix.secs_per_callback) / fade_total;
+      end_lfade = (fade_time + secs) / fade_total;
       end_rfade = end_lfade;
       adjust_fade_time = true;
     } else if (isFadingOut()) { // fade_total is negative in fadeout
       start_lfade = fade_time / -fade_total;
       start_rfade = start_lfade;
-      end_lfade = (fade_time - kame_mix.secs_per_callback) / -fade_total;
+      end_lfade = (fade_time - secs) / -fade_total;
       end_rfade = end_lfade;
       adjust_fade_time = true;
     }
@@ -1069,13 +2404,13 @@ VolumeData PlayingSound::getVolumeData()
 
     if (adjust_fade_time) {
       if (isFadingOut()) {
-        fade_time -= kame_mix.secs_per_callback;
+        fade_time -= secs;
         if (fade_time <= 0.0f) {
           state = FinishedState; 
           unsetFade();
         }
       } else {
-        fade_time += kame_mix.secs_per_callback;
+        fade_time += secs;
         if (fade_time >= fade_total) {
           unsetFade();
         }
@@ -1156,47 +2491,18 @@ VolumeFade applyPosition(float rel_x, float rel_y)
   return vfade;
 }
 
-template <class T>
-void applyVolume(T *stream, int len, float left_vol, float right_vol)
-{
-  for (int i = 0; i < len; i += 2) {
-    stream[i] = (T)(stream[i] * left_vol);
-    stream[i+1] = (T)(stream[i+1] * right_vol);
-  }
-}
-
-template <class T>
-void applyVolume(T *stream, int len_, const VolumeData &vdata)
-{
-  int pos = 0;
-  // make sure len is even after dividing by mod_times+1
-  int len = (len_ / 2) / (vdata.mod_times + 1) * 2;
-
-  for (int i = 0; i < vdata.mod_times; ++i) {
-    float lfade = vdata.lfade + i * vdata.lmod;
-    float rfade = vdata.rfade + i * vdata.rmod;
-    float left_vol = vdata.left_volume * lfade;
-    float right_vol = vdata.right_volume * rfade;
-    applyVolume(stream+pos, len, left_vol, right_vol);
-    pos += len;
-  }
-
-  float lfade = vdata.lfade + vdata.mod_times * vdata.lmod;
-  float rfade = vdata.rfade + vdata.mod_times * vdata.rmod;
-  float left_vol = vdata.left_volume * lfade;
-  float right_vol = vdata.right_volume * rfade;
-  // len*(fdata.mod_times+1) can be less than len_, so make sure to
-  // include all last samples
-  len = len_ - pos;
-  applyVolume(stream+pos, len, left_vol, right_vol);
-}
-
 template <class CopyFunc>
 int copySound(CopyFunc copy, uint8_t *buffer, const int buf_len, 
               PlayingSound &sound, SoundBuffer &sound_buf)
 {
   int buf_left = buf_len;
   int total_copied = 0;
+  // Progressive Sounds are only played up to the data decoded so far
+  bool loading;
+  const int ready_size = sound_buf.readySize(loading);
+  if (!loading && sound.buffer_pos > ready_size) {
+    sound.buffer_pos = 0; // started past the end
+  }
 
   while (true) {
     // FinishedState from decrementLoopCount
@@ -1204,7 +2510,10 @@ int copySound(CopyFunc copy, uint8_t *buffer, const int buf_len,
       break;
     }
 
-    int src_left = sound_buf.size() - sound.buffer_pos;
+    int src_left = ready_size - sound.buffer_pos;
+    if (src_left <= 0 && loading) {
+      break; // wait for more to be decoded
+    }
     CopyResult cpy_amount = 
       copy(buffer + total_copied, buf_left, 
            sound_buf.data() + sound.buffer_pos, src_left);
@@ -1215,6 +2524,10 @@ int copySound(CopyFunc copy, uint8_t *buffer, const int buf_len,
     if (cpy_amount.src_amount < src_left) { 
       sound.buffer_pos += cpy_amount.src_amount;
       break;
+    } else if (loading) {
+      // reached end of decoded data
+      sound.buffer_pos += cpy_amount.src_amount;
+      break;
     } else {
       // reached end of sound
       sound.decrementLoopCount();
@@ -1226,6 +2539,46 @@ int copySound(CopyFunc copy, uint8_t *buffer, const int buf_len,
   return total_copied;
 }
 
+template <class CopyFunc>
+int copySound(CopyFunc copy, uint8_t *buffer, const int buf_len, 
+              PlayingSound &sound, VorbisDecoder &decoder)
+{
+  int buf_left = buf_len;
+  int total_copied = 0;
+
+  while (buf_left > 0) {
+    // FinishedState from decrementLoopCount or on decode error
+    if (sound.isFinished()) { 
+      break;
+    }
+
+    if (decoder.size() == 0) {
+      if (decoder.atEnd()) {
+        // reached end of sound
+        sound.decrementLoopCount();
+        if (!sound.isFinished() && !decoder.rewind()) {
+          sound.state = FinishedState;
+        }
+      } else if (!decoder.decode()) {
+        sound.state = FinishedState;
+      }
+      continue;
+    }
+
+    CopyResult cpy_amount = 
+      copy(buffer + total_copied, buf_left, decoder.data(), decoder.size());
+    if (cpy_amount.target_amount == 0) {
+      break;
+    }
+
+    decoder.consume(cpy_amount.src_amount);
+    total_copied += cpy_amount.target_amount;
+    buf_left -= cpy_amount.target_amount;
+  }
+
+  return total_copied;
+}
+
 template <class CopyFunc>
 int copyStream(CopyFunc copy, uint8_t *buffer, const int buf_len, 
                PlayingSound &stream, StreamBuffer &stream_buf)
@@ -1281,124 +2634,488 @@ int copyStream(CopyFunc copy, uint8_t *buffer, const int buf_len,
   return total_copied;
 }
 
+inline float sampleToFloat(float val) { return val; }
+inline float sampleToFloat(int16_t val) { return val * (1.0f / 32768.0f); }
+
 template <class T>
 CopyResult 
 CopyMono<T>::operator()(uint8_t *dst_, int target_len, 
-                     uint8_t *src_, int src_len)
+                        uint8_t *src_, int src_len)
 {
-  int half_target_left = target_len / 2;
-  int half_cpy_amount = half_target_left < src_len ? 
-                        half_target_left : src_len;
+  const int target_frames = target_len / (2 * sizeof(float));
+  const int src_frames = src_len / sizeof(T);
+  const int len = target_frames < src_frames ? target_frames : src_frames;
 
-  const int len = half_cpy_amount / sizeof(T);
   T *src = (T*)src_; 
   T *src_end = src + len; 
-  T *dst = (T*)dst_;
+  float *dst = (float*)dst_;
   while (src != src_end) {
-    const T val = *src++;
+    const float val = sampleToFloat(*src++);
     dst[0] = val;
     dst[1] = val;
     dst += 2;
   }
 
-  CopyResult result = { half_cpy_amount * 2, half_cpy_amount };
+  CopyResult result = { (int)(len * 2 * sizeof(float)), 
+                        (int)(len * sizeof(T)) };
+  return result;
+}
+
+template <class T>
+CopyResult 
+CopyStereo<T>::operator()(uint8_t *dst_, int target_len, 
+                          uint8_t *src_, int src_len)
+{
+  const int target_frames = target_len / (2 * sizeof(float));
+  const int src_frames = src_len / (2 * sizeof(T));
+  const int len = target_frames < src_frames ? target_frames : src_frames;
+
+  T *src = (T*)src_; 
+  T *src_end = src + len * 2; 
+  float *dst = (float*)dst_;
+  while (src != src_end) {
+    *dst++ = sampleToFloat(*src++);
+  }
+
+  CopyResult result = { (int)(len * 2 * sizeof(float)), 
+                        (int)(len * 2 * sizeof(T)) };
   return result;
 }
 
+// float samples don't need converting
+template <>
 CopyResult 
-CopyStereo::operator()(uint8_t *dst, int dst_len, uint8_t *src, int src_len)
+CopyStereo<float>::operator()(uint8_t *dst, int target_len, 
+                              uint8_t *src, int src_len)
 {
-  int cpy_amount = dst_len < src_len ? dst_len : src_len;
+  int cpy_amount = target_len < src_len ? target_len : src_len;
+  cpy_amount = (cpy_amount / (2 * sizeof(float))) * (2 * sizeof(float));
   memcpy(dst, src, cpy_amount);
 
   CopyResult result = { cpy_amount, cpy_amount };
   return result;
 }
 
-int copySound(PlayingSound &sound, SoundBuffer &sound_buf, 
-              uint8_t *buf, int len)
+// Decodes ADPCM Sound to stereo float, at the rate it's stored at.
+int copyADPCM(uint8_t *buffer, const int buf_len, 
+              PlayingSound &sound, SoundBuffer &sound_buf)
 {
-  if (sound_buf.numChannels() == 1) {
-    switch (KameMix_getFormat()) {
-    case KameMix_OutputFloat:
-      return copySound(CopyMono<float>(), buf, len, sound, sound_buf);
-      break;
-    case KameMix_OutputS16:
-      return copySound(CopyMono<int16_t>(), buf, len, sound, sound_buf);
-      break;
+  AdpcmDecoder &decoder = sound.adpcm;
+  const int dst_frames = buf_len / (2 * sizeof(float));
+  float *dst = (float*)buffer;
+  int i = 0;
+
+  while (i < dst_frames && !sound.isFinished()) {
+    dst[0] = decoder.sample(0);
+    dst[1] = decoder.sample(1);
+    dst += 2;
+    ++i;
+
+    if (!decoder.advance()) {
+      // reached end of sound
+      sound.decrementLoopCount();
+      if (!sound.isFinished()) {
+        decoder.seek(0);
+      }
     }
-    assert("Invalid Output Format");
-    return -1;
+  }
+
+  return i * 2 * sizeof(float);
+}
+
+// Wrappers of the copy functions for each kind of voice, to put in tables
+// by channels and sample format
+template <class CopyFunc>
+int copySoundVoice(PlayingSound &sound, uint8_t *buf, int len)
+{
+  return copySound(CopyFunc(), buf, len, sound, sound.sound().buffer);
+}
+
+// decoder always outputs float
+template <class CopyFunc>
+int decodeSoundVoice(PlayingSound &sound, uint8_t *buf, int len)
+{
+  return copySound(CopyFunc(), buf, len, sound, *sound.decoder);
+}
+
+int copyADPCMVoice(PlayingSound &sound, uint8_t *buf, int len)
+{
+  return copyADPCM(buf, len, sound, sound.sound().buffer);
+}
+
+// streams are always stored as float
+template <class CopyFunc>
+int copyStreamVoice(PlayingSound &sound, uint8_t *buf, int len)
+{
+  return copyStream(CopyFunc(), buf, len, sound, sound.stream().buffer);
+}
+
+// [channels - 1][is_s16]
+const CopyVoiceFunc COPY_SOUND_FUNCS[2][2] = {
+  { copySoundVoice<CopyMono<float>>, copySoundVoice<CopyMono<int16_t>> },
+  { copySoundVoice<CopyStereo<float>>, copySoundVoice<CopyStereo<int16_t>> }
+};
+// [channels - 1]
+const CopyVoiceFunc DECODE_SOUND_FUNCS[2] = {
+  decodeSoundVoice<CopyMono<float>>, decodeSoundVoice<CopyStereo<float>>
+};
+const CopyVoiceFunc COPY_STREAM_FUNCS[2] = {
+  copyStreamVoice<CopyMono<float>>, copyStreamVoice<CopyStereo<float>>
+};
+
+// Returns copy function specialized for how sound is stored, which copies 
+// it at the rate it's stored at.
+CopyVoiceFunc sourceCopyFunc(PlayingSound &sound)
+{
+  if (sound.tag == StreamType) {
+    return COPY_STREAM_FUNCS[sound.stream().buffer.numChannels() - 1];
+  }
+
+  SoundBuffer &sound_buf = sound.sound().buffer;
+  const int ch = sound_buf.numChannels() - 1;
+  if (sound.decoder) {
+    return DECODE_SOUND_FUNCS[ch];
+  } else if (sound_buf.isADPCM()) {
+    return copyADPCMVoice;
+  }
+
+  const int is_s16 = sound_buf.format() == KameMix_OutputS16;
+  return COPY_SOUND_FUNCS[ch][is_s16];
+}
+
+// Returns source frames sound advances per output frame, from its pitch and
+// the rate it's stored at. Streams and compressed Sounds are decoded at the
+// output rate.
+double resampleStep(PlayingSound &sound)
+{
+  double step = sound.pitch;
+  if (sound.tag == SoundType && !sound.decoder) {
+    step *= (double)sound.sound().buffer.rate() / kame_mix.frequency;
+  }
+  return std::min(step, (double)VoiceResampler::MAX_STEP);
+}
+
+// Copies sound at resampleStep, reading it at its own rate with 
+// sourceCopyFunc a chunk at a time. The copy functions handle loops and 
+// waiting for data, so resampling works for every kind of voice.
+int resampleVoice(PlayingSound &sound, uint8_t *buf, int len)
+{
+  VoiceResampler &resampler = sound.resampler;
+  resampler.active = true;
+  const CopyVoiceFunc copy = sourceCopyFunc(sound);
+  const double step = resampleStep(sound);
+  float chunk[VoiceResampler::CHUNK_LEN];
+  const int dst_frames = len / (2 * sizeof(float));
+  float *dst = (float*)buf;
+  int i = 0;
+
+  while (i < dst_frames && !sound.isFinished()) {
+    const int wanted = resampler.framesWanted(dst_frames - i, step);
+    float *src = resampler.beginChunk(chunk);
+    const int copied = 
+      copy(sound, (uint8_t*)src, wanted * 2 * sizeof(float)) / 
+      (2 * sizeof(float));
+    const int output = 
+      resampler.resample(*kame_mix.kernels, kame_mix.resample_quality, 
+                         chunk, copied, sound.isFinished(), step, 
+                         dst + i * 2, dst_frames - i);
+    i += output;
+    if (copied < wanted || output == 0) {
+      break; // finished, or waiting for data
+    }
+  }
+
+  return i * 2 * sizeof(float);
+}
+
+// Returns copy function for sound. Picked once per voice each block, so 
+// copying has no format checks.
+CopyVoiceFunc copyVoiceFunc(PlayingSound &sound)
+{
+  if (sound.resampler.active || resampleStep(sound) != 1.0) {
+    return resampleVoice;
+  }
+  return sourceCopyFunc(sound);
+}
+
+// Starts playing sound that was waiting for its data to be reloaded. 
+// Returns false if still reloading. If reloading failed, sound is set to
+// FinishedState.
+bool startReloadedSound_locked(PlayingSound &sound)
+{
+  KameMix_Sound &snd = sound.sound();
+  switch (snd.residency.load(std::memory_order_acquire)) {
+  case SoundResident:
+    break;
+  case SoundEvicted: // evicted again before playing started
+    kame_mix.sound_cache->startReload(&snd);
+    return false;
+  case SoundReloading:
+    return false;
+  case SoundReloadFailed:
+    sound.waiting_reload = false;
+    sound.state = FinishedState;
+    return true;
+  }
+
+  sound.waiting_reload = false;
+  // decoder can't be opened in audio thread
+  if (snd.buffer.isCompressed()) {
+    sound.state = FinishedState;
+    return true;
+  }
+  setSoundStart_locked(sound, sound.start_sec);
+  return true;
+}
+
+// Sets start and end to the range of frames that sound plays in, of the 
+// block of frames mixed at clock. Returns false if it starts after the 
+// block. end is start if it stopped before the block.
+bool scheduledFrames(const PlayingSound &sound, uint64_t clock, int frames,
+                     int &start, int &end)
+{
+  const uint64_t block_end = clock + frames;
+  if (sound.start_frame >= block_end) {
+    return false;
+  }
+  start = sound.start_frame > clock ? (int)(sound.start_frame - clock) : 0;
+  if (sound.stop_frame <= clock + start) {
+    end = start;
+  } else if (sound.stop_frame < block_end) {
+    end = (int)(sound.stop_frame - clock);
   } else {
-    return copySound(CopyStereo(), buf, len, sound, sound_buf);
+    end = frames;
   }
+  return true;
 }
 
-int copyStream(PlayingSound &sound, StreamBuffer &stream_buf,
-              uint8_t *buf, int len)
+// Applies batches committed since the last block, so all of a batch's 
+// changes are heard starting in the same block.
+void applyUpdates_locked()
 {
-  if (stream_buf.numChannels() == 1) {
-    switch (KameMix_getFormat()) {
-    case KameMix_OutputFloat:
-      return copyStream(CopyMono<float>(), buf, len, sound, stream_buf);
+  for (const ParamUpdate &update : *kame_mix.pending_updates) {
+    PlayingSound &sound = (*kame_mix.sounds)[update.channel.idx];
+    if (sound.id != update.channel.id || sound.tag == InvalidType) {
+      continue; // finished since the change
+    }
+    switch (update.type) {
+    case PosParam:
+      sound.x = update.a;
+      sound.y = update.b;
+      sound.pos_ramp.unset();
+      break;
+    case VolumeParam:
+      sound.new_volume = update.a;
+      sound.volume_ramp.unset();
       break;
-    case KameMix_OutputS16:
-      return copyStream(CopyMono<int16_t>(), buf, len, sound, stream_buf);
+    case MaxDistanceParam:
+      sound.max_distance = update.a;
       break;
     }
-    assert("Invalid Output Format");
-    return -1;
+  }
+  kame_mix.pending_updates->clear(); // keeps capacity
+}
+
+// Drops changes of type to c in batches committed since the last block. 
+// Setting a param directly drops them instead of applying them, since 
+// applying any between blocks would split their batch across voices 
+// already mixed and not.
+void dropUpdates_locked(KameMix_Channel c, ParamType type)
+{
+  ParamUpdates &pending = *kame_mix.pending_updates;
+  pending.erase(
+    std::remove_if(pending.begin(), pending.end(), 
+                   [&](const ParamUpdate &update) {
+                     return update.channel.idx == c.idx && 
+                       update.channel.id == c.id && update.type == type;
+                   }),
+    pending.end());
+}
+
+// Advances group volume ramps by secs, once per block before voices are 
+// mixed.
+void advanceGroups_locked(float secs)
+{
+  for (Group &group : *kame_mix.groups) {
+    if (group.ramp.isActive()) {
+      const float t = group.ramp.advance(secs);
+      group.volume = rampValue(group.ramp_start, group.ramp_target, t, 
+                               group.ramp.curve);
+    }
+  }
+}
+
+// Returns bus sound is mixed into, or nullptr if mixed into output.
+inline
+Bus* voiceBus_locked(const PlayingSound &sound)
+{
+  return sound.group >= 0 ? (*kame_mix.groups)[sound.group].bus : nullptr;
+}
+
+// Returns bus sound sends to from KameMix_setSend, or else from the 
+// KameMix_setGroupSend of its group if not a bus, and sets level. Returns 
+// nullptr if it doesn't send.
+inline
+Bus* voiceSend_locked(const PlayingSound &sound, float &level)
+{
+  int send = sound.send;
+  level = sound.send_level;
+  if (send < 0 && sound.group >= 0 && !(*kame_mix.groups)[sound.group].bus) {
+    send = (*kame_mix.groups)[sound.group].send;
+    level = (*kame_mix.groups)[sound.group].send_level;
+  }
+  return send >= 0 ? (*kame_mix.groups)[send].bus : nullptr;
+}
+
+// Returns vdata with its volume scaled by send level.
+inline
+VolumeData sendVolume(VolumeData vdata, float level)
+{
+  vdata.left_volume *= level;
+  vdata.right_volume *= level;
+  return vdata;
+}
+
+// Returns how sound, at idx in kame_mix.sounds, is mixed after copying len
+// samples for the block from frame start.
+VoiceMix voiceMix_locked(int idx, const PlayingSound &sound, int start, 
+                         int len, const VolumeData &vdata)
+{
+  VoiceMix vm;
+  vm.idx = idx;
+  vm.id = sound.id;
+  vm.start = start;
+  vm.len = len;
+  vm.vdata = vdata;
+  vm.bus = voiceBus_locked(sound);
+  vm.send = voiceSend_locked(sound, vm.send_level);
+  return vm;
+}
+
+// Smooths sound's filter for this block, and returns true if it's 
+// filtered.
+inline
+bool filterVoice_locked(PlayingSound &sound)
+{
+  if (!sound.filter.isActive()) {
+    return false;
+  }
+  sound.filter.smooth(kame_mix.filter_smoothing);
+  return sound.filter.isActive();
+}
+
+// Mixes len samples of src into bus starting at frame start. Mix workers 
+// can be adding to the same bus.
+void mixIntoBus(Bus &bus, MixVoiceFunc mix, int start, const float *src, 
+                int len, const VolumeData &vdata)
+{
+  while (bus.lock.test_and_set(std::memory_order_acquire)) { }
+  mix(bus.buf + start * kame_mix.channels, src, len, vdata);
+  bus.lock.clear(std::memory_order_release);
+}
+
+// Mixes src into its bus or dst, and its send. Doesn't use the voice, so 
+// it's safe unlocked. Buses are only freed by shutdown.
+void mixVoiceMix(const VoiceMix &vm, const float *src, float *dst)
+{
+  MixVoiceFunc mix = mixVoiceFunc(*kame_mix.kernels, vm.vdata);
+  if (vm.bus) {
+    mixIntoBus(*vm.bus, mix, vm.start, src, vm.len, vm.vdata);
   } else {
-    return  copyStream(CopyStereo(), buf, len, sound, stream_buf);
+    mix(dst + vm.start * kame_mix.channels, src, vm.len, vm.vdata);
+  }
+  if (vm.send) {
+    const VolumeData send_vdata = sendVolume(vm.vdata, vm.send_level);
+    mixIntoBus(*vm.send, mixVoiceFunc(*kame_mix.kernels, send_vdata), 
+               vm.start, src, vm.len, send_vdata);
   }
 }
 
-template <class T, class U>
-void mixStream(T *target, U *source, int len) 
+// Filters the batched voices together, and mixes them like mixVoiceMix.
+void mixFilterJobs(FilterJobs &jobs, float *dst, int frames)
 {
-  for (int i = 0; i < len; ++i) {
-    target[i] += source[i];
+  jobs.batch.run(*kame_mix.kernels, frames);
+  for (int i = 0; i < jobs.batch.size(); ++i) {
+    const VoiceMix &vm = jobs.voices[i];
+    mixVoiceMix(vm, jobs.batch.buffer(i) + vm.start * kame_mix.channels, 
+                dst);
   }
 }
 
-void clamp(float *buf, int len)
+// Saves filter state of voices mixed by mixFilterJobs, unless freed since,
+// and empties the batch.
+void saveFilterJobs_locked(FilterJobs &jobs)
 {
-  for (int i = 0; i < len; ++i) {
-    float val = buf[i];
-    if (val > 1.0f) {
-      buf[i] = 1.0f;
-    } else if (val < -1.0f) {
-      buf[i] = -1.0f;
+  for (int i = 0; i < jobs.batch.size(); ++i) {
+    const VoiceMix &vm = jobs.voices[i];
+    PlayingSound &sound = (*kame_mix.sounds)[vm.idx];
+    if (sound.tag != InvalidType && sound.id == vm.id) {
+      jobs.batch.saveState(i, sound.filter);
     }
   }
+  jobs.batch.clear();
 }
 
-void clamp(int16_t *target, int32_t *src, int len)
+// Zeroes num_samples of each bus before voices are mixed into them.
+void clearBuses_locked(int num_samples)
 {
-  const int32_t max_val = std::numeric_limits<int16_t>::max();
-  const int32_t min_val = std::numeric_limits<int16_t>::min();
-  for (int i = 0; i < len; ++i) {
-    int32_t val = src[i];
-    if (val > max_val) {
-      target[i] = max_val;
-    } else if (val < min_val) {
-      target[i] = min_val;
-    } else {
-      target[i] = val;
+  for (Group &group : *kame_mix.groups) {
+    if (group.bus) {
+      memset(group.bus->buf, 0, num_samples * sizeof(float));
     }
   }
 }
 
-void audioCallback(void *udata, uint8_t *stream, const int len)
+// Runs each bus's effect, and mixes it into its parent or mix_buf, with 
+// gain ramped from its volume in the last block to its group's volume. 
+// Parents are created before their children, so going from last to first
+// processes children before parents.
+void mixBuses_locked(float *mix_buf, int num_samples)
 {
-  if (KameMix_getFormat() == KameMix_OutputS16) {
-    memset(kame_mix.audio_mix_buf, 0, 
-           kame_mix.audio_mix_buf_len * sizeof(int32_t));
-  } else {
-    memset(stream, 0, len);
+  const int frames = num_samples / kame_mix.channels;
+  for (int i = (int)kame_mix.groups->size() - 1; i >= 0; --i) {
+    Group &group = (*kame_mix.groups)[i];
+    Bus *bus = group.bus;
+    if (!bus) {
+      continue;
+    }
+    if (bus->effect) {
+      bus->effect(bus->buf, frames, bus->effect_data);
+    }
+    float *dst = bus->parent >= 0 ? 
+      (*kame_mix.groups)[bus->parent].bus->buf : mix_buf;
+    const float step = (group.volume - bus->last_volume) / frames;
+    float gain = bus->last_volume;
+    for (int j = 0; j < num_samples; j += 2) {
+      gain += step;
+      dst[j] += bus->buf[j] * gain;
+      dst[j + 1] += bus->buf[j + 1] * gain;
+    }
+    if (group.send >= 0) {
+      float *send = (*kame_mix.groups)[group.send].bus->buf;
+      gain = bus->last_volume * group.send_level;
+      const float send_step = step * group.send_level;
+      for (int j = 0; j < num_samples; j += 2) {
+        gain += send_step;
+        send[j] += bus->buf[j] * gain;
+        send[j + 1] += bus->buf[j + 1] * gain;
+      }
+    }
+    bus->last_volume = group.volume;
   }
+}
 
-  std::unique_lock<std::mutex> guard(kame_mix.audio_mutex);
+// Mixes voices on the audio thread. Unlocks kame_mix.audio_mutex while 
+// mixing each voice after copying it.
+void mixSerial(float *mix_buf, int num_samples, uint64_t clock)
+{
+  const int frames = num_samples / kame_mix.channels;
+  const float secs_per_frame = 1.0f / kame_mix.frequency;
+  FilterJobs &filter_jobs = kame_mix.filter_jobs[0];
+  AudioGuard guard;
+  applyUpdates_locked();
+  advanceGroups_locked(frames * secs_per_frame);
+  clearBuses_locked(num_samples);
 
   // Sounds can be added between locks, so use indexing and size(), instead 
   // of iterators or range-based for loop.
@@ -1407,51 +3124,260 @@ void audioCallback(void *udata, uint8_t *stream, const int len)
     PlayingSound &sound = (*kame_mix.sounds)[i];
     // not paused or finished
     if (sound.isPlaying() || sound.isPauseChanging()) {
-      int total_copied = 0; 
+      if (sound.waiting_reload && !startReloadedSound_locked(sound)) {
+        continue; // Sound's data is still being reloaded
+      }
+      int start, end;
+      if (!scheduledFrames(sound, clock, frames, start, end)) {
+        continue; // starts in a later block
+      }
 
-      if (sound.tag == SoundType) {
-        total_copied = copySound(sound, sound.sound().buffer, 
-                                 kame_mix.audio_tmp_buf, len);
-      } else {
-        total_copied = copyStream(sound, sound.stream().buffer, 
-                                  kame_mix.audio_tmp_buf, len);
+      // Filtered voices are copied to their place in a block buffer of the
+      // batch, and mixed once the batch is filtered.
+      const bool filtered = filterVoice_locked(sound);
+      float *voice_buf = filtered ? 
+        filter_jobs.batch.add(sound.filter) + start * kame_mix.channels :
+        (float*)kame_mix.audio_tmp_buf;
+      const int tmp_len = (end - start) * kame_mix.channels * sizeof(float);
+      CopyVoiceFunc copy = copyVoiceFunc(sound);
+      const int total_copied = copy(sound, (uint8_t*)voice_buf, tmp_len);
+
+      VolumeData vdata = sound.getVolumeData((end - start) * secs_per_frame);
+      if (sound.stop_frame <= clock + frames) {
+        sound.state = FinishedState; // reached stop_frame
       }
 
-      VolumeData vdata = sound.getVolumeData();
+      // filters ring past the samples copied, to the end of the block
+      const int len = filtered ? (frames - start) * kame_mix.channels :
+        total_copied / sizeof(float);
+      const VoiceMix vm = voiceMix_locked(i, sound, start, len, vdata);
 
       // finished in copy or getVolumeData
       if (sound.isFinished()) {
         freeChannel_locked(i, sound); // free Sound/Stream; set to InvalidType
       }
 
+      if (filtered) {
+        filter_jobs.voices[filter_jobs.batch.size() - 1] = vm;
+        if (filter_jobs.batch.isFull()) {
+          guard.unlock();
+          mixFilterJobs(filter_jobs, mix_buf, frames);
+          guard.lock();
+          saveFilterJobs_locked(filter_jobs);
+        }
+        continue;
+      }
+
       // Unlock kame_mix.audio_mutex when done with sound.
       guard.unlock();
+      mixVoiceMix(vm, voice_buf, mix_buf);
+      guard.lock();
+    }
+  }
 
-      switch (KameMix_getFormat()) {
-      case KameMix_OutputFloat: {
-        const int num_samples = total_copied / sizeof(float);
-        applyVolume((float*)kame_mix.audio_tmp_buf, num_samples, vdata);
-        mixStream((float*)stream, (float*)kame_mix.audio_tmp_buf, num_samples);
-        break;
+  if (filter_jobs.batch.size() > 0) {
+    guard.unlock();
+    mixFilterJobs(filter_jobs, mix_buf, frames);
+    guard.lock();
+    saveFilterJobs_locked(filter_jobs);
+  }
+  mixBuses_locked(mix_buf, num_samples);
+}
+
+// Rough cost of mixing sound relative to copying a Sound stored at the
+// output rate, so the most expensive are given to workers first.
+int voiceCost(PlayingSound &sound)
+{
+  int cost = 1;
+  if (sound.tag == StreamType) {
+    cost = 4; // can swap buffers
+  } else if (sound.decoder) {
+    cost = 8;
+  } else if (sound.sound().buffer.isADPCM()) {
+    cost = 3;
+  }
+  if (sound.resampler.active || resampleStep(sound) != 1.0) {
+    cost += 1;
+  }
+  return cost;
+}
+
+struct ParallelMix {
+  int num_samples;
+  uint64_t clock; // at start of block
+  std::atomic<int> next_job; // index of next job in kame_mix.mix_jobs
+  bool used[MixWorkers::MAX_WORKERS]; // worker mixed into its accumulator
+};
+
+// Run on each mix worker. Takes voices from kame_mix.mix_jobs until none are
+// left, and mixes them into the worker's accumulator. Jobs are sorted most
+// expensive first, so workers that get cheap voices take more of them.
+void mixJobs(int worker, void *data)
+{
+  ParallelMix &pm = *(ParallelMix*)data;
+  MixJobs &jobs = *kame_mix.mix_jobs;
+  MixWorkers &workers = *kame_mix.mix_workers;
+  uint8_t *tmp_buf = workers.tmpBuffer(worker);
+  float *accum = workers.accumulator(worker);
+  FilterJobs &filter_jobs = kame_mix.filter_jobs[worker];
+  const int frames = pm.num_samples / kame_mix.channels;
+  const float secs_per_frame = 1.0f / kame_mix.frequency;
+  pm.used[worker] = false;
+
+  while (true) {
+    const int j = pm.next_job.fetch_add(1, std::memory_order_relaxed);
+    if (j >= (int)jobs.size()) {
+      break;
+    }
+    if (!pm.used[worker]) {
+      memset(accum, 0, pm.num_samples * sizeof(float));
+      pm.used[worker] = true;
+    }
+
+    // each voice is only used by one worker, and audio_mutex is held by the
+    // audio thread, so it's safe to use like it's locked
+    const MixJob &job = jobs[j];
+    PlayingSound &sound = (*kame_mix.sounds)[job.idx];
+    const bool filtered = filterVoice_locked(sound);
+    float *voice_buf = filtered ? 
+      filter_jobs.batch.add(sound.filter) + job.start * kame_mix.channels :
+      (float*)tmp_buf;
+    const int tmp_len = (job.end - job.start) * kame_mix.channels * 
+      sizeof(float);
+    CopyVoiceFunc copy = copyVoiceFunc(sound);
+    const int total_copied = copy(sound, (uint8_t*)voice_buf, tmp_len);
+    VolumeData vdata = 
+      sound.getVolumeData((job.end - job.start) * secs_per_frame);
+    if (sound.stop_frame <= pm.clock + frames) {
+      sound.state = FinishedState; // reached stop_frame
+    }
+    const int len = filtered ? (frames - job.start) * kame_mix.channels :
+      total_copied / sizeof(float);
+    const VoiceMix vm = voiceMix_locked(job.idx, sound, job.start, len, vdata);
+    if (filtered) {
+      filter_jobs.voices[filter_jobs.batch.size() - 1] = vm;
+      if (filter_jobs.batch.isFull()) {
+        mixFilterJobs(filter_jobs, accum, frames);
+        saveFilterJobs_locked(filter_jobs);
       }
-      case KameMix_OutputS16: {
-        const int num_samples = total_copied / sizeof(int16_t);
-        applyVolume((int16_t*)kame_mix.audio_tmp_buf, num_samples, vdata);
-        mixStream(kame_mix.audio_mix_buf, (int16_t*)kame_mix.audio_tmp_buf, num_samples);
-        break;
+    } else {
+      mixVoiceMix(vm, voice_buf, accum);
+    }
+  }
+
+  if (filter_jobs.batch.size() > 0) {
+    mixFilterJobs(filter_jobs, accum, frames);
+    saveFilterJobs_locked(filter_jobs);
+  }
+}
+
+// Mixes voices on kame_mix.mix_workers, and adds their accumulators to 
+// mix_buf. kame_mix.audio_mutex is held while they mix.
+void mixParallel(float *mix_buf, int num_samples, uint64_t clock)
+{
+  MixWorkers &workers = *kame_mix.mix_workers;
+  MixJobs &jobs = *kame_mix.mix_jobs;
+  ParallelMix pm;
+  pm.num_samples = num_samples;
+  pm.clock = clock;
+  const int frames = num_samples / kame_mix.channels;
+  pm.next_job.store(0, std::memory_order_relaxed);
+
+  AudioGuard guard;
+  applyUpdates_locked();
+  advanceGroups_locked((float)frames / kame_mix.frequency);
+  clearBuses_locked(num_samples);
+
+  // reserved to number of voices when they're added, so doesn't allocate
+  jobs.clear();
+  for (int i = 0; i < (int)kame_mix.sounds->size(); ++i) {
+    PlayingSound &sound = (*kame_mix.sounds)[i];
+    // not paused or finished
+    if (sound.isPlaying() || sound.isPauseChanging()) {
+      // SoundCache isn't safe to use from workers
+      if (sound.waiting_reload && !startReloadedSound_locked(sound)) {
+        continue; // Sound's data is still being reloaded
       }
+      MixJob job = { voiceCost(sound), i, 0, 0 };
+      if (scheduledFrames(sound, clock, frames, job.start, job.end)) {
+        jobs.push_back(job);
       }
+    }
+  }
+  std::sort(jobs.begin(), jobs.end(), 
+            [](const MixJob &a, const MixJob &b) { return a.cost > b.cost; });
 
-      guard.lock();
+  workers.run(mixJobs, &pm);
+
+  // Free voices finished in copy or getVolumeData. Done after workers 
+  // finish, since freeing changes the free list.
+  for (const MixJob &job : jobs) {
+    PlayingSound &sound = (*kame_mix.sounds)[job.idx];
+    if (sound.isFinished()) {
+      freeChannel_locked(job.idx, sound); 
+    }
+  }
+  mixBuses_locked(mix_buf, num_samples);
+
+  guard.unlock();
+
+  // add accumulators at full volume
+  VolumeData unity = { 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0 };
+  MixVoiceFunc add = mixVoiceFunc(*kame_mix.kernels, unity);
+  for (int i = 0; i < workers.numWorkers(); ++i) {
+    if (pm.used[i]) {
+      add(mix_buf, workers.accumulator(i), num_samples, unity);
     }
   }
+}
+
+void audioCallback(void *udata, uint8_t *stream, const int len)
+{
+  if (kame_mix.mix_ahead) {
+    kame_mix.mix_ahead->read(stream, len); // already mixed
+    return;
+  }
+
+  // with KAMEMIX_RT_CHECK, reports unsafe calls, and enables flush to zero
+  RtAudioScope rt_scope;
+  // voice parameters are updated each block
+  for (int pos = 0; pos < len; pos += kame_mix.block_len) {
+    const int block_len = std::min(kame_mix.block_len, len - pos);
+    mixBlock(stream + pos, block_len);
+  }
+}
+
+// Mixes len bytes of all playing voices to stream in output format. len is
+// at most kame_mix.block_len. Called from audioCallback, or MixAhead's 
+// thread.
+void mixBlock(uint8_t *stream, const int len)
+{
+  // Mix as float, and convert to output format after
+  const int num_samples = len / KameMix_getFormatSize();
+  float *mix_buf;
+  if (KameMix_getFormat() == KameMix_OutputS16) {
+    mix_buf = kame_mix.audio_mix_buf;
+  } else {
+    mix_buf = (float*)stream;
+  }
+  memset(mix_buf, 0, num_samples * sizeof(float));
+
+  // only changed by the thread mixing
+  const uint64_t clock = kame_mix.clock.load(std::memory_order_relaxed);
+  if (kame_mix.mix_workers) {
+    mixParallel(mix_buf, num_samples, clock);
+  } else {
+    mixSerial(mix_buf, num_samples, clock);
+  }
+  kame_mix.clock.store(clock + num_samples / kame_mix.channels, 
+                       std::memory_order_relaxed);
 
   switch (KameMix_getFormat()) {
   case KameMix_OutputFloat: 
-    clamp((float*)stream, len / sizeof(float));
+    kame_mix.kernels->clamp(mix_buf, num_samples);
     break;
   case KameMix_OutputS16: 
-    clamp((int16_t*)stream, kame_mix.audio_mix_buf, len / sizeof(int16_t));
+    kame_mix.kernels->clamp_s16((int16_t*)stream, mix_buf, num_samples);
     break;
   }
 }
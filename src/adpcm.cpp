@@ -0,0 +1,354 @@
+#include "adpcm.h"
+#include <cstring>
+
+namespace {
+
+const int IMA_STEP_TABLE[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+  45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190,
+  209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724,
+  796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+  2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132,
+  7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+  22385, 24623, 27086, 29794, 32767
+};
+
+const int IMA_INDEX_TABLE[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+const int MS_ADAPTATION_TABLE[16] = {
+  230, 230, 230, 230, 307, 409, 512, 614,
+  768, 614, 512, 409, 307, 230, 230, 230
+};
+
+inline
+int clampSample(int val)
+{
+  if (val > 32767) {
+    return 32767;
+  } else if (val < -32768) {
+    return -32768;
+  }
+  return val;
+}
+
+inline
+int clampStepIndex(int idx)
+{
+  if (idx > 88) {
+    return 88;
+  } else if (idx < 0) {
+    return 0;
+  }
+  return idx;
+}
+
+inline
+int16_t readS16(const uint8_t *ptr)
+{
+  return (int16_t)(ptr[0] | (ptr[1] << 8));
+}
+
+inline
+void writeS16(uint8_t *ptr, int val)
+{
+  ptr[0] = (uint8_t)(val & 0xFF);
+  ptr[1] = (uint8_t)((val >> 8) & 0xFF);
+}
+
+// Decodes an IMA nibble, updating predictor and step_index.
+// Returns new sample.
+inline
+int imaDecodeNibble(int nibble, int &predictor, int &step_index)
+{
+  const int step = IMA_STEP_TABLE[step_index];
+  int diff = step >> 3;
+  if (nibble & 4) {
+    diff += step;
+  }
+  if (nibble & 2) {
+    diff += step >> 1;
+  }
+  if (nibble & 1) {
+    diff += step >> 2;
+  }
+  if (nibble & 8) {
+    predictor = clampSample(predictor - diff);
+  } else {
+    predictor = clampSample(predictor + diff);
+  }
+  step_index = clampStepIndex(step_index + IMA_INDEX_TABLE[nibble]);
+  return predictor;
+}
+
+// Returns nibble closest to sample, and updates predictor and step_index
+// the same way as the decoder.
+inline
+int imaEncodeNibble(int sample, int &predictor, int &step_index)
+{
+  int diff = sample - predictor;
+  int nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+
+  int step = IMA_STEP_TABLE[step_index];
+  for (int mask = 4; mask != 0; mask >>= 1) {
+    if (diff >= step) {
+      nibble |= mask;
+      diff -= step;
+    }
+    step >>= 1;
+  }
+
+  imaDecodeNibble(nibble, predictor, step_index);
+  return nibble;
+}
+
+// Decodes a Microsoft ADPCM nibble for one channel. Returns new sample.
+inline
+int msDecodeNibble(int nibble, int &sample1, int &sample2, int &delta,
+                   const int16_t *coef)
+{
+  const int signed_nibble = nibble >= 8 ? nibble - 16 : nibble;
+  int predictor = (sample1 * coef[0] + sample2 * coef[1]) / 256;
+  predictor = clampSample(predictor + signed_nibble * delta);
+  sample2 = sample1;
+  sample1 = predictor;
+  delta = (MS_ADAPTATION_TABLE[nibble] * delta) / 256;
+  if (delta < 16) {
+    delta = 16;
+  }
+  return predictor;
+}
+
+// Returns pointer to nibbles of channel ch in transcoded block.
+inline
+const uint8_t* adpcmNibbles(const uint8_t *block, int channels, int ch)
+{
+  return block + channels * 4 + ch * (KameMix::ADPCM_BLOCK_FRAMES / 2);
+}
+
+inline
+int adpcmNibble(const uint8_t *nibbles, int idx)
+{
+  const uint8_t byte = nibbles[idx / 2];
+  return (idx & 1) ? (byte >> 4) : (byte & 0x0F);
+}
+
+} // end anon namespace
+
+namespace KameMix {
+
+int imaWavBlockFrames(int block_bytes, int channels)
+{
+  const int header_size = 4 * channels;
+  if (block_bytes < header_size) {
+    return 0;
+  }
+  // data is in groups of 4 bytes (8 samples) per channel
+  const int groups = (block_bytes - header_size) / header_size;
+  return 1 + groups * 8;
+}
+
+int msWavBlockFrames(int block_bytes, int channels)
+{
+  const int header_size = 7 * channels;
+  if (block_bytes < header_size) {
+    return 0;
+  }
+  return 2 + (block_bytes - header_size) * 2 / channels;
+}
+
+int decodeImaWavBlock(const uint8_t *block, int block_bytes, int channels,
+                      int16_t *out)
+{
+  const int frames = imaWavBlockFrames(block_bytes, channels);
+  if (frames == 0) {
+    return 0;
+  }
+
+  int predictor[2];
+  int step_index[2];
+  for (int ch = 0; ch < channels; ++ch) {
+    predictor[ch] = readS16(block + ch * 4);
+    step_index[ch] = clampStepIndex(block[ch * 4 + 2]);
+    out[ch] = (int16_t)predictor[ch];
+  }
+
+  // Each channel has 4 bytes of data in turn, with the low nibble of each
+  // byte first.
+  const uint8_t *data = block + channels * 4;
+  for (int frame = 1; frame < frames; frame += 8) {
+    for (int ch = 0; ch < channels; ++ch) {
+      int16_t *dst = out + frame * channels + ch;
+      for (int i = 0; i < 4; ++i) {
+        const uint8_t byte = *data++;
+        *dst = (int16_t)imaDecodeNibble(byte & 0x0F, predictor[ch],
+                                        step_index[ch]);
+        dst += channels;
+        *dst = (int16_t)imaDecodeNibble(byte >> 4, predictor[ch],
+                                        step_index[ch]);
+        dst += channels;
+      }
+    }
+  }
+
+  return frames;
+}
+
+int decodeMsWavBlock(const uint8_t *block, int block_bytes, int channels,
+                     const int16_t (*coefs)[2], int num_coefs, int16_t *out)
+{
+  const int frames = msWavBlockFrames(block_bytes, channels);
+  if (frames == 0) {
+    return 0;
+  }
+
+  // header is predictor index, delta, sample1, then sample2 for each
+  // channel in turn
+  const int16_t *coef[2];
+  int delta[2];
+  int sample1[2];
+  int sample2[2];
+  const uint8_t *header = block;
+  for (int ch = 0; ch < channels; ++ch) {
+    const int coef_idx = *header++;
+    if (coef_idx >= num_coefs) {
+      return -1;
+    }
+    coef[ch] = coefs[coef_idx];
+  }
+  for (int ch = 0; ch < channels; ++ch, header += 2) {
+    delta[ch] = readS16(header);
+  }
+  for (int ch = 0; ch < channels; ++ch, header += 2) {
+    sample1[ch] = readS16(header);
+  }
+  for (int ch = 0; ch < channels; ++ch, header += 2) {
+    sample2[ch] = readS16(header);
+  }
+
+  // sample2 is played first
+  for (int ch = 0; ch < channels; ++ch) {
+    out[ch] = (int16_t)sample2[ch];
+    out[channels + ch] = (int16_t)sample1[ch];
+  }
+
+  // nibbles are interleaved by channel, with the high nibble first
+  const uint8_t *data = header;
+  int16_t *dst = out + 2 * channels;
+  const int num_nibbles = (frames - 2) * channels;
+  for (int i = 0; i < num_nibbles; ++i) {
+    const uint8_t byte = data[i / 2];
+    const int nibble = (i & 1) ? (byte & 0x0F) : (byte >> 4);
+    const int ch = i % channels;
+    *dst++ = (int16_t)msDecodeNibble(nibble, sample1[ch], sample2[ch],
+                                     delta[ch], coef[ch]);
+  }
+
+  return frames;
+}
+
+void adpcmEncode(const int16_t *src, int frames, int channels, uint8_t *dst)
+{
+  memset(dst, 0, adpcmEncodedSize(frames, channels));
+
+  int predictor[2] = { 0, 0 };
+  int step_index[2] = { 0, 0 };
+  const int block_size = adpcmBlockSize(channels);
+
+  for (int block_start = 0; block_start < frames;
+       block_start += ADPCM_BLOCK_FRAMES) {
+    uint8_t *block = dst + (block_start / ADPCM_BLOCK_FRAMES) * block_size;
+    int block_frames = frames - block_start;
+    if (block_frames > ADPCM_BLOCK_FRAMES) {
+      block_frames = ADPCM_BLOCK_FRAMES;
+    }
+
+    for (int ch = 0; ch < channels; ++ch) {
+      // header is decoder state before first sample of block
+      writeS16(block + ch * 4, predictor[ch]);
+      block[ch * 4 + 2] = (uint8_t)step_index[ch];
+
+      uint8_t *nibbles = (uint8_t*)adpcmNibbles(block, channels, ch);
+      const int16_t *sample = src + block_start * channels + ch;
+      for (int i = 0; i < block_frames; ++i, sample += channels) {
+        const int nibble =
+          imaEncodeNibble(*sample, predictor[ch], step_index[ch]);
+        nibbles[i / 2] |= (i & 1) ? (nibble << 4) : nibble;
+      }
+    }
+  }
+}
+
+void AdpcmDecoder::open(const uint8_t *data_, int frames_, int channels_)
+{
+  data = data_;
+  frames = frames_;
+  channels = channels_;
+  seek(0);
+}
+
+void AdpcmDecoder::seek(int frame)
+{
+  if (frame < 0 || frame >= frames) {
+    frame = 0;
+  }
+  pos = frame;
+  cur[0] = cur[1] = 0;
+  if (frames == 0) {
+    return;
+  }
+
+  const int block_idx = frame / ADPCM_BLOCK_FRAMES;
+  const int block_pos = frame % ADPCM_BLOCK_FRAMES;
+  const uint8_t *block = data + block_idx * adpcmBlockSize(channels);
+  for (int ch = 0; ch < channels; ++ch) {
+    predictor[ch] = readS16(block + ch * 4);
+    step_index[ch] = clampStepIndex(block[ch * 4 + 2]);
+    const uint8_t *nibbles = adpcmNibbles(block, channels, ch);
+    for (int i = 0; i <= block_pos; ++i) {
+      cur[ch] = (int16_t)imaDecodeNibble(adpcmNibble(nibbles, i),
+                                         predictor[ch], step_index[ch]);
+    }
+  }
+  if (channels == 1) {
+    cur[1] = cur[0];
+  }
+}
+
+bool AdpcmDecoder::advance()
+{
+  if (pos + 1 >= frames) {
+    return false;
+  }
+  ++pos;
+  decodeCur();
+  return true;
+}
+
+void AdpcmDecoder::decodeCur()
+{
+  const int block_idx = pos / ADPCM_BLOCK_FRAMES;
+  const int block_pos = pos % ADPCM_BLOCK_FRAMES;
+  const uint8_t *block = data + block_idx * adpcmBlockSize(channels);
+  for (int ch = 0; ch < channels; ++ch) {
+    if (block_pos == 0) { // start of block, so reload state from header
+      predictor[ch] = readS16(block + ch * 4);
+      step_index[ch] = clampStepIndex(block[ch * 4 + 2]);
+    }
+    const int nibble = adpcmNibble(adpcmNibbles(block, channels, ch),
+                                   block_pos);
+    cur[ch] = (int16_t)imaDecodeNibble(nibble, predictor[ch],
+                                       step_index[ch]);
+  }
+  if (channels == 1) {
+    cur[1] = cur[0];
+  }
+}
+
+} // end namespace KameMix
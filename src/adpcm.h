@@ -0,0 +1,99 @@
+#ifndef KAME_MIX_ADPCM_H
+#define KAME_MIX_ADPCM_H
+
+#include <cstdint>
+
+namespace KameMix {
+
+//
+// Decoding of IMA and Microsoft ADPCM WAV blocks
+//
+
+// Max number of predictor coefficient pairs in a Microsoft ADPCM WAV.
+const int MS_ADPCM_MAX_COEFS = 256;
+
+// Returns number of sample frames in an IMA ADPCM WAV block of block_bytes,
+// or 0 if too small for its header.
+int imaWavBlockFrames(int block_bytes, int channels);
+
+// Returns number of sample frames in a Microsoft ADPCM WAV block of
+// block_bytes, or 0 if too small for its header.
+int msWavBlockFrames(int block_bytes, int channels);
+
+// Decodes an IMA ADPCM WAV block into interleaved samples in out, which must
+// have room for imaWavBlockFrames(block_bytes, channels) frames.
+// Returns number of frames decoded.
+int decodeImaWavBlock(const uint8_t *block, int block_bytes, int channels,
+                      int16_t *out);
+
+// Decodes a Microsoft ADPCM WAV block into interleaved samples in out,
+// which must have room for msWavBlockFrames(block_bytes, channels) frames.
+// coefs are the num_coefs predictor pairs from the WAV format chunk.
+// Returns number of frames decoded, or -1 if block has a bad predictor.
+int decodeMsWavBlock(const uint8_t *block, int block_bytes, int channels,
+                     const int16_t (*coefs)[2], int num_coefs, int16_t *out);
+
+//
+// IMA ADPCM Sounds transcoded at load with KameMix_SoundADPCM
+//
+
+// Number of sample frames in each block of a transcoded Sound. Each block
+// starts with the predictor and step index of every channel, so a playing
+// channel can start decoding at any block.
+const int ADPCM_BLOCK_FRAMES = 256;
+
+// Size in bytes of each block, with a 4 byte header and a nibble per sample
+// for each channel.
+inline
+int adpcmBlockSize(int channels)
+{
+  return channels * (4 + ADPCM_BLOCK_FRAMES / 2);
+}
+
+// Returns size in bytes needed to encode frames with adpcmEncode.
+inline
+int adpcmEncodedSize(int frames, int channels)
+{
+  const int blocks = (frames + ADPCM_BLOCK_FRAMES - 1) / ADPCM_BLOCK_FRAMES;
+  return blocks * adpcmBlockSize(channels);
+}
+
+// Encodes frames of interleaved samples with 1 or 2 channels into dst,
+// which must be adpcmEncodedSize(frames, channels) bytes.
+void adpcmEncode(const int16_t *src, int frames, int channels, uint8_t *dst);
+
+/*
+Decodes a transcoded Sound one sample frame at a time for a playing
+channel. Keeps the current frame decoded. Has no destructor and doesn't own
+data, so it can be stored in PlayingSound.
+*/
+class AdpcmDecoder {
+public:
+  // data is from adpcmEncode, and must stay valid while decoding.
+  void open(const uint8_t *data, int frames, int channels);
+
+  // Sets current frame, decoding from the start of its block.
+  void seek(int frame);
+
+  // Moves to next frame. Returns false if current frame was the last.
+  bool advance();
+
+  // Returns sample of channel ch in current frame.
+  float sample(int ch) const { return cur[ch] * (1.0f / 32768.0f); }
+
+private:
+  // Decodes frame pos into cur, continuing from frame pos - 1.
+  void decodeCur();
+
+  const uint8_t *data;
+  int frames;
+  int channels;
+  int pos; // current frame
+  int predictor[2]; // decoder state after frame pos
+  int step_index[2];
+  int16_t cur[2];
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef KAME_MIX_AUDIO_GUARD_H
+#define KAME_MIX_AUDIO_GUARD_H
+
+namespace KameMix {
+
+// Locks the mutex shared with the audio thread like std::unique_lock, and 
+// keeps track of the thread holding it, so allocating while locked can be 
+// caught with KameMix_InitOptions.debug_alloc_check. Defined in KameMix.cpp.
+class AudioGuard {
+public:
+  AudioGuard() : locked{false} { lock(); }
+  ~AudioGuard() { if (locked) { unlock(); } }
+
+  void lock();
+  void unlock();
+
+private:
+  AudioGuard(const AudioGuard &other) = delete;
+  AudioGuard& operator=(const AudioGuard &other) = delete;
+
+  bool locked;
+};
+
+} // end namespace KameMix
+
+#endif
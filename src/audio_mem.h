@@ -1,30 +1,35 @@
 #ifndef KAME_MIX_AUDIO_MEM_H
 #define KAME_MIX_AUDIO_MEM_H
 
+#include "rt_check.h"
 #include <new>
 
 namespace KameMix {
 
 //
-// Helper functions using user defined malloc,free,realloc
+// Helper functions using user defined malloc,free,realloc. Calls on the 
+// audio thread are reported with KAMEMIX_RT_CHECK, see rt_check.h.
 //
 
 inline
-void km_free(void *ptr)
+void km_free(void *ptr RT_SITE_PARAM)
 {
+  RT_CHECK_SITE("km_free");
   KameMix_getFree()(ptr);
 }
 
 inline
-void* km_malloc_(size_t len)
+void* km_malloc_(size_t len RT_SITE_PARAM)
 {
+  RT_CHECK_SITE("km_malloc");
   return KameMix_getMalloc()(len);
 }
 
 inline
-void* km_malloc(size_t len)
+void* km_malloc(size_t len RT_SITE_PARAM)
 {
-  void *tmp = km_malloc_(len);
+  RT_CHECK_SITE("km_malloc");
+  void *tmp = KameMix_getMalloc()(len);
   if (tmp) {
     return tmp;
   } else {
@@ -33,15 +38,17 @@ void* km_malloc(size_t len)
 }
 
 inline
-void* km_realloc_(void *ptr, size_t len)
+void* km_realloc_(void *ptr, size_t len RT_SITE_PARAM)
 {
+  RT_CHECK_SITE("km_realloc");
   return KameMix_getRealloc()(ptr, len);
 }
 
 inline
-void* km_realloc(void *ptr, size_t len)
+void* km_realloc(void *ptr, size_t len RT_SITE_PARAM)
 {
-  void *tmp = km_realloc_(ptr, len);
+  RT_CHECK_SITE("km_realloc");
+  void *tmp = KameMix_getRealloc()(ptr, len);
   if (tmp) {
     return tmp;
   } else {
@@ -52,6 +59,7 @@ void* km_realloc(void *ptr, size_t len)
 template <class T>
 T* km_new()
 {
+  RT_CHECK("km_new");
   T *buf = (T*) KameMix_getMalloc()(sizeof(T));
   if (buf) {
     buf = new (buf) T();
@@ -62,8 +70,9 @@ T* km_new()
 }
 
 template <class T>
-T* km_new_n(size_t num)
+T* km_new_n(size_t num RT_SITE_PARAM)
 {
+  RT_CHECK_SITE("km_new_n");
   T *buf = (T*) KameMix_getMalloc()(num * sizeof(T));
   if (buf) {
     T *tmp = buf;
@@ -79,15 +88,45 @@ T* km_new_n(size_t num)
 }
 
 template <class T>
-void km_delete(T *ptr)
+void km_delete(T *ptr RT_SITE_PARAM)
 {
+  RT_CHECK_SITE("km_delete");
   ptr->~T();
   KameMix_getFree()(ptr);
 }
 
+// Allocates len bytes from the MemPool if enabled with KameMix_initEx, or 
+// else with the user allocator. Returns nullptr on failure. Must be freed 
+// with poolFree passing the same len.
+void* poolAlloc(size_t len);
+void poolFree(void *ptr, size_t len);
+
+inline
+void* km_pool_alloc(size_t len RT_SITE_PARAM)
+{
+  RT_CHECK_SITE("km_pool_alloc");
+  return poolAlloc(len);
+}
+
+inline
+void km_pool_free(void *ptr, size_t len RT_SITE_PARAM)
+{
+  RT_CHECK_SITE("km_pool_free");
+  poolFree(ptr, len);
+}
+
+template <class T>
+void km_pool_delete(T *ptr RT_SITE_PARAM)
+{
+  RT_CHECK_SITE("km_pool_delete");
+  ptr->~T();
+  poolFree(ptr, sizeof(T));
+}
+
 template <class T>
-void km_delete_n(T *buf, int num)
+void km_delete_n(T *buf, int num RT_SITE_PARAM)
 {
+  RT_CHECK_SITE("km_delete_n");
   T *tmp = buf;
   T *buf_end = buf + num;
   while (tmp != buf_end) {
@@ -113,11 +152,13 @@ struct Alloc{
 
   T* allocate(std::size_t n) 
   { 
+    RT_CHECK("Alloc::allocate");
     return (T*) KameMix_getMalloc()(n * sizeof(T)); 
   }
 
   void deallocate(T *ptr, std::size_t n) 
   { 
+    RT_CHECK("Alloc::deallocate");
     KameMix_getFree()(ptr);
   }
 };
@@ -0,0 +1,67 @@
+#include "audio_ring.h"
+#include "audio_mem.h"
+#include <cstring>
+
+namespace KameMix {
+
+AudioRing::AudioRing(int capacity)
+  : buf{(uint8_t*)km_malloc(capacity)},
+    cap{capacity},
+    read_pos{0},
+    write_pos{0}
+{ }
+
+AudioRing::~AudioRing()
+{
+  km_free(buf);
+}
+
+int AudioRing::readAvailable() const
+{
+  const size_t rpos = read_pos.load(std::memory_order_relaxed);
+  const size_t wpos = write_pos.load(std::memory_order_acquire);
+  return (int)(wpos - rpos);
+}
+
+int AudioRing::writeAvailable() const
+{
+  const size_t wpos = write_pos.load(std::memory_order_relaxed);
+  const size_t rpos = read_pos.load(std::memory_order_acquire);
+  return cap - (int)(wpos - rpos);
+}
+
+int AudioRing::write(const uint8_t *src, int len)
+{
+  const int avail = writeAvailable();
+  if (len > avail) {
+    len = avail;
+  }
+
+  const size_t wpos = write_pos.load(std::memory_order_relaxed);
+  const int start = (int)(wpos % cap);
+  const int first = len < cap - start ? len : cap - start;
+  memcpy(buf + start, src, first);
+  memcpy(buf, src + first, len - first);
+  // publish data after it's written
+  write_pos.store(wpos + len, std::memory_order_release);
+  return len;
+}
+
+int AudioRing::read(uint8_t *dst, int len)
+{
+  const int avail = readAvailable();
+  if (len > avail) {
+    len = avail;
+  }
+
+  const size_t rpos = read_pos.load(std::memory_order_relaxed);
+  const int start = (int)(rpos % cap);
+  const int first = len < cap - start ? len : cap - start;
+  memcpy(dst, buf + start, first);
+  memcpy(dst + first, buf, len - first);
+  // free space after data is copied out
+  read_pos.store(rpos + len, std::memory_order_release);
+  return len;
+}
+
+} // end namespace KameMix
@@ -0,0 +1,48 @@
+#ifndef KAME_MIX_AUDIO_RING_H
+#define KAME_MIX_AUDIO_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+namespace KameMix {
+
+/*
+Lock-free ring buffer of bytes, for one thread writing and another reading
+at the same time. Positions only increase, and are wrapped when used, so 
+the ring can be completely filled. Used by MixAhead to pass audio mixed 
+ahead to the audio callback.
+*/
+class AudioRing {
+public:
+  // capacity is size in bytes.
+  explicit AudioRing(int capacity);
+  ~AudioRing();
+
+  int capacity() const { return cap; }
+  // Bytes that can be read. Exact in the reader, a lower bound elsewhere.
+  int readAvailable() const;
+  // Bytes that can be written. Exact in the writer, a lower bound elsewhere.
+  int writeAvailable() const;
+
+  // Writes up to len bytes of src. Returns number written. Only called by 
+  // the writer.
+  int write(const uint8_t *src, int len);
+
+  // Reads up to len bytes to dst. Returns number read. Only called by the
+  // reader.
+  int read(uint8_t *dst, int len);
+
+private:
+  AudioRing(const AudioRing &other) = delete;
+  AudioRing& operator=(const AudioRing &other) = delete;
+
+  uint8_t *buf;
+  int cap;
+  std::atomic<size_t> read_pos;
+  std::atomic<size_t> write_pos;
+};
+
+} // end namespace KameMix
+
+#endif
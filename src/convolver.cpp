@@ -0,0 +1,207 @@
+#include "convolver.h"
+#include <SDL.h>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+namespace KameMix {
+
+const int Convolver::HEAD_PARTITIONS;
+
+Convolver::Convolver(const float *ir, int frames, int channels,
+                     int block_frames, float block_secs_, bool tail_thread,
+                     const MixKernels &kernels_)
+  : kernels(kernels_),
+    fft{block_frames * 2},
+    block{block_frames},
+    parts{std::max(1, (frames + block_frames - 1) / block_frames)},
+    block_pos{0},
+    block_num{0},
+    late_blocks{0},
+    block_secs{block_secs_},
+    quit{false}
+{
+  head_parts = tail_thread ? std::min(parts, HEAD_PARTITIONS) : parts;
+  // input spectra are kept until the tail thread is done with them, and
+  // tails are summed up to head_parts blocks ahead. head_parts more are 
+  // kept, so a tail that's published wasn't overwritten while summed.
+  input_slots = parts + 2 * head_parts;
+  tail_slots = head_parts + 1;
+  const int spectrum_len = 2 * 2 * block; // 2 channels of real and imag
+  ir_spectra.resize(parts * spectrum_len);
+  input_spectra.resize(input_slots * spectrum_len, 0.0f);
+  tail_sums.resize(tail_slots * spectrum_len);
+  window[0].resize(2 * block, 0.0f);
+  window[1].resize(2 * block, 0.0f);
+  output.resize(2 * block, 0.0f);
+  sum.resize(spectrum_len);
+  time_buf.resize(2 * block);
+
+  // Partitions are zero padded to the FFT size, and scaled by 1/size so
+  // output doesn't need to be scaled after the inverse FFT.
+  const float scale = 1.0f / fft.size();
+  for (int p = 0; p < parts; ++p) {
+    for (int c = 0; c < 2; ++c) {
+      const int src_channel = channels == 2 ? c : 0;
+      std::fill(time_buf.begin(), time_buf.end(), 0.0f);
+      for (int i = 0; i < block && p * block + i < frames; ++i) {
+        time_buf[i] = ir[(p * block + i) * channels + src_channel] * scale;
+      }
+      float *re = spectrum(ir_spectra, p, c);
+      fft.forward(time_buf.data(), re, re + block);
+    }
+  }
+
+  tail_ready = decltype(tail_ready)(tail_slots);
+  for (std::atomic<int64_t> &ready : tail_ready) {
+    ready.store(-1, std::memory_order_relaxed);
+  }
+  posted.store(head_parts - 1, std::memory_order_relaxed);
+  if (parts > head_parts) {
+    // started last, after everything it uses is set
+    thread = std::thread(&Convolver::threadMain, this);
+  }
+}
+
+Convolver::~Convolver()
+{
+  if (thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit.store(true, std::memory_order_relaxed);
+    }
+    cond.notify_one();
+    thread.join();
+  }
+}
+
+void Convolver::process(float *buf, int frames)
+{
+  int i = 0;
+  while (i < frames) {
+    const int len = std::min(frames - i, block - block_pos);
+    float *left = window[0].data() + block + block_pos;
+    float *right = window[1].data() + block + block_pos;
+    const float *out = output.data() + block_pos * 2;
+    for (int j = 0; j < len; ++j) {
+      float *frame = buf + (i + j) * 2;
+      left[j] = frame[0];
+      right[j] = frame[1];
+      frame[0] = out[j * 2];
+      frame[1] = out[j * 2 + 1];
+    }
+    i += len;
+    block_pos += len;
+    if (block_pos == block) {
+      processBlock();
+      block_pos = 0;
+    }
+  }
+}
+
+void Convolver::processBlock()
+{
+  const int input_slot = (int)(block_num % input_slots);
+  for (int c = 0; c < 2; ++c) {
+    float *re = spectrum(input_spectra, input_slot, c);
+    fft.forward(window[c].data(), re, re + block);
+    // overlap with the next block
+    memcpy(window[c].data(), window[c].data() + block, block * sizeof(float));
+  }
+
+  const bool has_tail = parts > head_parts;
+  bool tail_ready_now = false;
+  // blocks before head_parts have no input old enough for a tail
+  if (has_tail && block_num >= head_parts) {
+    const int64_t ready =
+      tail_ready[block_num % tail_slots].load(std::memory_order_acquire);
+    tail_ready_now = ready == block_num;
+    if (!tail_ready_now) {
+      late_blocks.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  const int tail_slot = (int)(block_num % tail_slots);
+  for (int c = 0; c < 2; ++c) {
+    float *out = sum.data() + c * 2 * block;
+    if (tail_ready_now) {
+      memcpy(out, spectrum(tail_sums, tail_slot, c),
+             2 * block * sizeof(float));
+    } else {
+      memset(out, 0, 2 * block * sizeof(float));
+    }
+    sumPartitions(out, c, block_num, 0, head_parts);
+    fft.inverse(out, out + block, time_buf.data());
+    // first half wrapped around, so only the second is valid
+    for (int j = 0; j < block; ++j) {
+      output[j * 2 + c] = time_buf[block + j];
+    }
+  }
+
+  if (has_tail) {
+    // this block's input is the newest the tail head_parts blocks later
+    // uses
+    posted.store(block_num + head_parts, std::memory_order_release);
+    cond.notify_one();
+  }
+  ++block_num;
+}
+
+void Convolver::sumPartitions(float *out, int channel, int64_t num,
+                              int first_part, int last_part)
+{
+  float *out_im = out + block;
+  for (int p = first_part; p < last_part && p <= num; ++p) {
+    const int slot = (int)((num - p) % input_slots);
+    const float *x = spectrum(input_spectra, slot, channel);
+    const float *h = spectrum(ir_spectra, p, channel);
+    // bins 0 and block are real, and packed as bin 0
+    const float dc = out[0] + x[0] * h[0];
+    const float nyquist = out_im[0] + x[block] * h[block];
+    kernels.complex_mac(out, out_im, x, x + block, h, h + block, block);
+    out[0] = dc;
+    out_im[0] = nyquist;
+  }
+}
+
+void Convolver::sumTail(int64_t num)
+{
+  const int slot = (int)(num % tail_slots);
+  for (int c = 0; c < 2; ++c) {
+    float *out = spectrum(tail_sums, slot, c);
+    memset(out, 0, 2 * block * sizeof(float));
+    sumPartitions(out, c, num, head_parts, parts);
+  }
+  // Only publish if block num isn't output yet. Then the audio thread 
+  // hasn't reached the input slots summed, else the sum may be torn.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (posted.load(std::memory_order_relaxed) < num + head_parts) {
+    tail_ready[slot].store(num, std::memory_order_release);
+  }
+}
+
+void Convolver::threadMain()
+{
+  // same priority SDL gives its audio thread
+  SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+  const std::chrono::duration<float> wait_time(block_secs / 2);
+  int64_t next = head_parts; // first block with a tail
+
+  while (!quit.load(std::memory_order_relaxed)) {
+    const int64_t last = posted.load(std::memory_order_acquire);
+    if (next <= last) {
+      // skip tails of blocks already output without them
+      next = std::max(next, last - head_parts + 1);
+      sumTail(next);
+      ++next;
+    } else {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait_for(lock, wait_time, [&]() {
+        return quit.load(std::memory_order_relaxed) ||
+          posted.load(std::memory_order_acquire) >= next;
+      });
+    }
+  }
+}
+
+} // end namespace KameMix
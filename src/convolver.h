@@ -0,0 +1,105 @@
+#ifndef KAME_MIX_CONVOLVER_H
+#define KAME_MIX_CONVOLVER_H
+
+#include "KameMix.h"
+#include "audio_mem.h"
+#include "fft.h"
+#include "mix_kernels.h"
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace KameMix {
+
+/*
+Stereo convolution with an impulse response, for KameMix_Reverb. Uses
+uniformly partitioned overlap-save: the impulse response is cut into
+partitions of block_frames, kept as spectra, and each block of input is
+transformed once and kept in a delay line of spectra. A block of output is
+the sum of each input spectrum times the partition as old as it, so cost
+grows with the number of partitions, not their length squared. Output is
+delayed by block_frames.
+
+The first HEAD_PARTITIONS partitions are summed by process. The rest, the
+tail, only use input at least that many blocks old, so a background thread
+sums them for a later block while the caller does other work. If the
+thread doesn't finish a block's tail in time, that block has no tail, and
+is counted by lateBlocks.
+*/
+class Convolver {
+public:
+  static const int HEAD_PARTITIONS = 4;
+
+  // ir is frames of samples with 1 or 2 interleaved channels. A mono ir is
+  // used for both output channels. block_frames must be a power of 2.
+  // block_secs is the time a block plays for, to wake the tail thread if
+  // a wakeup is missed. Without tail_thread, process sums every partition.
+  Convolver(const float *ir, int frames, int channels, int block_frames,
+            float block_secs, bool tail_thread, const MixKernels &kernels);
+  ~Convolver();
+
+  // Replaces frames stereo sample frames in buf with their convolution.
+  void process(float *buf, int frames);
+  // Number of blocks output without their tail.
+  unsigned lateBlocks() const
+  {
+    return late_blocks.load(std::memory_order_relaxed);
+  }
+
+private:
+  Convolver(const Convolver &other) = delete;
+  Convolver& operator=(const Convolver &other) = delete;
+
+  typedef std::vector<float, Alloc<float>> FloatBuf;
+
+  // Returns real part of channel's spectrum in slot of buf, with the
+  // imaginary part following it.
+  float* spectrum(FloatBuf &buf, int slot, int channel)
+  {
+    return buf.data() + (slot * 2 + channel) * 2 * block;
+  }
+  // Transforms a block of input, sums partitions, and transforms output.
+  void processBlock();
+  // Adds each input spectrum times its partition from first_part to
+  // last_part - 1 to out, for output block num.
+  void sumPartitions(float *out, int channel, int64_t num, int first_part,
+                     int last_part);
+  // Sums tail of output block num into tail_sums, and marks it ready if 
+  // block num isn't output yet.
+  void sumTail(int64_t num);
+  void threadMain();
+
+  const MixKernels &kernels;
+  RealFft fft;
+  int block; // frames per partition, and spectrum bins
+  int parts; // partitions of the impulse response
+  int head_parts; // summed by process
+  int input_slots; // spectra of input blocks kept
+  int tail_slots; // tail sums ready or being summed
+  FloatBuf ir_spectra; // [partition][channel]
+  FloatBuf input_spectra; // [block % input_slots][channel]
+  FloatBuf tail_sums; // [block % tail_slots][channel]
+  std::vector<std::atomic<int64_t>, Alloc<std::atomic<int64_t>>> tail_ready;
+  FloatBuf window[2]; // last 2 blocks of input
+  FloatBuf output; // stereo frames of last block
+  FloatBuf sum; // [channel] spectrum
+  FloatBuf time_buf; // inverse FFT of sum
+  int block_pos; // frames into current block
+  int64_t block_num; // blocks processed
+  std::atomic<unsigned> late_blocks;
+
+  // tail thread
+  float block_secs;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::atomic<bool> quit;
+  std::atomic<int64_t> posted; // last block with a tail to sum
+  std::thread thread;
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,219 @@
+#define _FILE_OFFSET_BITS 64 // for fseeko
+
+#include "data_source.h"
+#include "audio_mem.h"
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+namespace {
+
+inline
+int64_t fseekWrapper(FILE *file, int64_t offset, int origin)
+{
+#ifdef _WIN32
+  return _fseeki64(file, offset, origin);
+#else
+  return fseeko(file, offset, origin);
+#endif
+}
+
+inline
+int64_t ftellWrapper(FILE *file)
+{
+#ifdef _WIN32
+  return _ftelli64(file);
+#else
+  return ftello(file);
+#endif
+}
+
+size_t fileRead(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+  FILE *file = (FILE*)userdata;
+  size_t num_read = fread(ptr, size, nmemb, file);
+  if (num_read < nmemb) {
+    clearerr(file); // clear eof or error, so next read can be tried
+  }
+  return num_read;
+}
+
+int fileSeek(void *userdata, int64_t offset, int whence)
+{
+  FILE *file = (FILE*)userdata;
+  if (fseekWrapper(file, offset, whence) != 0) {
+    clearerr(file);
+    return -1;
+  }
+  return 0;
+}
+
+int64_t fileTell(void *userdata)
+{
+  return ftellWrapper((FILE*)userdata);
+}
+
+int fileClose(void *userdata)
+{
+  return fclose((FILE*)userdata);
+}
+
+struct MemFile {
+  const uint8_t *data;
+  int64_t len;
+  int64_t pos;
+};
+
+size_t memRead(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+  MemFile *mf = (MemFile*)userdata;
+  if (size == 0 || mf->pos >= mf->len) {
+    return 0;
+  }
+  size_t num_left = (size_t)(mf->len - mf->pos) / size;
+  size_t num_read = nmemb < num_left ? nmemb : num_left;
+  memcpy(ptr, mf->data + mf->pos, num_read * size);
+  mf->pos += num_read * size;
+  return num_read;
+}
+
+int memSeek(void *userdata, int64_t offset, int whence)
+{
+  MemFile *mf = (MemFile*)userdata;
+  int64_t pos;
+  switch (whence) {
+  case SEEK_SET:
+    pos = offset;
+    break;
+  case SEEK_CUR:
+    pos = mf->pos + offset;
+    break;
+  case SEEK_END:
+    pos = mf->len + offset;
+    break;
+  default:
+    return -1;
+  }
+
+  if (pos < 0 || pos > mf->len) {
+    return -1;
+  }
+  mf->pos = pos;
+  return 0;
+}
+
+int64_t memTell(void *userdata)
+{
+  return ((MemFile*)userdata)->pos;
+}
+
+int memClose(void *userdata)
+{
+  KameMix::km_free(userdata);
+  return 0;
+}
+
+} // end anon namespace
+
+namespace KameMix {
+
+bool openFileSource(DataSource &src, const char *filename)
+{
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+    return false;
+  }
+
+  src.io.read = fileRead;
+  src.io.seek = fileSeek;
+  src.io.tell = fileTell;
+  src.io.close = fileClose;
+  src.userdata = file;
+  return true;
+}
+
+bool openMemSource(DataSource &src, const void *data, size_t len)
+{
+  MemFile *mf = (MemFile*)km_malloc_(sizeof(MemFile));
+  if (!mf) {
+    return false;
+  }
+  mf->data = (const uint8_t*)data;
+  mf->len = (int64_t)len;
+  mf->pos = 0;
+
+  src.io.read = memRead;
+  src.io.seek = memSeek;
+  src.io.tell = memTell;
+  src.io.close = memClose;
+  src.userdata = mf;
+  return true;
+}
+
+void openUserSource(DataSource &src, const KameMix_IO &io, void *userdata)
+{
+  src.io = io;
+  src.userdata = userdata;
+}
+
+void closeSource(DataSource &src)
+{
+  if (src.io.close) {
+    src.io.close(src.userdata);
+  }
+  src.userdata = nullptr;
+}
+
+AudioFileType fileTypeFromName(const char *filename)
+{
+  int dot_idx = -1;
+  int size = 0;
+  const char *iter = filename;
+
+  while (*iter != '\0') {
+    if (*iter == '.') {
+      dot_idx = (int)(iter - filename);
+    }
+    ++iter;
+    ++size;
+  }
+
+  // (size - dot_idx - 1) is num chars past last dot
+  if (dot_idx == -1 || (size - dot_idx - 1) != 3 ){
+    return UnknownFileType;
+  }
+
+  iter = filename + dot_idx + 1; // 1 past last dot
+  char prefix[4];
+  prefix[0] = (char)tolower(iter[0]);
+  prefix[1] = (char)tolower(iter[1]);
+  prefix[2] = (char)tolower(iter[2]);
+  prefix[3] = '\0';
+
+  if (strcmp(prefix, "ogg") == 0) {
+    return OggFileType;
+  } else if (strcmp(prefix, "wav") == 0) {
+    return WavFileType;
+  }
+
+  return UnknownFileType;
+}
+
+AudioFileType fileTypeFromData(DataSource &src)
+{
+  char magic[4];
+  size_t num_read = readSource(src, magic, 1, 4);
+  if (seekSource(src, 0, SEEK_SET) != 0 || num_read != 4) {
+    return UnknownFileType;
+  }
+
+  if (memcmp(magic, "OggS", 4) == 0) {
+    return OggFileType;
+  } else if (memcmp(magic, "RIFF", 4) == 0) {
+    return WavFileType;
+  }
+
+  return UnknownFileType;
+}
+
+} // end namespace KameMix
@@ -0,0 +1,64 @@
+#ifndef KAME_MIX_DATA_SOURCE_H
+#define KAME_MIX_DATA_SOURCE_H
+
+#include "KameMix.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace KameMix {
+
+enum AudioFileType {
+  OggFileType,
+  WavFileType,
+  UnknownFileType
+};
+
+// Audio file data read through KameMix_IO callbacks. Used by the WAV and
+// OGG loaders, so sounds and streams can be loaded from a file, memory, or
+// user defined callbacks.
+struct DataSource {
+  KameMix_IO io;
+  void *userdata;
+};
+
+// Opens filename with stdio. Returns false on error.
+bool openFileSource(DataSource &src, const char *filename);
+
+// Reads from data without copying it, so data must stay valid until
+// closeSource is called. Returns false on error.
+bool openMemSource(DataSource &src, const void *data, size_t len);
+
+// io.read, io.seek, and io.tell must not be NULL. io.close may be NULL.
+void openUserSource(DataSource &src, const KameMix_IO &io, void *userdata);
+
+// Calls io.close if set. src must not be used after this.
+void closeSource(DataSource &src);
+
+inline
+size_t readSource(DataSource &src, void *ptr, size_t size, size_t nmemb)
+{
+  return src.io.read(ptr, size, nmemb, src.userdata);
+}
+
+// Returns 0 on success, like fseek.
+inline
+int seekSource(DataSource &src, int64_t offset, int whence)
+{
+  return src.io.seek(src.userdata, offset, whence);
+}
+
+inline
+int64_t tellSource(DataSource &src)
+{
+  return src.io.tell(src.userdata);
+}
+
+// Returns type of file from its extension, ignoring case.
+AudioFileType fileTypeFromName(const char *filename);
+
+// Returns type of file from its header. src is seeked back to start after.
+AudioFileType fileTypeFromData(DataSource &src);
+
+} // end namespace KameMix
+
+#endif
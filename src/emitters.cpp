@@ -0,0 +1,256 @@
+#include "emitters.h"
+#include "sound_handle.h"
+#include <cmath>
+#include <cassert>
+
+namespace {
+
+// Playing emitters are demoted a bit past max_distance, so ones at the
+// edge of range don't restart each update. They're silent there anyway.
+const float DEMOTE_DISTANCE = 1.1f;
+
+float distanceSq(float x1, float y1, float x2, float y2)
+{
+  const float dx = x2 - x1;
+  const float dy = y2 - y1;
+  return dx * dx + dy * dy;
+}
+
+uint64_t packCell(int cx, int cy)
+{
+  return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+}
+
+// Returns length of sound in seconds, or 0.0 if unknown, as for compressed
+// Sounds which are decoded while playing.
+double soundLength(KameMix_Sound *sound)
+{
+  KameMix::SoundBuffer &buffer = sound->buffer;
+  if (!sound->isResident() || buffer.isCompressed() || buffer.rate() == 0) {
+    return 0.0;
+  }
+  if (buffer.isADPCM()) {
+    return (double)buffer.numADPCMFrames() / buffer.rate();
+  }
+  return (double)(buffer.size() / buffer.sampleBlockSize()) / buffer.rate();
+}
+
+} // end anon namespace
+
+namespace KameMix {
+
+Emitters::Emitters() : cell_size{0.0f} { }
+
+Emitters::~Emitters()
+{
+  for (Emitter &emitter : emitters) {
+    if (emitter.sound) {
+      KameMix_halt(emitter.channel);
+      KameMix_freeSound(emitter.sound);
+    }
+  }
+}
+
+int Emitters::cellCoord(float pos) const
+{
+  return (int)std::floor(pos / cell_size);
+}
+
+uint64_t Emitters::cellKey(float x, float y) const
+{
+  return packCell(cellCoord(x), cellCoord(y));
+}
+
+int Emitters::add(KameMix_Sound *sound, float x, float y, float max_distance,
+                  float volume, int group)
+{
+  if (!sound || !(max_distance > 0.0f)) {
+    return -1;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  int idx;
+  if (!free_list.empty()) {
+    idx = free_list.back();
+    free_list.pop_back();
+  } else {
+    idx = (int)emitters.size();
+    emitters.push_back(Emitter());
+  }
+
+  KameMix_incSoundRef(sound);
+  Emitter &emitter = emitters[idx];
+  emitter.sound = sound;
+  emitter.x = x;
+  emitter.y = y;
+  emitter.max_distance = max_distance;
+  emitter.volume = volume;
+  emitter.group = group;
+  emitter.start_clock = KameMix_getClock();
+  KameMix_unsetChannel(emitter.channel);
+
+  if (max_distance > cell_size) {
+    // cells must be at least max_distance, so emitters in range of the
+    // listener are always in the cells around it
+    rebuild_locked(max_distance);
+  } else {
+    insert_locked(idx);
+  }
+  return idx;
+}
+
+void Emitters::remove(int emitter)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  assert(emitter >= 0 && emitter < (int)emitters.size());
+  Emitter &e = emitters[emitter];
+  assert(e.sound && "emitter was already removed");
+  demote_locked(e);
+  erase_locked(emitter);
+  KameMix_freeSound(e.sound);
+  e.sound = nullptr;
+  free_list.push_back(emitter);
+}
+
+void Emitters::setPos(int emitter, float x, float y)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  assert(emitter >= 0 && emitter < (int)emitters.size());
+  Emitter &e = emitters[emitter];
+  e.x = x;
+  e.y = y;
+  if (cellKey(x, y) != e.cell) {
+    erase_locked(emitter);
+    insert_locked(emitter);
+  }
+  if (KameMix_isChannelSet(e.channel)) {
+    KameMix_setPos(e.channel, x, y);
+  }
+}
+
+void Emitters::setVolume(int emitter, float volume)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  assert(emitter >= 0 && emitter < (int)emitters.size());
+  Emitter &e = emitters[emitter];
+  e.volume = volume;
+  if (KameMix_isChannelSet(e.channel)) {
+    KameMix_setVolume(e.channel, volume);
+  }
+}
+
+int Emitters::update(float listener_x, float listener_y)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (size_t i = 0; i < playing.size(); ) {
+    Emitter &e = emitters[playing[i]];
+    const float demote_distance = e.max_distance * DEMOTE_DISTANCE;
+    // voices ended by a voice limit or stopping all channels are demoted
+    // too, so they're promoted again if in range
+    if (distanceSq(e.x, e.y, listener_x, listener_y) >
+        demote_distance * demote_distance || 
+        KameMix_isFinished(e.channel)) {
+      demote_locked(e); // swaps last into i
+    } else {
+      ++i;
+    }
+  }
+
+  if (cell_size == 0.0f) {
+    return (int)playing.size(); // none added
+  }
+
+  const int cx = cellCoord(listener_x);
+  const int cy = cellCoord(listener_y);
+  for (int y = cy - 1; y <= cy + 1; ++y) {
+    for (int x = cx - 1; x <= cx + 1; ++x) {
+      Grid::iterator it = grid.find(packCell(x, y));
+      if (it == grid.end()) {
+        continue;
+      }
+      for (int idx : it->second) {
+        Emitter &e = emitters[idx];
+        if (!KameMix_isChannelSet(e.channel) &&
+            distanceSq(e.x, e.y, listener_x, listener_y) <=
+            e.max_distance * e.max_distance) {
+          promote_locked(idx);
+        }
+      }
+    }
+  }
+  return (int)playing.size();
+}
+
+void Emitters::insert_locked(int idx)
+{
+  Emitter &emitter = emitters[idx];
+  emitter.cell = cellKey(emitter.x, emitter.y);
+  grid[emitter.cell].push_back(idx);
+}
+
+void Emitters::erase_locked(int idx)
+{
+  Grid::iterator it = grid.find(emitters[idx].cell);
+  assert(it != grid.end());
+  IndexList &cell = it->second;
+  for (size_t i = 0; i < cell.size(); ++i) {
+    if (cell[i] == idx) {
+      cell[i] = cell.back();
+      cell.pop_back();
+      break;
+    }
+  }
+  if (cell.empty()) {
+    grid.erase(it);
+  }
+}
+
+void Emitters::rebuild_locked(float new_cell_size)
+{
+  cell_size = new_cell_size;
+  grid.clear();
+  for (int i = 0; i < (int)emitters.size(); ++i) {
+    if (emitters[i].sound) {
+      insert_locked(i);
+    }
+  }
+}
+
+void Emitters::promote_locked(int idx)
+{
+  Emitter &e = emitters[idx];
+  // start at the emitter's loop phase, as if it had been playing since
+  // added
+  double start_sec = 0.0;
+  const double length = soundLength(e.sound);
+  if (length > 0.0) {
+    const double elapsed = (double)(KameMix_getClock() - e.start_clock) /
+      KameMix_getFrequency();
+    start_sec = std::fmod(elapsed, length);
+  }
+  e.channel = playEmitterSound(e.sound, e.channel, start_sec, e.volume, 
+                               e.x, e.y, e.max_distance, e.group);
+  // unset if out of voices, so tried again next update
+  if (KameMix_isChannelSet(e.channel)) {
+    playing.push_back(idx);
+  }
+}
+
+void Emitters::demote_locked(Emitter &emitter)
+{
+  if (!KameMix_isChannelSet(emitter.channel)) {
+    return;
+  }
+  const int idx = (int)(&emitter - emitters.data());
+  for (size_t i = 0; i < playing.size(); ++i) {
+    if (playing[i] == idx) {
+      playing[i] = playing.back();
+      playing.pop_back();
+      break;
+    }
+  }
+  KameMix_stop(emitter.channel);
+  KameMix_unsetChannel(emitter.channel);
+}
+
+} // end namespace KameMix
@@ -0,0 +1,87 @@
+#ifndef KAME_MIX_EMITTERS_H
+#define KAME_MIX_EMITTERS_H
+
+#include "KameMix.h"
+#include "audio_mem.h"
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+namespace KameMix {
+
+// Plays sound looping forever like KameMix_playSound, except events aren't 
+// sent about the channel, since the app didn't play it. Defined in 
+// KameMix.cpp.
+KameMix_Channel playEmitterSound(KameMix_Sound *sound, KameMix_Channel c, 
+                                 double start_sec, float vol, float x, 
+                                 float y, float max_distance, int group);
+
+/*
+Emitters from KameMix_addEmitter: Sounds looping forever at a position,
+which only play on a voice while the listener is within their max
+distance. They're kept in a spatial hash grid with cells as large as the
+largest max distance, so update only looks at emitters in the 3x3 cells
+around the listener, and the ones already playing. The rest cost nothing.
+
+Emitters keep their loop phase from the mixer clock while not playing, so
+when promoted again they start where they would be if they had kept
+playing.
+*/
+class Emitters {
+public:
+  Emitters();
+  // Stops playing emitters, and frees their Sounds.
+  ~Emitters();
+
+  // Returns id of the new emitter, or -1 if sound is NULL or max_distance
+  // isn't greater than 0.
+  int add(KameMix_Sound *sound, float x, float y, float max_distance,
+          float volume, int group);
+  void remove(int emitter);
+  void setPos(int emitter, float x, float y);
+  void setVolume(int emitter, float volume);
+  // Promotes emitters in range of the listener to voices, and demotes
+  // playing ones out of range. Returns number playing.
+  int update(float listener_x, float listener_y);
+
+private:
+  Emitters(const Emitters &other) = delete;
+  Emitters& operator=(const Emitters &other) = delete;
+
+  struct Emitter {
+    KameMix_Sound *sound; // nullptr if removed
+    float x, y;
+    float max_distance;
+    float volume;
+    int group;
+    uint64_t start_clock; // mixer clock when added, for loop phase
+    uint64_t cell; // key in grid
+    KameMix_Channel channel; // set while promoted
+  };
+
+  typedef std::vector<int, Alloc<int>> IndexList;
+  typedef std::unordered_map<uint64_t, IndexList, std::hash<uint64_t>,
+                             std::equal_to<uint64_t>,
+                             Alloc<std::pair<const uint64_t, IndexList>>>
+    Grid;
+
+  int cellCoord(float pos) const;
+  uint64_t cellKey(float x, float y) const;
+  void insert_locked(int idx);
+  void erase_locked(int idx);
+  void rebuild_locked(float new_cell_size);
+  void promote_locked(int idx);
+  void demote_locked(Emitter &emitter);
+
+  std::vector<Emitter, Alloc<Emitter>> emitters;
+  IndexList free_list; // removed emitters to reuse
+  IndexList playing; // promoted emitters
+  Grid grid;
+  float cell_size; // largest max_distance, 0.0f until one is added
+  std::mutex mutex;
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,79 @@
+#include "event_queue.h"
+#include "audio_mem.h"
+
+namespace KameMix {
+
+EventQueue::EventQueue(int capacity)
+  : push_pos{0},
+    pop_pos{0},
+    dropped_{0}
+{
+  size_t cap = 2;
+  while (cap < (size_t)capacity) {
+    cap *= 2;
+  }
+  mask = cap - 1;
+  cells = (Cell*)km_malloc(sizeof(Cell) * cap);
+  for (size_t i = 0; i < cap; ++i) {
+    new (&cells[i]) Cell;
+    cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+}
+
+EventQueue::~EventQueue()
+{
+  km_delete_n(cells, (int)(mask + 1));
+}
+
+bool EventQueue::push(const KameMix_Event &event)
+{
+  size_t pos = push_pos.load(std::memory_order_relaxed);
+  while (true) {
+    Cell &cell = cells[pos & mask];
+    const size_t seq = cell.seq.load(std::memory_order_acquire);
+    const ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+    if (diff == 0) {
+      // cell is free, so claim it, or retry at the new pos if another
+      // thread did first
+      if (push_pos.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+        cell.event = event;
+        cell.seq.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // not popped since a lap ago
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = push_pos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+int EventQueue::pop(KameMix_Event *events, int max_events)
+{
+  int num = 0;
+  size_t pos = pop_pos.load(std::memory_order_relaxed);
+  while (num < max_events) {
+    Cell &cell = cells[pos & mask];
+    const size_t seq = cell.seq.load(std::memory_order_acquire);
+    const ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+    if (diff == 0) {
+      if (pop_pos.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+        events[num++] = cell.event;
+        // free for the push a lap later
+        cell.seq.store(pos + mask + 1, std::memory_order_release);
+        pos += 1;
+      }
+    } else if (diff < 0) {
+      break; // empty, or next push isn't finished
+    } else {
+      pos = pop_pos.load(std::memory_order_relaxed);
+    }
+  }
+  return num;
+}
+
+} // end namespace KameMix
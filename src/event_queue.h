@@ -0,0 +1,49 @@
+#ifndef KAME_MIX_EVENT_QUEUE_H
+#define KAME_MIX_EVENT_QUEUE_H
+
+#include "KameMix.h"
+#include <cstddef>
+#include <atomic>
+
+namespace KameMix {
+
+/*
+Bounded queue of KameMix_Events, pushed by the audio thread, mix workers
+and API threads, and popped by KameMix_pollEvents. Each cell has a sequence
+number telling whether it's ready to be written or read, so pushing and
+popping never lock and the audio thread never waits. Events pushed while
+the queue is full are dropped and counted.
+*/
+class EventQueue {
+public:
+  // capacity is rounded up to a power of 2.
+  explicit EventQueue(int capacity);
+  ~EventQueue();
+
+  // Returns false if the queue was full, and the event was dropped.
+  bool push(const KameMix_Event &event);
+  // Pops up to max_events to events. Returns number popped.
+  int pop(KameMix_Event *events, int max_events);
+  // Number of events dropped since created.
+  unsigned dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  EventQueue(const EventQueue &other) = delete;
+  EventQueue& operator=(const EventQueue &other) = delete;
+
+  struct Cell {
+    // equal to position when ready to write, position + 1 when ready to read
+    std::atomic<size_t> seq;
+    KameMix_Event event;
+  };
+
+  Cell *cells;
+  size_t mask; // capacity - 1
+  std::atomic<size_t> push_pos;
+  std::atomic<size_t> pop_pos;
+  std::atomic<unsigned> dropped_;
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,118 @@
+#include "fft.h"
+#include <cmath>
+#include <cassert>
+#include <utility>
+
+namespace KameMix {
+
+RealFft::RealFft(int size)
+  : n{size},
+    half{size / 2},
+    bitrev(size / 2),
+    cos_table(size / 2),
+    sin_table(size / 2),
+    work_re(size / 2),
+    work_im(size / 2)
+{
+  assert(size >= 4 && (size & (size - 1)) == 0 && "size must be power of 2");
+  const double pi = 3.14159265358979323846;
+  for (int k = 0; k < half; ++k) {
+    const double angle = -2.0 * pi * k / n;
+    cos_table[k] = (float)std::cos(angle);
+    sin_table[k] = (float)std::sin(angle);
+  }
+
+  int bits = 0;
+  while ((1 << bits) < half) {
+    ++bits;
+  }
+  for (int i = 0; i < half; ++i) {
+    int rev = 0;
+    for (int b = 0; b < bits; ++b) {
+      rev |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    bitrev[i] = rev;
+  }
+}
+
+void RealFft::forward(const float *src, float *re, float *im)
+{
+  for (int m = 0; m < half; ++m) {
+    work_re[m] = src[2*m];
+    work_im[m] = src[2*m + 1];
+  }
+  complexFft(false);
+
+  re[0] = work_re[0] + work_im[0];
+  im[0] = work_re[0] - work_im[0]; // bin size/2
+  for (int k = 1; k < half; ++k) {
+    // split into spectra of the even (e) and odd (o) samples, and combine
+    const float ar = work_re[k], ai = work_im[k];
+    const float br = work_re[half - k], bi = work_im[half - k];
+    const float er = (ar + br) * 0.5f, ei = (ai - bi) * 0.5f;
+    const float or_ = (ai + bi) * 0.5f, oi = (br - ar) * 0.5f;
+    const float wr = cos_table[k], wi = sin_table[k];
+    re[k] = er + wr * or_ - wi * oi;
+    im[k] = ei + wr * oi + wi * or_;
+  }
+}
+
+void RealFft::inverse(const float *re, const float *im, float *dst)
+{
+  // bin size/2 is in im[0]
+  work_re[0] = re[0] + im[0];
+  work_im[0] = re[0] - im[0];
+  for (int k = 1; k < half; ++k) {
+    const float ar = re[k], ai = im[k];
+    const float br = re[half - k], bi = im[half - k];
+    const float er = ar + br, ei = ai - bi;
+    const float dr = ar - br, di = ai + bi;
+    const float wr = cos_table[k], wi = sin_table[k];
+    // odd spectrum is difference times conjugate of twiddle
+    const float or_ = dr * wr + di * wi, oi = di * wr - dr * wi;
+    work_re[k] = er - oi;
+    work_im[k] = ei + or_;
+  }
+  complexFft(true);
+
+  for (int m = 0; m < half; ++m) {
+    dst[2*m] = work_re[m];
+    dst[2*m + 1] = work_im[m];
+  }
+}
+
+void RealFft::complexFft(bool inverse)
+{
+  float *re = work_re.data();
+  float *im = work_im.data();
+  for (int i = 0; i < half; ++i) {
+    const int j = bitrev[i];
+    if (i < j) {
+      std::swap(re[i], re[j]);
+      std::swap(im[i], im[j]);
+    }
+  }
+
+  // twiddles of the half size FFT are every other one of the real size
+  const float sign = inverse ? -1.0f : 1.0f;
+  for (int len = 2; len <= half; len *= 2) {
+    const int step = 2 * (half / len);
+    const int mid = len / 2;
+    for (int i = 0; i < half; i += len) {
+      for (int j = 0; j < mid; ++j) {
+        const float wr = cos_table[j * step];
+        const float wi = sin_table[j * step] * sign;
+        const int a = i + j;
+        const int b = a + mid;
+        const float vr = re[b] * wr - im[b] * wi;
+        const float vi = re[b] * wi + im[b] * wr;
+        re[b] = re[a] - vr;
+        im[b] = im[a] - vi;
+        re[a] += vr;
+        im[a] += vi;
+      }
+    }
+  }
+}
+
+} // end namespace KameMix
@@ -0,0 +1,47 @@
+#ifndef KAME_MIX_FFT_H
+#define KAME_MIX_FFT_H
+
+#include "audio_mem.h"
+#include <vector>
+
+namespace KameMix {
+
+/*
+FFT of real signals, done as a complex FFT of half the size on the even and
+odd samples packed as real and imaginary parts, then split into the real
+signal's spectrum. Spectra are in separate real and imaginary arrays of
+size/2 bins, so the Convolver can multiply them with SIMD. Bins 0 and
+size/2 are both real, so bin size/2 is packed into im[0].
+
+Not thread safe, since it uses its own work buffers.
+*/
+class RealFft {
+public:
+  // size must be a power of 2, and at least 4.
+  explicit RealFft(int size);
+
+  int size() const { return n; }
+  // Transforms size samples in src to size/2 bins in re and im.
+  void forward(const float *src, float *re, float *im);
+  // Inverse of forward, without dividing by size, so forward then inverse
+  // multiplies dst by size.
+  void inverse(const float *re, const float *im, float *dst);
+
+private:
+  typedef std::vector<float, Alloc<float>> FloatBuf;
+
+  // In place complex FFT of size/2 points in work_re and work_im.
+  void complexFft(bool inverse);
+
+  int n; // real size
+  int half; // complex size
+  std::vector<int, Alloc<int>> bitrev; // permutation of half points
+  FloatBuf cos_table; // e^(-2*pi*i*k/size) for k < size/2
+  FloatBuf sin_table;
+  FloatBuf work_re;
+  FloatBuf work_im;
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,173 @@
+#include "mem_pool.h"
+#include "audio_mem.h"
+
+namespace {
+
+// Size of slabs for small size classes
+const size_t SLAB_SIZE = 32 * 1024;
+// Fewest blocks in a slab of a small size class
+const int MIN_SLAB_BLOCKS = 4;
+
+} // end anon namespace
+
+namespace KameMix {
+
+MemPool::MemPool(size_t large_size)
+{
+  size_t block_size = MIN_BLOCK_SIZE;
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    SizeClass &sc = classes[i];
+    if (i < NUM_SMALL_CLASSES) {
+      sc.block_size = block_size;
+      const int slab_blocks = (int)(SLAB_SIZE / block_size);
+      sc.blocks_per_slab =
+        slab_blocks > MIN_SLAB_BLOCKS ? slab_blocks : MIN_SLAB_BLOCKS;
+      block_size *= 2;
+    } else {
+      // keep blocks max aligned
+      const size_t align = sizeof(SlabHeader);
+      sc.block_size = (large_size + align - 1) / align * align;
+      sc.blocks_per_slab = 1;
+    }
+    sc.free_list = nullptr;
+    sc.slabs = nullptr;
+    sc.blocks_total = 0;
+    sc.blocks_used = 0;
+    sc.peak_used = 0;
+    sc.allocs = 0;
+    sc.slab_allocs = 0;
+  }
+}
+
+MemPool::~MemPool()
+{
+  for (SizeClass &sc : classes) {
+    SlabHeader *slab = sc.slabs;
+    while (slab) {
+      SlabHeader *next = slab->next;
+      km_free(slab);
+      slab = next;
+    }
+  }
+}
+
+int MemPool::classIndex(size_t len) const
+{
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    if (len <= classes[i].block_size) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool MemPool::addSlab_locked(SizeClass &sc, int num_blocks)
+{
+  uint8_t *slab =
+    (uint8_t*)km_malloc_(sizeof(SlabHeader) + sc.block_size * num_blocks);
+  if (!slab) {
+    return false;
+  }
+
+  SlabHeader *header = (SlabHeader*)slab;
+  header->next = sc.slabs;
+  sc.slabs = header;
+
+  uint8_t *block = slab + sizeof(SlabHeader);
+  for (int i = 0; i < num_blocks; ++i, block += sc.block_size) {
+    FreeBlock *free_block = (FreeBlock*)block;
+    free_block->next = sc.free_list;
+    sc.free_list = free_block;
+  }
+  sc.blocks_total += num_blocks;
+  sc.slab_allocs += 1;
+  return true;
+}
+
+void* MemPool::alloc(size_t len)
+{
+  const int idx = classIndex(len);
+  if (idx == -1) {
+    return km_malloc_(len);
+  }
+
+  SizeClass &sc = classes[idx];
+  rtLock(sc.mutex); // reports waiting in audio thread
+  std::lock_guard<std::mutex> lock(sc.mutex, std::adopt_lock);
+  if (!sc.free_list && !addSlab_locked(sc, sc.blocks_per_slab)) {
+    return nullptr;
+  }
+
+  FreeBlock *block = sc.free_list;
+  sc.free_list = block->next;
+  sc.blocks_used += 1;
+  if (sc.blocks_used > sc.peak_used) {
+    sc.peak_used = sc.blocks_used;
+  }
+  sc.allocs += 1;
+  return block;
+}
+
+void MemPool::free(void *ptr, size_t len)
+{
+  if (!ptr) {
+    return;
+  }
+  const int idx = classIndex(len);
+  if (idx == -1) {
+    km_free(ptr);
+    return;
+  }
+
+  SizeClass &sc = classes[idx];
+  rtLock(sc.mutex); // reports waiting in audio thread
+  std::lock_guard<std::mutex> lock(sc.mutex, std::adopt_lock);
+  FreeBlock *block = (FreeBlock*)ptr;
+  block->next = sc.free_list;
+  sc.free_list = block;
+  sc.blocks_used -= 1;
+}
+
+bool MemPool::reserve(size_t len, int count)
+{
+  const int idx = classIndex(len);
+  if (idx == -1) {
+    return false;
+  }
+
+  SizeClass &sc = classes[idx];
+  std::lock_guard<std::mutex> lock(sc.mutex);
+  const int blocks_free = sc.blocks_total - sc.blocks_used;
+  if (count <= blocks_free) {
+    return true;
+  }
+  // large blocks are kept in separate slabs, so they can be any count
+  const int needed = count - blocks_free;
+  if (sc.blocks_per_slab == 1) {
+    for (int i = 0; i < needed; ++i) {
+      if (!addSlab_locked(sc, 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return addSlab_locked(sc, needed > sc.blocks_per_slab ?
+                        needed : sc.blocks_per_slab);
+}
+
+int MemPool::getStats(KameMix_PoolStats *stats, int max_classes)
+{
+  for (int i = 0; i < NUM_CLASSES && i < max_classes; ++i) {
+    SizeClass &sc = classes[i];
+    std::lock_guard<std::mutex> lock(sc.mutex);
+    stats[i].block_size = sc.block_size;
+    stats[i].blocks_total = sc.blocks_total;
+    stats[i].blocks_used = sc.blocks_used;
+    stats[i].peak_used = sc.peak_used;
+    stats[i].allocs = sc.allocs;
+    stats[i].slab_allocs = sc.slab_allocs;
+  }
+  return NUM_CLASSES;
+}
+
+} // end namespace KameMix
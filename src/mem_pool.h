@@ -0,0 +1,86 @@
+#ifndef KAME_MIX_MEM_POOL_H
+#define KAME_MIX_MEM_POOL_H
+
+#include "KameMix.h"
+#include <cstddef>
+#include <mutex>
+
+namespace KameMix {
+
+/*
+Pools of fixed size blocks for KameMix_Sounds, KameMix_Streams, decoders and
+stream buffers, used when enabled with KameMix_initEx. Blocks are carved
+out of slabs allocated with the user allocator, and freed blocks are kept
+for reuse instead of returned, so opening and closing Sounds and Streams
+doesn't fragment the heap. Slabs are only freed when the pool is destroyed.
+
+Small sizes are rounded up to a power of 2 size class. The largest class
+holds one stream buffer per slab. Each class has its own lock, so threads
+loading different kinds of objects don't wait on each other.
+*/
+class MemPool {
+public:
+  // Number of power of 2 size classes, from MIN_BLOCK_SIZE up
+  static const int NUM_SMALL_CLASSES = 8;
+  static const int NUM_CLASSES = NUM_SMALL_CLASSES + 1;
+  static const size_t MIN_BLOCK_SIZE = 64;
+
+  // large_size is the size of the largest class, for stream buffers.
+  explicit MemPool(size_t large_size);
+  ~MemPool();
+
+  // Returns block of at least len bytes, or nullptr on error. Sizes larger
+  // than the largest class are allocated with the user allocator.
+  void* alloc(size_t len);
+
+  // Returns ptr to its pool. len must be the size passed to alloc. ptr can
+  // be nullptr.
+  void free(void *ptr, size_t len);
+
+  // Adds blocks so count more of len bytes can be allocated without calling
+  // the user allocator. Returns false on error.
+  bool reserve(size_t len, int count);
+
+  // Fills up to max_classes stats, and returns number of size classes.
+  int getStats(KameMix_PoolStats *stats, int max_classes);
+
+private:
+  MemPool(const MemPool &other) = delete;
+  MemPool& operator=(const MemPool &other) = delete;
+
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  // Start of each slab, padded so blocks after it stay max aligned
+  union SlabHeader {
+    SlabHeader *next;
+    std::max_align_t align;
+  };
+
+  struct SizeClass {
+    std::mutex mutex;
+    size_t block_size;
+    int blocks_per_slab;
+    FreeBlock *free_list;
+    SlabHeader *slabs;
+    int blocks_total;
+    int blocks_used;
+    int peak_used;
+    unsigned allocs;
+    unsigned slab_allocs;
+  };
+
+  // Returns index of smallest class that fits len, or -1 if too large.
+  int classIndex(size_t len) const;
+
+  // Allocates a slab of num_blocks for sc, and adds them to its free list.
+  // sc.mutex must be locked.
+  bool addSlab_locked(SizeClass &sc, int num_blocks);
+
+  SizeClass classes[NUM_CLASSES];
+};
+
+} // end namespace KameMix
+
+#endif
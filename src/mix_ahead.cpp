@@ -0,0 +1,97 @@
+#include "mix_ahead.h"
+#include "audio_mem.h"
+#include "rt_check.h"
+#include <SDL.h>
+#include <cstring>
+#include <chrono>
+
+namespace KameMix {
+
+MixAhead::MixAhead(MixFunc mix_, int ring_len, int block_len_, 
+                   int frame_size_, float block_secs_)
+  : mix{mix_},
+    ring{ring_len},
+    block{(uint8_t*)km_malloc(block_len_)},
+    block_len{block_len_},
+    frame_size{frame_size_},
+    block_secs{block_secs_},
+    quit{false},
+    min_fill{ring_len},
+    underruns{0},
+    blocks_mixed{0}
+{
+  // started last, after everything it uses is set
+  thread = std::thread(&MixAhead::threadMain, this);
+}
+
+MixAhead::~MixAhead()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit.store(true, std::memory_order_relaxed);
+  }
+  cond.notify_one();
+  thread.join();
+  km_free(block);
+}
+
+void MixAhead::read(uint8_t *out, int len)
+{
+  const int copied = ring.read(out, len);
+  if (copied < len) {
+    memset(out + copied, 0, len - copied); // 0 is silence for all formats
+    underruns.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const int fill = ring.readAvailable();
+  if (fill < min_fill.load(std::memory_order_relaxed)) {
+    min_fill.store(fill, std::memory_order_relaxed);
+  }
+  cond.notify_one();
+}
+
+void MixAhead::getStats(KameMix_MixAheadStats &stats)
+{
+  stats.fill_frames = ring.readAvailable() / frame_size;
+  stats.min_fill_frames = 
+    min_fill.load(std::memory_order_relaxed) / frame_size;
+  stats.capacity_frames = ring.capacity() / frame_size;
+  stats.block_frames = block_len / frame_size;
+  stats.underruns = underruns.load(std::memory_order_relaxed);
+  stats.blocks_mixed = blocks_mixed.load(std::memory_order_relaxed);
+}
+
+void MixAhead::resetStats()
+{
+  min_fill.store(ring.readAvailable(), std::memory_order_relaxed);
+  underruns.store(0, std::memory_order_relaxed);
+  blocks_mixed.store(0, std::memory_order_relaxed);
+}
+
+void MixAhead::threadMain()
+{
+  // same priority SDL gives its audio thread
+  SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+  const std::chrono::duration<float> wait_time(block_secs / 2);
+
+  while (!quit.load(std::memory_order_relaxed)) {
+    if (ring.writeAvailable() >= block_len) {
+      {
+        // with KAMEMIX_RT_CHECK, reports unsafe calls, and enables flush 
+        // to zero
+        RtAudioScope rt_scope;
+        mix(block, block_len);
+      }
+      ring.write(block, block_len);
+      blocks_mixed.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait_for(lock, wait_time, [&]() {
+        return quit.load(std::memory_order_relaxed) || 
+          ring.writeAvailable() >= block_len;
+      });
+    }
+  }
+}
+
+} // end namespace KameMix
@@ -0,0 +1,65 @@
+#ifndef KAME_MIX_MIX_AHEAD_H
+#define KAME_MIX_MIX_AHEAD_H
+
+#include "KameMix.h"
+#include "audio_ring.h"
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace KameMix {
+
+/*
+Mixes audio ahead of the audio device on its own thread, enabled with 
+KameMix_InitOptions.mix_ahead_frames. The thread mixes small blocks into 
+an AudioRing whenever a whole block fits, and the audio callback only 
+copies from it. A small device buffer gives low latency, while the ring 
+covers blocks that occasionally take longer to mix than to play.
+
+The thread sleeps while the ring is full, and is woken by the callback 
+after reading, or after half a block's time if the wakeup is missed.
+*/
+class MixAhead {
+public:
+  // Mixes len bytes of output to out.
+  typedef void (*MixFunc)(uint8_t *out, int len);
+
+  // Starts thread that calls mix with block_len bytes at a time, up to 
+  // ring_len bytes ahead. block_secs is the time a block plays for.
+  MixAhead(MixFunc mix, int ring_len, int block_len, int frame_size, 
+           float block_secs);
+  ~MixAhead();
+
+  // Copies len bytes of mixed audio to out, and fills the rest with 
+  // silence if not enough was mixed. Called by the audio callback.
+  void read(uint8_t *out, int len);
+
+  void getStats(KameMix_MixAheadStats &stats);
+  void resetStats();
+
+private:
+  MixAhead(const MixAhead &other) = delete;
+  MixAhead& operator=(const MixAhead &other) = delete;
+
+  void threadMain();
+
+  MixFunc mix;
+  AudioRing ring;
+  uint8_t *block;
+  int block_len;
+  int frame_size;
+  float block_secs;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::atomic<bool> quit;
+  std::atomic<int> min_fill; // bytes
+  std::atomic<unsigned> underruns;
+  std::atomic<unsigned> blocks_mixed;
+  std::thread thread;
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,858 @@
+#include "mix_kernels.h"
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define KAMEMIX_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+// AVX-512 intrinsics need Visual Studio 2017 or later
+#if !defined(_MSC_VER) || _MSC_VER >= 1910
+#define KAMEMIX_AVX512
+#endif
+#endif
+
+// Compiles a function for an instruction set beyond the build's baseline,
+// so it can be picked at run time. MSVC allows any intrinsics without it.
+#if defined(__GNUC__) || defined(__clang__)
+#define KAMEMIX_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KAMEMIX_TARGET(isa)
+#endif
+
+namespace {
+
+using namespace KameMix;
+
+// Coefficients and state of up to 8 filtered voices, with a lane for each
+// channel, to load into vectors for filtering voices together.
+struct FilterLanes {
+  static const int MAX_LANES = 16;
+
+  void load(const FilterCoeffs *coeffs, const FilterState *state, int num)
+  {
+    for (int v = 0; v < num; ++v) {
+      for (int c = 0; c < 2; ++c) {
+        const int lane = v * 2 + c;
+        b0[lane] = coeffs[v].b0;
+        b1[lane] = coeffs[v].b1;
+        b2[lane] = coeffs[v].b2;
+        a1[lane] = coeffs[v].a1;
+        a2[lane] = coeffs[v].a2;
+        z1[lane] = state[v].z1[c];
+        z2[lane] = state[v].z2[c];
+      }
+    }
+  }
+
+  void save(FilterState *state, int num) const
+  {
+    for (int v = 0; v < num; ++v) {
+      for (int c = 0; c < 2; ++c) {
+        state[v].z1[c] = z1[v * 2 + c];
+        state[v].z2[c] = z2[v * 2 + c];
+      }
+    }
+  }
+
+  float b0[MAX_LANES], b1[MAX_LANES], b2[MAX_LANES];
+  float a1[MAX_LANES], a2[MAX_LANES];
+  float z1[MAX_LANES], z2[MAX_LANES];
+};
+
+// Catmull-Rom spline through y0 and y1 at t from 0 to 1, with ym1 and y2
+// the samples around them. Same as the vector versions for each 
+// instruction set.
+inline
+float cubic(float ym1, float y0, float y1, float y2, float t)
+{
+  const float c1 = 0.5f * (y1 - ym1);
+  const float c2 = ym1 - 2.5f * y0 + 2.0f * y1 - 0.5f * y2;
+  const float c3 = 0.5f * (y2 - ym1) + 1.5f * (y0 - y1);
+  return ((c3 * t + c2) * t + c1) * t + y0;
+}
+
+// Each instruction set has a struct of static functions used by mixVoice
+// and the kernel tables. len is always a number of float samples, and is
+// even since they're stereo.
+struct ScalarMix {
+  template <bool Positional>
+  static void mixGain(float *dst, const float *src, int len,
+                      float lgain, float rgain)
+  {
+    for (int i = 0; i < len; i += 2) {
+      dst[i] += src[i] * lgain;
+      dst[i+1] += src[i+1] * (Positional ? rgain : lgain);
+    }
+  }
+
+  static void clamp(float *buf, int len)
+  {
+    for (int i = 0; i < len; ++i) {
+      float val = buf[i];
+      if (val > 1.0f) {
+        buf[i] = 1.0f;
+      } else if (val < -1.0f) {
+        buf[i] = -1.0f;
+      }
+    }
+  }
+
+  static void clampS16(int16_t *dst, const float *src, int len)
+  {
+    const float max_val = std::numeric_limits<int16_t>::max();
+    const float min_val = std::numeric_limits<int16_t>::min();
+    for (int i = 0; i < len; ++i) {
+      float val = src[i] * 32768.0f;
+      if (val > max_val) {
+        dst[i] = (int16_t)max_val;
+      } else if (val < min_val) {
+        dst[i] = (int16_t)min_val;
+      } else {
+        dst[i] = (int16_t)val;
+      }
+    }
+  }
+
+  static void filterVoices(float *const *bufs, const FilterCoeffs *coeffs,
+                           FilterState *state, int num, int frames)
+  {
+    for (int v = 0; v < num; ++v) {
+      const FilterCoeffs &k = coeffs[v];
+      for (int c = 0; c < 2; ++c) {
+        float *buf = bufs[v] + c;
+        float z1 = state[v].z1[c];
+        float z2 = state[v].z2[c];
+        for (int i = 0; i < frames * 2; i += 2) {
+          const float x = buf[i];
+          const float y = k.b0 * x + z1;
+          z1 = k.b1 * x - k.a1 * y + z2;
+          z2 = k.b2 * x - k.a2 * y;
+          buf[i] = y;
+        }
+        state[v].z1[c] = z1;
+        state[v].z2[c] = z2;
+      }
+    }
+  }
+
+  template <bool Cubic>
+  static void resample(const float *src, double pos, double step, 
+                       float *dst, int frames)
+  {
+    for (int i = 0; i < frames; ++i) {
+      const double p = pos + i * step;
+      const int idx = (int)p;
+      const float t = (float)(p - idx);
+      const float *x = src + idx * 2;
+      for (int c = 0; c < 2; ++c) {
+        dst[i * 2 + c] = Cubic ? cubic(x[c - 2], x[c], x[c + 2], x[c + 4], t)
+          : x[c] + (x[c + 2] - x[c]) * t;
+      }
+    }
+  }
+
+  static void complexMac(float *yre, float *yim, const float *xre,
+                         const float *xim, const float *hre, const float *him,
+                         int len)
+  {
+    for (int i = 0; i < len; ++i) {
+      yre[i] += xre[i] * hre[i] - xim[i] * him[i];
+      yim[i] += xre[i] * him[i] + xim[i] * hre[i];
+    }
+  }
+};
+
+#ifdef KAMEMIX_X86
+
+// Samples left over from the vector loops are done by ScalarMix.
+struct Sse2Mix {
+  template <bool Positional>
+  KAMEMIX_TARGET("sse2")
+  static void mixGain(float *dst, const float *src, int len,
+                      float lgain, float rgain)
+  {
+    const __m128 gain = Positional ? _mm_setr_ps(lgain, rgain, lgain, rgain)
+                                   : _mm_set1_ps(lgain);
+    int i = 0;
+    for (; i + 4 <= len; i += 4) {
+      const __m128 val = _mm_mul_ps(_mm_loadu_ps(src + i), gain);
+      _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), val));
+    }
+    ScalarMix::mixGain<Positional>(dst + i, src + i, len - i, lgain, rgain);
+  }
+
+  KAMEMIX_TARGET("sse2")
+  static void clamp(float *buf, int len)
+  {
+    const __m128 max_val = _mm_set1_ps(1.0f);
+    const __m128 min_val = _mm_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 4 <= len; i += 4) {
+      const __m128 val = _mm_loadu_ps(buf + i);
+      _mm_storeu_ps(buf + i, _mm_min_ps(_mm_max_ps(val, min_val), max_val));
+    }
+    ScalarMix::clamp(buf + i, len - i);
+  }
+
+  KAMEMIX_TARGET("sse2")
+  static void clampS16(int16_t *dst, const float *src, int len)
+  {
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 max_val = _mm_set1_ps(32767.0f);
+    const __m128 min_val = _mm_set1_ps(-32768.0f);
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+      __m128 lo = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+      __m128 hi = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+      lo = _mm_min_ps(_mm_max_ps(lo, min_val), max_val);
+      hi = _mm_min_ps(_mm_max_ps(hi, min_val), max_val);
+      const __m128i packed =
+        _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi));
+      _mm_storeu_si128((__m128i*)(dst + i), packed);
+    }
+    ScalarMix::clampS16(dst + i, src + i, len - i);
+  }
+
+  // Filters 2 voices at a time, with a lane for each channel. A frame of 
+  // each voice is loaded into half of a vector.
+  KAMEMIX_TARGET("sse2")
+  static void filterVoices(float *const *bufs, const FilterCoeffs *coeffs,
+                           FilterState *state, int num, int frames)
+  {
+    int v = 0;
+    for (; v + 2 <= num; v += 2) {
+      FilterLanes lanes;
+      lanes.load(coeffs + v, state + v, 2);
+      const __m128 b0 = _mm_loadu_ps(lanes.b0);
+      const __m128 b1 = _mm_loadu_ps(lanes.b1);
+      const __m128 b2 = _mm_loadu_ps(lanes.b2);
+      const __m128 a1 = _mm_loadu_ps(lanes.a1);
+      const __m128 a2 = _mm_loadu_ps(lanes.a2);
+      __m128 z1 = _mm_loadu_ps(lanes.z1);
+      __m128 z2 = _mm_loadu_ps(lanes.z2);
+      float *buf0 = bufs[v];
+      float *buf1 = bufs[v + 1];
+      for (int i = 0; i < frames * 2; i += 2) {
+        __m128 x = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(buf0 + i));
+        x = _mm_loadh_pi(x, (const __m64*)(buf1 + i));
+        const __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+        z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+        z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+        _mm_storel_pi((__m64*)(buf0 + i), y);
+        _mm_storeh_pi((__m64*)(buf1 + i), y);
+      }
+      _mm_storeu_ps(lanes.z1, z1);
+      _mm_storeu_ps(lanes.z2, z2);
+      lanes.save(state + v, 2);
+    }
+    ScalarMix::filterVoices(bufs + v, coeffs + v, state + v, num - v, 
+                            frames);
+  }
+
+  // Loads a stereo frame from each of 2 positions.
+  KAMEMIX_TARGET("sse2")
+  static __m128 loadFrames(const float *frame0, const float *frame1)
+  {
+    const __m128 x = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)frame0);
+    return _mm_loadh_pi(x, (const __m64*)frame1);
+  }
+
+  KAMEMIX_TARGET("sse2")
+  static __m128 cubic(__m128 ym1, __m128 y0, __m128 y1, __m128 y2, __m128 t)
+  {
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 c1 = _mm_mul_ps(half, _mm_sub_ps(y1, ym1));
+    const __m128 c2 = _mm_sub_ps(
+      _mm_add_ps(ym1, _mm_mul_ps(_mm_set1_ps(2.0f), y1)),
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.5f), y0), _mm_mul_ps(half, y2)));
+    const __m128 c3 = _mm_add_ps(
+      _mm_mul_ps(half, _mm_sub_ps(y2, ym1)),
+      _mm_mul_ps(_mm_set1_ps(1.5f), _mm_sub_ps(y0, y1)));
+    __m128 y = _mm_add_ps(_mm_mul_ps(c3, t), c2);
+    y = _mm_add_ps(_mm_mul_ps(y, t), c1);
+    return _mm_add_ps(_mm_mul_ps(y, t), y0);
+  }
+
+  // 2 output frames at a time, with their taps loaded a frame at a time
+  template <bool Cubic>
+  KAMEMIX_TARGET("sse2")
+  static void resample(const float *src, double pos, double step, 
+                       float *dst, int frames)
+  {
+    int i = 0;
+    for (; i + 2 <= frames; i += 2) {
+      const double p0 = pos + i * step;
+      const double p1 = pos + (i + 1) * step;
+      const int idx0 = (int)p0;
+      const int idx1 = (int)p1;
+      const float t0 = (float)(p0 - idx0);
+      const float t1 = (float)(p1 - idx1);
+      const __m128 t = _mm_setr_ps(t0, t0, t1, t1);
+      const float *x0 = src + idx0 * 2;
+      const float *x1 = src + idx1 * 2;
+      const __m128 y0 = loadFrames(x0, x1);
+      const __m128 y1 = loadFrames(x0 + 2, x1 + 2);
+      __m128 y;
+      if (Cubic) {
+        y = cubic(loadFrames(x0 - 2, x1 - 2), y0, y1, 
+                  loadFrames(x0 + 4, x1 + 4), t);
+      } else {
+        y = _mm_add_ps(y0, _mm_mul_ps(_mm_sub_ps(y1, y0), t));
+      }
+      _mm_storeu_ps(dst + i * 2, y);
+    }
+    ScalarMix::resample<Cubic>(src, pos + i * step, step, dst + i * 2, 
+                               frames - i);
+  }
+
+  KAMEMIX_TARGET("sse2")
+  static void complexMac(float *yre, float *yim, const float *xre,
+                         const float *xim, const float *hre, const float *him,
+                         int len)
+  {
+    int i = 0;
+    for (; i + 4 <= len; i += 4) {
+      const __m128 xr = _mm_loadu_ps(xre + i);
+      const __m128 xi = _mm_loadu_ps(xim + i);
+      const __m128 hr = _mm_loadu_ps(hre + i);
+      const __m128 hi = _mm_loadu_ps(him + i);
+      const __m128 re = _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+      const __m128 im = _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+      _mm_storeu_ps(yre + i, _mm_add_ps(_mm_loadu_ps(yre + i), re));
+      _mm_storeu_ps(yim + i, _mm_add_ps(_mm_loadu_ps(yim + i), im));
+    }
+    ScalarMix::complexMac(yre + i, yim + i, xre + i, xim + i, hre + i,
+                          him + i, len - i);
+  }
+};
+
+struct Avx2Mix {
+  template <bool Positional>
+  KAMEMIX_TARGET("avx2")
+  static void mixGain(float *dst, const float *src, int len,
+                      float lgain, float rgain)
+  {
+    const __m256 gain = Positional
+      ? _mm256_setr_ps(lgain, rgain, lgain, rgain, lgain, rgain, lgain, rgain)
+      : _mm256_set1_ps(lgain);
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+      const __m256 val = _mm256_mul_ps(_mm256_loadu_ps(src + i), gain);
+      _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), val));
+    }
+    ScalarMix::mixGain<Positional>(dst + i, src + i, len - i, lgain, rgain);
+  }
+
+  KAMEMIX_TARGET("avx2")
+  static void clamp(float *buf, int len)
+  {
+    const __m256 max_val = _mm256_set1_ps(1.0f);
+    const __m256 min_val = _mm256_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+      const __m256 val = _mm256_loadu_ps(buf + i);
+      _mm256_storeu_ps(buf + i,
+                       _mm256_min_ps(_mm256_max_ps(val, min_val), max_val));
+    }
+    ScalarMix::clamp(buf + i, len - i);
+  }
+
+  KAMEMIX_TARGET("avx2")
+  static void clampS16(int16_t *dst, const float *src, int len)
+  {
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 max_val = _mm256_set1_ps(32767.0f);
+    const __m256 min_val = _mm256_set1_ps(-32768.0f);
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+      __m256 lo = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+      __m256 hi = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale);
+      lo = _mm256_min_ps(_mm256_max_ps(lo, min_val), max_val);
+      hi = _mm256_min_ps(_mm256_max_ps(hi, min_val), max_val);
+      // packs works within 128 bit lanes, so put 64 bit halves back in order
+      const __m256i packed =
+        _mm256_packs_epi32(_mm256_cvttps_epi32(lo), _mm256_cvttps_epi32(hi));
+      _mm256_storeu_si256((__m256i*)(dst + i),
+                          _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    ScalarMix::clampS16(dst + i, src + i, len - i);
+  }
+
+  // Filters 4 voices at a time, with each 128 bit half of a vector loaded
+  // like Sse2Mix.
+  KAMEMIX_TARGET("avx2")
+  static void filterVoices(float *const *bufs, const FilterCoeffs *coeffs,
+                           FilterState *state, int num, int frames)
+  {
+    int v = 0;
+    for (; v + 4 <= num; v += 4) {
+      FilterLanes lanes;
+      lanes.load(coeffs + v, state + v, 4);
+      const __m256 b0 = _mm256_loadu_ps(lanes.b0);
+      const __m256 b1 = _mm256_loadu_ps(lanes.b1);
+      const __m256 b2 = _mm256_loadu_ps(lanes.b2);
+      const __m256 a1 = _mm256_loadu_ps(lanes.a1);
+      const __m256 a2 = _mm256_loadu_ps(lanes.a2);
+      __m256 z1 = _mm256_loadu_ps(lanes.z1);
+      __m256 z2 = _mm256_loadu_ps(lanes.z2);
+      float *const *buf = bufs + v;
+      for (int i = 0; i < frames * 2; i += 2) {
+        __m128 lo = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(buf[0] + i));
+        lo = _mm_loadh_pi(lo, (const __m64*)(buf[1] + i));
+        __m128 hi = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(buf[2] + i));
+        hi = _mm_loadh_pi(hi, (const __m64*)(buf[3] + i));
+        const __m256 x = 
+          _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+        const __m256 y = _mm256_add_ps(_mm256_mul_ps(b0, x), z1);
+        z1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1, x), 
+                                         _mm256_mul_ps(a1, y)), z2);
+        z2 = _mm256_sub_ps(_mm256_mul_ps(b2, x), _mm256_mul_ps(a2, y));
+        lo = _mm256_castps256_ps128(y);
+        hi = _mm256_extractf128_ps(y, 1);
+        _mm_storel_pi((__m64*)(buf[0] + i), lo);
+        _mm_storeh_pi((__m64*)(buf[1] + i), lo);
+        _mm_storel_pi((__m64*)(buf[2] + i), hi);
+        _mm_storeh_pi((__m64*)(buf[3] + i), hi);
+      }
+      _mm256_storeu_ps(lanes.z1, z1);
+      _mm256_storeu_ps(lanes.z2, z2);
+      lanes.save(state + v, 4);
+    }
+    Sse2Mix::filterVoices(bufs + v, coeffs + v, state + v, num - v, 
+                          frames);
+  }
+
+  KAMEMIX_TARGET("avx2")
+  static __m256 cubic(__m256 ym1, __m256 y0, __m256 y1, __m256 y2, __m256 t)
+  {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 c1 = _mm256_mul_ps(half, _mm256_sub_ps(y1, ym1));
+    const __m256 c2 = _mm256_sub_ps(
+      _mm256_add_ps(ym1, _mm256_mul_ps(_mm256_set1_ps(2.0f), y1)),
+      _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.5f), y0), 
+                    _mm256_mul_ps(half, y2)));
+    const __m256 c3 = _mm256_add_ps(
+      _mm256_mul_ps(half, _mm256_sub_ps(y2, ym1)),
+      _mm256_mul_ps(_mm256_set1_ps(1.5f), _mm256_sub_ps(y0, y1)));
+    __m256 y = _mm256_add_ps(_mm256_mul_ps(c3, t), c2);
+    y = _mm256_add_ps(_mm256_mul_ps(y, t), c1);
+    return _mm256_add_ps(_mm256_mul_ps(y, t), y0);
+  }
+
+  // Gathers the stereo frames at idx. The masked gather with a zeroed 
+  // source is used, since GCC warns the unmasked one reads an 
+  // uninitialized source.
+  KAMEMIX_TARGET("avx2")
+  static __m256 gatherFrames(const double *frames_src, __m128i idx)
+  {
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    return _mm256_castpd_ps(
+      _mm256_mask_i32gather_pd(_mm256_setzero_pd(), frames_src, idx, all, 8));
+  }
+
+  // 4 output frames at a time. Each stereo frame is gathered as one 
+  // double.
+  template <bool Cubic>
+  KAMEMIX_TARGET("avx2")
+  static void resample(const float *src, double pos, double step, 
+                       float *dst, int frames)
+  {
+    const __m256d lanes = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+    const __m256d steps = _mm256_set1_pd(step);
+    const double *frames_src = (const double*)src;
+    int i = 0;
+    for (; i + 4 <= frames; i += 4) {
+      const __m256d p = _mm256_add_pd(
+        _mm256_set1_pd(pos), 
+        _mm256_mul_pd(_mm256_add_pd(_mm256_set1_pd(i), lanes), steps));
+      const __m128i idx = _mm256_cvttpd_epi32(p);
+      const __m128 t4 = _mm256_cvtpd_ps(
+        _mm256_sub_pd(p, _mm256_cvtepi32_pd(idx)));
+      // t of each frame for both of its channels
+      const __m256 t = _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_unpacklo_ps(t4, t4)), 
+        _mm_unpackhi_ps(t4, t4), 1);
+      const __m256 y0 = gatherFrames(frames_src, idx);
+      const __m256 y1 = gatherFrames(frames_src + 1, idx);
+      __m256 y;
+      if (Cubic) {
+        const __m256 ym1 = gatherFrames(frames_src - 1, idx);
+        const __m256 y2 = gatherFrames(frames_src + 2, idx);
+        y = cubic(ym1, y0, y1, y2, t);
+      } else {
+        y = _mm256_add_ps(y0, _mm256_mul_ps(_mm256_sub_ps(y1, y0), t));
+      }
+      _mm256_storeu_ps(dst + i * 2, y);
+    }
+    Sse2Mix::resample<Cubic>(src, pos + i * step, step, dst + i * 2, 
+                             frames - i);
+  }
+
+  KAMEMIX_TARGET("avx2")
+  static void complexMac(float *yre, float *yim, const float *xre,
+                         const float *xim, const float *hre, const float *him,
+                         int len)
+  {
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+      const __m256 xr = _mm256_loadu_ps(xre + i);
+      const __m256 xi = _mm256_loadu_ps(xim + i);
+      const __m256 hr = _mm256_loadu_ps(hre + i);
+      const __m256 hi = _mm256_loadu_ps(him + i);
+      const __m256 re = _mm256_sub_ps(_mm256_mul_ps(xr, hr),
+                                      _mm256_mul_ps(xi, hi));
+      const __m256 im = _mm256_add_ps(_mm256_mul_ps(xr, hi),
+                                      _mm256_mul_ps(xi, hr));
+      _mm256_storeu_ps(yre + i, _mm256_add_ps(_mm256_loadu_ps(yre + i), re));
+      _mm256_storeu_ps(yim + i, _mm256_add_ps(_mm256_loadu_ps(yim + i), im));
+    }
+    ScalarMix::complexMac(yre + i, yim + i, xre + i, xim + i, hre + i,
+                          him + i, len - i);
+  }
+};
+
+#ifdef KAMEMIX_AVX512
+
+// Intrinsics that gcc implements starting from an undefined vector are 
+// used in their zero masked forms with all lanes set, since gcc warns the 
+// undefined vector is uninitialized.
+struct Avx512Mix {
+  template <bool Positional>
+  KAMEMIX_TARGET("avx512f")
+  static void mixGain(float *dst, const float *src, int len,
+                      float lgain, float rgain)
+  {
+    const __m512 gain = Positional
+      ? _mm512_maskz_broadcast_f32x4(
+          0xFFFF, _mm_setr_ps(lgain, rgain, lgain, rgain))
+      : _mm512_set1_ps(lgain);
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+      const __m512 val = _mm512_mul_ps(_mm512_loadu_ps(src + i), gain);
+      _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(dst + i), val));
+    }
+    ScalarMix::mixGain<Positional>(dst + i, src + i, len - i, lgain, rgain);
+  }
+
+  KAMEMIX_TARGET("avx512f")
+  static __m512 clampLanes(__m512 val, __m512 min_val, __m512 max_val)
+  {
+    return _mm512_maskz_min_ps(
+      0xFFFF, _mm512_maskz_max_ps(0xFFFF, val, min_val), max_val);
+  }
+
+  KAMEMIX_TARGET("avx512f")
+  static void clamp(float *buf, int len)
+  {
+    const __m512 max_val = _mm512_set1_ps(1.0f);
+    const __m512 min_val = _mm512_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+      const __m512 val = _mm512_loadu_ps(buf + i);
+      _mm512_storeu_ps(buf + i, clampLanes(val, min_val, max_val));
+    }
+    ScalarMix::clamp(buf + i, len - i);
+  }
+
+  KAMEMIX_TARGET("avx512f")
+  static void clampS16(int16_t *dst, const float *src, int len)
+  {
+    const __m512 scale = _mm512_set1_ps(32768.0f);
+    const __m512 max_val = _mm512_set1_ps(32767.0f);
+    const __m512 min_val = _mm512_set1_ps(-32768.0f);
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+      __m512 val = _mm512_mul_ps(_mm512_loadu_ps(src + i), scale);
+      val = clampLanes(val, min_val, max_val);
+      const __m256i packed = _mm512_maskz_cvtsepi32_epi16(
+        0xFFFF, _mm512_maskz_cvttps_epi32(0xFFFF, val));
+      _mm256_storeu_si256((__m256i*)(dst + i), packed);
+    }
+    ScalarMix::clampS16(dst + i, src + i, len - i);
+  }
+
+  // Filters 8 voices at a time, with each 128 bit quarter of a vector 
+  // loaded like Sse2Mix. CPUs with AVX-512 also have AVX2, so it does the
+  // rest.
+  KAMEMIX_TARGET("avx512f")
+  static void filterVoices(float *const *bufs, const FilterCoeffs *coeffs,
+                           FilterState *state, int num, int frames)
+  {
+    int v = 0;
+    for (; v + 8 <= num; v += 8) {
+      FilterLanes lanes;
+      lanes.load(coeffs + v, state + v, 8);
+      const __m512 b0 = _mm512_loadu_ps(lanes.b0);
+      const __m512 b1 = _mm512_loadu_ps(lanes.b1);
+      const __m512 b2 = _mm512_loadu_ps(lanes.b2);
+      const __m512 a1 = _mm512_loadu_ps(lanes.a1);
+      const __m512 a2 = _mm512_loadu_ps(lanes.a2);
+      __m512 z1 = _mm512_loadu_ps(lanes.z1);
+      __m512 z2 = _mm512_loadu_ps(lanes.z2);
+      float *const *buf = bufs + v;
+      for (int i = 0; i < frames * 2; i += 2) {
+        __m512 x = _mm512_setzero_ps();
+        x = _mm512_insertf32x4(x, loadFrames(buf[0] + i, buf[1] + i), 0);
+        x = _mm512_insertf32x4(x, loadFrames(buf[2] + i, buf[3] + i), 1);
+        x = _mm512_insertf32x4(x, loadFrames(buf[4] + i, buf[5] + i), 2);
+        x = _mm512_insertf32x4(x, loadFrames(buf[6] + i, buf[7] + i), 3);
+        const __m512 y = _mm512_add_ps(_mm512_mul_ps(b0, x), z1);
+        z1 = _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(b1, x), 
+                                         _mm512_mul_ps(a1, y)), z2);
+        z2 = _mm512_sub_ps(_mm512_mul_ps(b2, x), _mm512_mul_ps(a2, y));
+        storeFrames(buf[0] + i, buf[1] + i, 
+                    _mm512_maskz_extractf32x4_ps(0xF, y, 0));
+        storeFrames(buf[2] + i, buf[3] + i, 
+                    _mm512_maskz_extractf32x4_ps(0xF, y, 1));
+        storeFrames(buf[4] + i, buf[5] + i, 
+                    _mm512_maskz_extractf32x4_ps(0xF, y, 2));
+        storeFrames(buf[6] + i, buf[7] + i, 
+                    _mm512_maskz_extractf32x4_ps(0xF, y, 3));
+      }
+      _mm512_storeu_ps(lanes.z1, z1);
+      _mm512_storeu_ps(lanes.z2, z2);
+      lanes.save(state + v, 8);
+    }
+    Avx2Mix::filterVoices(bufs + v, coeffs + v, state + v, num - v, 
+                          frames);
+  }
+
+  // Loads a stereo frame from each of 2 voices.
+  KAMEMIX_TARGET("avx512f")
+  static __m128 loadFrames(const float *frame0, const float *frame1)
+  {
+    const __m128 x = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)frame0);
+    return _mm_loadh_pi(x, (const __m64*)frame1);
+  }
+
+  KAMEMIX_TARGET("avx512f")
+  static void storeFrames(float *frame0, float *frame1, __m128 y)
+  {
+    _mm_storel_pi((__m64*)frame0, y);
+    _mm_storeh_pi((__m64*)frame1, y);
+  }
+
+  KAMEMIX_TARGET("avx512f")
+  static __m512 cubic(__m512 ym1, __m512 y0, __m512 y1, __m512 y2, __m512 t)
+  {
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 c1 = _mm512_mul_ps(half, _mm512_sub_ps(y1, ym1));
+    const __m512 c2 = _mm512_sub_ps(
+      _mm512_fmadd_ps(_mm512_set1_ps(2.0f), y1, ym1),
+      _mm512_fmadd_ps(_mm512_set1_ps(2.5f), y0, _mm512_mul_ps(half, y2)));
+    const __m512 c3 = _mm512_fmadd_ps(
+      half, _mm512_sub_ps(y2, ym1),
+      _mm512_mul_ps(_mm512_set1_ps(1.5f), _mm512_sub_ps(y0, y1)));
+    __m512 y = _mm512_fmadd_ps(c3, t, c2);
+    y = _mm512_fmadd_ps(y, t, c1);
+    return _mm512_fmadd_ps(y, t, y0);
+  }
+
+  // Gathers the stereo frames at idx, masked like Avx2Mix::gatherFrames.
+  KAMEMIX_TARGET("avx512f")
+  static __m512 gatherFrames(const double *frames_src, __m256i idx)
+  {
+    return _mm512_castpd_ps(
+      _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, idx, frames_src, 
+                               8));
+  }
+
+  // 8 output frames at a time, gathered like Avx2Mix::resample
+  template <bool Cubic>
+  KAMEMIX_TARGET("avx512f")
+  static void resample(const float *src, double pos, double step, 
+                       float *dst, int frames)
+  {
+    const __m512d lanes = 
+      _mm512_setr_pd(0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0);
+    const __m512d steps = _mm512_set1_pd(step);
+    // t of each frame for both of its channels
+    const __m512i dup = 
+      _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+    const double *frames_src = (const double*)src;
+    int i = 0;
+    for (; i + 8 <= frames; i += 8) {
+      const __m512d p = _mm512_add_pd(
+        _mm512_set1_pd(pos), 
+        _mm512_mul_pd(_mm512_add_pd(_mm512_set1_pd(i), lanes), steps));
+      const __m256i idx = _mm512_maskz_cvttpd_epi32(0xFF, p);
+      const __m256 t8 = _mm512_maskz_cvtpd_ps(0xFF, 
+        _mm512_sub_pd(p, _mm512_maskz_cvtepi32_pd(0xFF, idx)));
+      const __m512 t = 
+        _mm512_maskz_permutexvar_ps(0xFFFF, dup, _mm512_castps256_ps512(t8));
+      const __m512 y0 = 
+        gatherFrames(frames_src, idx);
+      const __m512 y1 = 
+        gatherFrames(frames_src + 1, idx);
+      __m512 y;
+      if (Cubic) {
+        const __m512 ym1 = 
+          gatherFrames(frames_src - 1, idx);
+        const __m512 y2 = 
+          gatherFrames(frames_src + 2, idx);
+        y = cubic(ym1, y0, y1, y2, t);
+      } else {
+        y = _mm512_fmadd_ps(_mm512_sub_ps(y1, y0), t, y0);
+      }
+      _mm512_storeu_ps(dst + i * 2, y);
+    }
+    Avx2Mix::resample<Cubic>(src, pos + i * step, step, dst + i * 2, 
+                             frames - i);
+  }
+
+  KAMEMIX_TARGET("avx512f")
+  static void complexMac(float *yre, float *yim, const float *xre,
+                         const float *xim, const float *hre, const float *him,
+                         int len)
+  {
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+      const __m512 xr = _mm512_loadu_ps(xre + i);
+      const __m512 xi = _mm512_loadu_ps(xim + i);
+      const __m512 hr = _mm512_loadu_ps(hre + i);
+      const __m512 hi = _mm512_loadu_ps(him + i);
+      const __m512 re = _mm512_sub_ps(_mm512_mul_ps(xr, hr),
+                                      _mm512_mul_ps(xi, hi));
+      const __m512 im = _mm512_add_ps(_mm512_mul_ps(xr, hi),
+                                      _mm512_mul_ps(xi, hr));
+      _mm512_storeu_ps(yre + i, _mm512_add_ps(_mm512_loadu_ps(yre + i), re));
+      _mm512_storeu_ps(yim + i, _mm512_add_ps(_mm512_loadu_ps(yim + i), im));
+    }
+    ScalarMix::complexMac(yre + i, yim + i, xre + i, xim + i, hre + i,
+                          him + i, len - i);
+  }
+};
+
+#endif // KAMEMIX_AVX512
+
+#endif // KAMEMIX_X86
+
+// Applies vdata to len samples of src, and adds them to dst. Volume is
+// changed in mod_times+1 even steps when Ramping, and left and right
+// volumes are the same unless Positional.
+template <class Simd, bool Ramping, bool Positional>
+void mixVoice(float *dst, const float *src, int len_, const VolumeData &vdata)
+{
+  if (!Ramping) {
+    Simd::template mixGain<Positional>(dst, src, len_,
+                                       vdata.left_volume * vdata.lfade,
+                                       vdata.right_volume * vdata.rfade);
+    return;
+  }
+
+  int pos = 0;
+  // make sure len is even after dividing by mod_times+1
+  int len = (len_ / 2) / (vdata.mod_times + 1) * 2;
+
+  for (int i = 0; i < vdata.mod_times; ++i) {
+    float lfade = vdata.lfade + i * vdata.lmod;
+    float rfade = vdata.rfade + i * vdata.rmod;
+    Simd::template mixGain<Positional>(dst + pos, src + pos, len,
+                                       vdata.left_volume * lfade,
+                                       vdata.right_volume * rfade);
+    pos += len;
+  }
+
+  float lfade = vdata.lfade + vdata.mod_times * vdata.lmod;
+  float rfade = vdata.rfade + vdata.mod_times * vdata.rmod;
+  // len*(fdata.mod_times+1) can be less than len_, so make sure to
+  // include all last samples
+  Simd::template mixGain<Positional>(dst + pos, src + pos, len_ - pos,
+                                     vdata.left_volume * lfade,
+                                     vdata.right_volume * rfade);
+}
+
+template <class Simd>
+struct KernelTable {
+  static const MixKernels kernels;
+};
+
+template <class Simd>
+const MixKernels KernelTable<Simd>::kernels = {
+  { { mixVoice<Simd, false, false>, mixVoice<Simd, false, true> },
+    { mixVoice<Simd, true, false>, mixVoice<Simd, true, true> } },
+  Simd::clamp,
+  Simd::clampS16,
+  Simd::filterVoices,
+  { Simd::template resample<false>, Simd::template resample<true> },
+  Simd::complexMac
+};
+
+#ifdef KAMEMIX_X86
+
+// Returns true if the CPU and OS support level.
+bool cpuSupports(KameMix_SimdLevel level)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  switch (level) {
+  case KameMix_SimdSSE2:
+    return __builtin_cpu_supports("sse2");
+  case KameMix_SimdAVX2:
+    return __builtin_cpu_supports("avx2");
+  case KameMix_SimdAVX512:
+    return __builtin_cpu_supports("avx512f");
+  default:
+    return true;
+  }
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  const int max_leaf = info[0];
+  __cpuid(info, 1);
+  const bool sse2 = (info[3] & (1 << 26)) != 0;
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if (level == KameMix_SimdSSE2) {
+    return sse2;
+  } else if (level == KameMix_SimdNone) {
+    return true;
+  } else if (!osxsave || !avx || max_leaf < 7) {
+    return false;
+  }
+
+  // OS must save the larger registers on context switches
+  const unsigned long long xcr0 = _xgetbv(0);
+  __cpuidex(info, 7, 0);
+  if (level == KameMix_SimdAVX2) {
+    return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+  }
+  return (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+#else
+  return level == KameMix_SimdNone;
+#endif
+}
+
+#endif // KAMEMIX_X86
+
+} // end anon namespace
+
+namespace KameMix {
+
+const MixKernels& selectMixKernels(KameMix_SimdLevel max_level,
+                                   KameMix_SimdLevel &level)
+{
+#ifdef KAMEMIX_AVX512
+  if (max_level >= KameMix_SimdAVX512 && cpuSupports(KameMix_SimdAVX512)) {
+    level = KameMix_SimdAVX512;
+    return KernelTable<Avx512Mix>::kernels;
+  }
+#endif
+#ifdef KAMEMIX_X86
+  if (max_level >= KameMix_SimdAVX2 && cpuSupports(KameMix_SimdAVX2)) {
+    level = KameMix_SimdAVX2;
+    return KernelTable<Avx2Mix>::kernels;
+  }
+  if (max_level >= KameMix_SimdSSE2 && cpuSupports(KameMix_SimdSSE2)) {
+    level = KameMix_SimdSSE2;
+    return KernelTable<Sse2Mix>::kernels;
+  }
+#endif
+  level = KameMix_SimdNone;
+  return KernelTable<ScalarMix>::kernels;
+}
+
+} // end namespace KameMix
@@ -0,0 +1,103 @@
+#ifndef KAME_MIX_MIX_KERNELS_H
+#define KAME_MIX_MIX_KERNELS_H
+
+#include "KameMix.h"
+#include <cstdint>
+
+namespace KameMix {
+
+struct VolumeData {
+  float left_volume;
+  float right_volume;
+  float lfade; // fade_percent
+  float rfade; // fade_percent
+  // increment/decrement to add to fade each time after applying fade to
+  // audio stream
+  float lmod;
+  float rmod;
+  // number of times to add mod to fade; 0 means apply fade once to
+  // audio stream without adding mod after
+  int mod_times;
+};
+
+// Biquad coefficients, normalized so a0 is 1. One-pole filters have b2 and
+// a2 of 0.
+struct FilterCoeffs {
+  float b0, b1, b2;
+  float a1, a2;
+};
+
+// Transposed direct form II state of a stereo filter, for each channel
+struct FilterState {
+  float z1[2];
+  float z2[2];
+};
+
+// Applies vdata to len stereo float samples in src, and adds them to dst.
+typedef void (*MixVoiceFunc)(float *dst, const float *src, int len,
+                             const VolumeData &vdata);
+// Clamps len float samples to [-1.0, 1.0].
+typedef void (*ClampFunc)(float *buf, int len);
+// Clamps len float samples in src and converts them to int16_t in dst.
+typedef void (*ClampS16Func)(int16_t *dst, const float *src, int len);
+// Filters frames stereo float samples in each of num bufs with its coeffs,
+// and updates its state.
+typedef void (*FilterVoicesFunc)(float *const *bufs, 
+                                 const FilterCoeffs *coeffs, 
+                                 FilterState *state, int num, int frames);
+// Interpolates frames stereo float frames of src, at frame positions pos,
+// pos + step, pos + 2 * step..., into dst. Every position is at least 1 
+// frame from the start of src, and 3 from its end, so all taps are in src.
+typedef void (*ResampleFunc)(const float *src, double pos, double step,
+                             float *dst, int frames);
+// Multiplies len complex numbers in x by the ones in h, and adds them to y.
+// Real and imaginary parts are in separate arrays.
+typedef void (*ComplexMacFunc)(float *yre, float *yim, const float *xre,
+                               const float *xim, const float *hre,
+                               const float *him, int len);
+
+/*
+Mixing functions for one SIMD instruction set. Each voice's gain and mix is
+specialized at compile time for whether its volume is steady or ramping
+during the callback, and whether left and right volumes differ from
+positioning, so the inner loops have no branches. audioCallback picks one
+with mixVoiceFunc once per voice.
+*/
+struct MixKernels {
+  MixVoiceFunc mix_voice[2][2]; // [ramping][positional]
+  ClampFunc clamp;
+  ClampS16Func clamp_s16;
+  FilterVoicesFunc filter_voices; // for FilterBatch
+  ResampleFunc resample[2]; // [KameMix_ResampleQuality], for VoiceResampler
+  ComplexMacFunc complex_mac; // for Convolver
+};
+
+// Returns true if vdata changes volume during the callback.
+inline
+bool isRamping(const VolumeData &vdata)
+{
+  return vdata.mod_times > 0;
+}
+
+// Returns true if vdata has different left and right volumes.
+inline
+bool isPositional(const VolumeData &vdata)
+{
+  return vdata.left_volume * vdata.lfade != vdata.right_volume * vdata.rfade
+    || vdata.lmod != vdata.rmod;
+}
+
+inline
+MixVoiceFunc mixVoiceFunc(const MixKernels &kernels, const VolumeData &vdata)
+{
+  return kernels.mix_voice[isRamping(vdata)][isPositional(vdata)];
+}
+
+// Returns kernels for the best instruction set supported by the CPU, up to
+// max_level, and sets level to the one used.
+const MixKernels& selectMixKernels(KameMix_SimdLevel max_level,
+                                   KameMix_SimdLevel &level);
+
+} // end namespace KameMix
+
+#endif
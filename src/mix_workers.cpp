@@ -0,0 +1,87 @@
+#include "mix_workers.h"
+#include "audio_mem.h"
+#include "rt_check.h"
+
+namespace KameMix {
+
+MixWorkers::MixWorkers(int num_workers_, int buf_len_)
+  : generation{0},
+    quit{false},
+    func{nullptr},
+    data{nullptr},
+    done{0},
+    num_workers{num_workers_},
+    buf_len{buf_len_}
+{
+  if (num_workers < 1) {
+    num_workers = 1;
+  } else if (num_workers > MAX_WORKERS) {
+    num_workers = MAX_WORKERS;
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    buffers[i] = (uint8_t*)km_malloc(buf_len * 2);
+  }
+  for (int i = 1; i < num_workers; ++i) {
+    threads[i] = std::thread(&MixWorkers::threadMain, this, i);
+  }
+}
+
+MixWorkers::~MixWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  cond.notify_all();
+  for (int i = 1; i < num_workers; ++i) {
+    threads[i].join();
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    km_free(buffers[i]);
+  }
+}
+
+void MixWorkers::run(WorkFunc func_, void *data_)
+{
+  if (num_workers > 1) {
+    func = func_;
+    data = data_;
+    done.store(0, std::memory_order_relaxed);
+    {
+      rtLock(mutex); // reports waiting in audio thread
+      std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+      ++generation;
+    }
+    cond.notify_all();
+  }
+
+  func_(0, data_);
+
+  while (done.load(std::memory_order_acquire) != num_workers - 1) {
+    std::this_thread::yield();
+  }
+}
+
+void MixWorkers::threadMain(int worker)
+{
+  unsigned seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]() { return generation != seen || quit; });
+      if (quit) {
+        return;
+      }
+      seen = generation;
+    }
+
+    {
+      // same checks and float mode as audioCallback
+      RtAudioScope rt_scope;
+      func(worker, data);
+    }
+    done.fetch_add(1, std::memory_order_release);
+  }
+}
+
+} // end namespace KameMix
@@ -0,0 +1,67 @@
+#ifndef KAME_MIX_MIX_WORKERS_H
+#define KAME_MIX_MIX_WORKERS_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace KameMix {
+
+/*
+Threads that help the audio thread mix voices, enabled with
+KameMix_InitOptions.mix_threads. run calls a function on every worker at
+once, with the caller as worker 0, and returns when they all finish. Each
+worker has its own buffer to copy voices to and accumulator to mix them
+into, so they never write to the same memory.
+
+Workers sleep between runs, and are woken each callback. The caller spins
+waiting for the others to finish, since it usually finishes last after
+taking its share of the work.
+*/
+class MixWorkers {
+public:
+  static const int MAX_WORKERS = 16;
+  typedef void (*WorkFunc)(int worker, void *data);
+
+  // Starts num_workers-1 threads, since the caller of run is worker 0. 
+  // buf_len is the size in bytes of each worker's buffers.
+  MixWorkers(int num_workers, int buf_len);
+  ~MixWorkers();
+
+  int numWorkers() const { return num_workers; }
+  // Buffer for copying a voice before mixing it, of buf_len bytes
+  uint8_t* tmpBuffer(int worker) { return buffers[worker]; }
+  // Buffer of buf_len bytes to mix into, set by the worker
+  float* accumulator(int worker) 
+  { 
+    return (float*)(buffers[worker] + buf_len); 
+  }
+
+  // Calls func(worker, data) on all workers, and returns when all return.
+  // Only called from one thread at a time.
+  void run(WorkFunc func, void *data);
+
+private:
+  MixWorkers(const MixWorkers &other) = delete;
+  MixWorkers& operator=(const MixWorkers &other) = delete;
+
+  void threadMain(int worker);
+
+  std::thread threads[MAX_WORKERS];
+  uint8_t *buffers[MAX_WORKERS]; // tmp buffer then accumulator
+  std::mutex mutex;
+  std::condition_variable cond;
+  unsigned generation; // incremented for each run
+  bool quit;
+  WorkFunc func;
+  void *data;
+  std::atomic<int> done; // threads done with current run
+  int num_workers;
+  int buf_len;
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,65 @@
+#include "resampler.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace KameMix {
+
+const int VoiceResampler::HISTORY;
+const int VoiceResampler::CHUNK_FRAMES;
+const int VoiceResampler::MAX_STEP;
+const int VoiceResampler::CHUNK_LEN;
+
+void VoiceResampler::reset()
+{
+  memset(history, 0, sizeof(history));
+  pos = HISTORY;
+  active = false;
+}
+
+int VoiceResampler::framesWanted(int dst_frames, double step) const
+{
+  // last output's taps go 2 frames past it
+  const double last = pos + (dst_frames - 1) * step;
+  const int frames = (int)last + 3 - HISTORY;
+  return std::min(std::max(frames, 0), CHUNK_FRAMES);
+}
+
+float* VoiceResampler::beginChunk(float *chunk) const
+{
+  memcpy(chunk, history, sizeof(history));
+  return chunk + HISTORY * 2;
+}
+
+int VoiceResampler::resample(const MixKernels &kernels, 
+                             KameMix_ResampleQuality quality, float *chunk,
+                             int src_frames, bool ended, double step, 
+                             float *dst, int dst_frames)
+{
+  const int total = HISTORY + src_frames;
+  int last; // last frame an output can be at
+  if (ended) {
+    memset(chunk + total * 2, 0, 2 * 2 * sizeof(float));
+    last = total - 1;
+  } else {
+    last = total - 3;
+  }
+
+  int frames = 0;
+  if (pos < last + 1) {
+    frames = (int)std::ceil((last + 1 - pos) / step);
+    frames = std::min(frames, dst_frames);
+    // rounding can put the last one past last
+    while (frames > 0 && (int)(pos + (frames - 1) * step) > last) {
+      --frames;
+    }
+  }
+  kernels.resample[quality](chunk, pos, step, dst, frames);
+  pos += frames * step;
+
+  memcpy(history, chunk + (total - HISTORY) * 2, sizeof(history));
+  pos -= src_frames;
+  return frames;
+}
+
+} // end namespace KameMix
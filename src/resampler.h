@@ -0,0 +1,48 @@
+#ifndef KAME_MIX_RESAMPLER_H
+#define KAME_MIX_RESAMPLER_H
+
+#include "KameMix.h"
+#include "mix_kernels.h"
+
+namespace KameMix {
+
+/*
+Resampling state of a voice played at a pitch from KameMix_setPitch, or 
+stored at a different rate than the output. Source frames are read a chunk
+at a time, after the last HISTORY frames of the chunk before, so the taps 
+around every position are in one buffer, across reads and loop wraps. 
+Positions are read with the ResampleFunc kernels, several frames at once.
+*/
+struct VoiceResampler {
+  // frames kept from the chunk before. A position can be up to 3 frames
+  // before the first frame read, and its taps start 1 before it.
+  static const int HISTORY = 4;
+  static const int CHUNK_FRAMES = 256; // most source frames read at once
+  static const int MAX_STEP = 16; // most source frames per output frame
+  // floats in a chunk, with history and silence after a source's end
+  static const int CHUNK_LEN = (HISTORY + CHUNK_FRAMES + 2) * 2;
+
+  // Clears history, to start at the next frame read.
+  void reset();
+  // Returns source frames to read for up to dst_frames output frames at 
+  // step, at most CHUNK_FRAMES.
+  int framesWanted(int dst_frames, double step) const;
+  // Copies history to the start of chunk, of CHUNK_LEN floats, and returns
+  // where to read source frames to after it.
+  float* beginChunk(float *chunk) const;
+  // Interpolates up to dst_frames stereo frames into dst at step, from 
+  // chunk with src_frames read after history. If ended, the source has no 
+  // more frames, so output goes to its last frame, with silence after it.
+  // Returns frames output.
+  int resample(const MixKernels &kernels, KameMix_ResampleQuality quality,
+               float *chunk, int src_frames, bool ended, double step, 
+               float *dst, int dst_frames);
+
+  float history[HISTORY * 2];
+  double pos; // next output position, in frames from start of history
+  bool active; // voice reads through the resampler
+};
+
+} // end namespace KameMix
+
+#endif
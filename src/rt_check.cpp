@@ -0,0 +1,122 @@
+#include "rt_check.h"
+
+#ifdef KAMEMIX_RT_CHECK
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define KAMEMIX_HAS_MXCSR
+#endif
+
+namespace {
+
+// Max number of different call sites recorded
+const int MAX_VIOLATIONS = 128;
+
+struct Violation {
+  const char *what;
+  const char *file;
+  int line;
+  std::atomic<unsigned> count;
+};
+
+// Entries up to num_violations are written once before num_violations is 
+// incremented, and after that only count changes. insert_lock is held 
+// while adding one, since mix workers can record them at the same time as
+// the audio thread.
+Violation violations[MAX_VIOLATIONS];
+std::atomic<int> num_violations{0};
+std::atomic<unsigned> dropped_violations{0};
+std::atomic_flag insert_lock = ATOMIC_FLAG_INIT;
+
+// Returns entry for site in first num violations, or nullptr.
+Violation* findViolation(int num, const char *what, const char *file, 
+                         int line)
+{
+  for (int i = 0; i < num; ++i) {
+    Violation &v = violations[i];
+    if (v.line == line && strcmp(v.what, what) == 0 && 
+        strcmp(v.file, file) == 0) {
+      return &v;
+    }
+  }
+  return nullptr;
+}
+
+} // end anon namespace
+
+namespace KameMix {
+
+thread_local bool rt_audio_thread = false;
+
+void rtViolation(const char *what, const char *file, int line)
+{
+  int num = num_violations.load(std::memory_order_acquire);
+  Violation *found = findViolation(num, what, file, line);
+  if (found) {
+    found->count.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  while (insert_lock.test_and_set(std::memory_order_acquire)) { }
+  // another thread could have added it before getting the lock
+  num = num_violations.load(std::memory_order_relaxed);
+  found = findViolation(num, what, file, line);
+  if (found) {
+    found->count.fetch_add(1, std::memory_order_relaxed);
+  } else if (num == MAX_VIOLATIONS) {
+    dropped_violations.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    Violation &v = violations[num];
+    v.what = what;
+    v.file = file;
+    v.line = line;
+    v.count.store(1, std::memory_order_relaxed);
+    num_violations.store(num + 1, std::memory_order_release);
+  }
+  insert_lock.clear(std::memory_order_release);
+}
+
+RtAudioScope::RtAudioScope()
+  : saved_csr{0}
+{
+  rt_audio_thread = true;
+#ifdef KAMEMIX_HAS_MXCSR
+  saved_csr = _mm_getcsr();
+  _mm_setcsr(saved_csr | 0x8040); // flush to zero | denormals are zero
+#endif
+}
+
+RtAudioScope::~RtAudioScope()
+{
+#ifdef KAMEMIX_HAS_MXCSR
+  _mm_setcsr(saved_csr);
+#endif
+  rt_audio_thread = false;
+}
+
+int rtForEachViolation(KameMix_RtViolationFunc func, void *userdata)
+{
+  const int num = num_violations.load(std::memory_order_acquire);
+  if (func) {
+    for (int i = 0; i < num; ++i) {
+      Violation &v = violations[i];
+      func(v.what, v.file, v.line, 
+           v.count.load(std::memory_order_relaxed), userdata);
+    }
+    const unsigned dropped = 
+      dropped_violations.load(std::memory_order_relaxed);
+    if (dropped > 0) {
+      func("more sites than recorded", __FILE__, __LINE__, dropped, 
+           userdata);
+    }
+  }
+  return num;
+}
+
+} // end namespace KameMix
+
+#endif // KAMEMIX_RT_CHECK
@@ -0,0 +1,116 @@
+#ifndef KAME_MIX_RT_CHECK_H
+#define KAME_MIX_RT_CHECK_H
+
+#include "KameMix.h"
+
+/*
+Real-time safety checks for the audio thread, enabled by building with
+KAMEMIX_RT_CHECK defined. audioCallback must not allocate, free, wait on a
+lock, or make system calls like starting a thread, since any of them can
+take long enough for the audio device to underrun. Those operations are
+marked with RT_CHECK, and when run on the audio thread they are recorded
+with their call site, to be reported by KameMix_forEachRtViolation.
+
+km_* allocation functions take their caller's file and line as default
+arguments from RT_SITE_PARAM, so the report shows where they were called
+from instead of audio_mem.h.
+
+The checks are compiled out when KAMEMIX_RT_CHECK isn't defined.
+*/
+
+#ifdef KAMEMIX_RT_CHECK
+
+#if defined(__GNUC__) || defined(__clang__) || \
+    (defined(_MSC_VER) && _MSC_VER >= 1926)
+#define RT_SITE_PARAM , const char *rt_file = __builtin_FILE(), \
+                        int rt_line = __builtin_LINE()
+#else // caller's site not supported, so report site of the check
+#define RT_SITE_PARAM , const char *rt_file = __FILE__, \
+                        int rt_line = __LINE__
+#endif
+
+// Checks operation named what, at call site passed with RT_SITE_PARAM.
+#define RT_CHECK_SITE(what) KameMix::rtCheck((what), rt_file, rt_line)
+// Checks operation named what, at this site.
+#define RT_CHECK(what) KameMix::rtCheck((what), __FILE__, __LINE__)
+
+namespace KameMix {
+
+// true in audioCallback and mix workers, while an RtAudioScope exists
+extern thread_local bool rt_audio_thread;
+
+// Records what at file and line, or increments its count if already
+// recorded. Called on the audio thread and mix workers.
+void rtViolation(const char *what, const char *file, int line);
+
+inline
+void rtCheck(const char *what, const char *file, int line)
+{
+  if (rt_audio_thread) {
+    rtViolation(what, file, line);
+  }
+}
+
+// Locks mutex, first trying without blocking, and records a violation at
+// the call site if it had to wait.
+template <class Mutex>
+void rtLock(Mutex &mutex RT_SITE_PARAM)
+{
+  if (!mutex.try_lock()) {
+    RT_CHECK_SITE("blocking lock");
+    mutex.lock();
+  }
+}
+
+/*
+Marks the current thread as the audio thread while in scope, and enables
+flush to zero and denormals are zero, so mixing tiny values like the tails
+of fades doesn't slow down.
+*/
+class RtAudioScope {
+public:
+  RtAudioScope();
+  ~RtAudioScope();
+
+private:
+  RtAudioScope(const RtAudioScope &other) = delete;
+  RtAudioScope& operator=(const RtAudioScope &other) = delete;
+
+  unsigned saved_csr; // floating point control register to restore
+};
+
+// Calls func for each recorded violation. Returns number of them.
+int rtForEachViolation(KameMix_RtViolationFunc func, void *userdata);
+
+} // end namespace KameMix
+
+#else
+
+#define RT_SITE_PARAM
+#define RT_CHECK_SITE(what) ((void)0)
+#define RT_CHECK(what) ((void)0)
+
+namespace KameMix {
+
+template <class Mutex>
+void rtLock(Mutex &mutex)
+{
+  mutex.lock();
+}
+
+class RtAudioScope {
+public:
+  RtAudioScope() { }
+};
+
+inline
+int rtForEachViolation(KameMix_RtViolationFunc /*func*/, void* /*userdata*/)
+{
+  return 0;
+}
+
+} // end namespace KameMix
+
+#endif // KAMEMIX_RT_CHECK
+
+#endif
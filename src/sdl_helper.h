@@ -21,6 +21,21 @@ SDL_AudioFormat outFormatToSDL(KameMix_OutputFormat format)
   return 0;
 }
 
+// Size in bytes of a sample in format
+inline
+int formatSize(KameMix_OutputFormat format)
+{
+  switch (format) {
+  case KameMix_OutputFloat:
+    return sizeof(float);
+  case KameMix_OutputS16:
+    return sizeof(int16_t);
+  }
+
+  assert("Unknown AudioFormat");
+  return 0;
+}
+
 inline
 SDL_AudioFormat WAV_formatToSDL(const KameMix_WavFormat format)
 {
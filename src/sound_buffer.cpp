@@ -3,71 +3,254 @@
 #include "sdl_helper.h"
 #include "vorbis_helper.h"
 #include "wav_loader.h"
+#include "adpcm.h"
 #include "scope_exit.h"
 #include <cassert>
 #include <cstring>
 #include <cctype>
 #include <cstdlib>
 #include <limits>
+#include <utility>
+#include <thread>
+#include <chrono>
 
 namespace {
 
 const int MAX_BUFF_SIZE = std::numeric_limits<int>::max();
 
+// Number of sample frames decoded at once when loading progressively. Also 
+// the delay before a progressive Sound can start playing.
+const int PROGRESSIVE_DECODE_FRAMES = 4096;
+
+// Returns format to store samples in when loaded with flags.
+inline
+KameMix_OutputFormat storageFormat(int flags)
+{
+  if (flags & KameMix_SoundS16) {
+    return KameMix_OutputS16;
+  }
+  return KameMix_getFormat();
+}
+
+// Returns sample rate to store samples in when loaded with flags.
+inline
+int storageRate(int flags, int src_freq)
+{
+  if (flags & KameMix_SoundNativeRate) {
+    return src_freq;
+  }
+  return KameMix_getFrequency();
+}
+
 }
 
 namespace KameMix {
 
-bool SoundBuffer::load(const char *filename)
+struct ProgressiveLoad {
+  ProgressiveLoad() 
+    : dst{nullptr}, dst_size{0}, channels{0}, dst_freq{0}, 
+      format{KameMix_OutputFloat}, ready_size{0}, done{false}, cancel{false},
+      owners{2}
+  { }
+
+  OggVorbis_File vf;
+  DataSource src; // read by vf, and closed by ov_clear
+  std::thread thread; // runs decodeProgressive
+  uint8_t *dst; // SoundBuffer's data, owned by SoundBuffer
+  int dst_size;
+  int channels;
+  int dst_freq;
+  KameMix_OutputFormat format;
+  std::atomic<int> ready_size; // bytes of dst decoded so far
+  std::atomic<bool> done; // ready_size is final
+  std::atomic<bool> cancel; // set to stop decoding early
+  // SoundBuffer and thread. The last to let go frees the load and dst, so 
+  // releasing doesn't wait for the thread.
+  std::atomic<int> owners;
+};
+
+// Decode threads still running, including ones their SoundBuffer let go of
+std::atomic<int> running_loads{0};
+
+// Drops an owner of load, and frees it and its dst if that was the last.
+void releaseLoad(ProgressiveLoad *load)
 {
-  int dot_idx = -1;
-  int size = 0;
-  const char *iter = filename;
+  if (load->owners.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    ov_clear(&load->vf);
+    km_free(load->dst);
+    km_delete(load);
+  }
+}
 
-  while (*iter != '\0') {
-    if (*iter == '.') {
-      dot_idx = (int)(iter - filename);
+// Decodes load.vf into load.dst a chunk at a time, converting each chunk to
+// the stored format and rate, and publishing it with ready_size. Stops at 
+// the end of file, on error, or when cancel is set.
+static
+void decodeProgressive(ProgressiveLoad &load)
+{
+  const int channels = load.channels;
+  const int block_size = channels * formatSize(load.format);
+  const SDL_AudioFormat dst_format = outFormatToSDL(load.format);
+  uint8_t *decode_buf = nullptr;
+  auto decode_buf_cleanup = 
+    makeScopeExit([&decode_buf]() { km_free(decode_buf); });
+  int decode_buf_size = 0;
+  SDL_AudioCVT cvt;
+  int bitstream = -1;
+  int written = 0;
+
+  while (!load.cancel.load(std::memory_order_relaxed)) {
+    // pointer to array of channels, each channel is array of floats
+    float **channel_buf;
+    int stream_idx;
+    const long samples_read = ov_read_float(&load.vf, &channel_buf, 
+                                            PROGRESSIVE_DECODE_FRAMES, 
+                                            &stream_idx);
+    if (samples_read == OV_HOLE) { // skip over corrupt data
+      continue;
+    } else if (samples_read <= 0) { // end of file or error
+      break;
     }
-    ++iter;
-    ++size;
+
+    if (stream_idx != bitstream) {
+      const int src_freq = ov_info(&load.vf, stream_idx)->rate;
+      if (SDL_BuildAudioCVT(&cvt, AUDIO_F32SYS, channels, src_freq,
+                            dst_format, channels, load.dst_freq) < 0) {
+        break;
+      }
+      const int needed_size = 
+        PROGRESSIVE_DECODE_FRAMES * sizeof(float) * channels * cvt.len_mult;
+      if (needed_size > decode_buf_size) {
+        uint8_t *tmp = (uint8_t*)km_realloc_(decode_buf, needed_size);
+        if (!tmp) {
+          break;
+        }
+        decode_buf = tmp;
+        decode_buf_size = needed_size;
+      }
+      bitstream = stream_idx;
+    }
+
+    float *dst = (float*)decode_buf;
+    if (channels == 1) { // src has only mono streams, so store as mono
+      memcpy(dst, *channel_buf, samples_read * sizeof(float));
+    } else if (ov_info(&load.vf, stream_idx)->channels > 1) {
+      // more than 1 channel but only care about 2
+      float *chan = *channel_buf;
+      float *chan2 = channel_buf[1];
+      float *chan_end = chan + samples_read;
+      while (chan != chan_end) {
+        *dst++ = *chan++;
+        *dst++ = *chan2++;
+      }
+    } else {
+      // this stream is mono, but store as stereo
+      float *chan = *channel_buf;
+      float *chan_end = chan + samples_read;
+      while (chan != chan_end) {
+        *dst++ = *chan;
+        *dst++ = *chan++;
+      }
+    }
+
+    int len = (int)samples_read * sizeof(float) * channels;
+    if (cvt.needed) {
+      cvt.buf = decode_buf;
+      cvt.len = len;
+      if (SDL_ConvertAudio(&cvt) < 0) {
+        break;
+      }
+      len = (cvt.len_cvt / block_size) * block_size;
+    }
+    // dst_size is an upper bound, but don't trust it
+    if (len > load.dst_size - written) {
+      len = load.dst_size - written;
+    }
+    memcpy(load.dst + written, decode_buf, len);
+    written += len;
+    load.ready_size.store(written, std::memory_order_release);
   }
 
-  // (size - dot_idx - 1) is num chars past last dot
-  if (dot_idx == -1 || (size - dot_idx - 1) != 3 ){
-    return false;
+  load.done.store(true, std::memory_order_release);
+}
+
+bool SoundBuffer::load(const char *filename, int flags)
+{
+  switch (fileTypeFromName(filename)) {
+  case OggFileType:
+    return loadOGG(filename, flags);
+  case WavFileType:
+    return loadWAV(filename, flags);
+  case UnknownFileType:
+    break;
   }
 
-  iter = filename + dot_idx + 1; // 1 past last dot
-  char prefix[4]; 
-  prefix[0] = (char)tolower(iter[0]);
-  prefix[1] = (char)tolower(iter[1]);
-  prefix[2] = (char)tolower(iter[2]);
-  prefix[3] = '\0';
+  return false;
+}
 
-  if (strcmp(prefix, "ogg") == 0) {
-    return loadOGG(filename);
-  } else if (strcmp(prefix, "wav") == 0) {
-    return loadWAV(filename);
+bool SoundBuffer::load(DataSource &src, int flags)
+{
+  switch (fileTypeFromData(src)) {
+  case OggFileType:
+    return loadOGG(src, flags);
+  case WavFileType:
+    return loadWAV(src, flags);
+  case UnknownFileType:
+    break;
   }
 
+  closeSource(src);
   return false;
 }
 
-bool SoundBuffer::loadWAV(const char *filename)
+bool SoundBuffer::loadWAV(const char *filename, int flags)
 {
+  DataSource src;
+  if (!openFileSource(src, filename)) {
+    release();
+    return false;
+  }
+  return loadWAV(src, flags);
+}
+
+bool SoundBuffer::loadOGG(const char *filename, int flags)
+{
+  const int not_progressive = KameMix_SoundCompressed | KameMix_SoundADPCM;
+  if ((flags & KameMix_SoundProgressive) && !(flags & not_progressive)) {
+    return loadProgressiveOGG(filename, flags);
+  }
+
+  DataSource src;
+  if (!openFileSource(src, filename)) {
+    release();
+    return false;
+  }
+  return loadOGG(src, flags);
+}
+
+bool SoundBuffer::loadWAV(DataSource &src, int flags)
+{
+  if (flags & KameMix_SoundADPCM) {
+    // load as S16 samples, and encode them after
+    const int s16_flags = (flags & ~KameMix_SoundADPCM) | KameMix_SoundS16;
+    return loadWAV(src, s16_flags) && transcodeADPCM();
+  }
+
   release();
 
   KameMix_WavFile wf;
-  KameMix_WavResult wav_result = KameMix_wavOpen(&wf, filename);
+  KameMix_WavResult wav_result = 
+    KameMix_wavOpenIO(&wf, &src.io, src.userdata);
   if (wav_result != KameMix_WAV_OK) {
     return false;
   }
 
   auto wf_cleanup = makeScopeExit([&wf]() { KameMix_wavClose(&wf); });
 
+  const KameMix_OutputFormat format = storageFormat(flags);
   const SDL_AudioFormat src_format = WAV_formatToSDL(wf.format);
-  const SDL_AudioFormat dst_format = getOutputFormat();
-  const int dst_freq = KameMix_getFrequency();
+  const SDL_AudioFormat dst_format = outFormatToSDL(format);
+  const int dst_freq = storageRate(flags, wf.sample_rate);
   const int channels = wf.num_channels >= 2 ? 2 : 1;
   SDL_AudioCVT cvt;
   if (SDL_BuildAudioCVT(&cvt, src_format, wf.num_channels, 
@@ -113,7 +296,7 @@ bool SoundBuffer::loadWAV(const char *filename)
       return false;
     }
     
-    const int block_size = channels * KameMix_getFormatSize();
+    const int block_size = channels * formatSize(format);
     audio_buf_len = (cvt.len_cvt / block_size) * block_size;
     // try to shrink if at least 1KB unused
     if ((cvt.len * cvt.len_mult - audio_buf_len) > 1024) {
@@ -129,29 +312,43 @@ bool SoundBuffer::loadWAV(const char *filename)
   this->buffer = dst_buf; 
   this->buffer_size = audio_buf_len; 
   this->channels = channels;
+  this->rate_ = dst_freq;
+  this->format_ = format;
   dst_buf_cleanup.cancel(); // don't free dst_buf
   return true;
 }
 
-bool SoundBuffer::loadOGG(const char *filename)
+bool SoundBuffer::loadOGG(DataSource &src, int flags)
 {
+  if (flags & KameMix_SoundCompressed) {
+    return loadCompressedOGG(src);
+  }
+
+  if (flags & KameMix_SoundADPCM) {
+    // load as S16 samples, and encode them after
+    const int s16_flags = (flags & ~KameMix_SoundADPCM) | KameMix_SoundS16;
+    return loadOGG(src, s16_flags) && transcodeADPCM();
+  }
+
   release();
   OggVorbis_File vf;
 
-  if (ov_fopen(filename, &vf) != 0) {
+  if (openOGG(vf, src) != 0) {
     return false;
   }
 
   auto vf_cleanup = makeScopeExit([&vf]() { ov_clear(&vf); });
 
   ov_pcm_seek(&vf, 0);
+  const KameMix_OutputFormat format = storageFormat(flags);
   const int channels = isMonoOGG(vf) ? 1 : 2;
   int last_src_freq = ov_info(&vf, 0)->rate;
+  const int dst_freq = storageRate(flags, last_src_freq);
   int audio_buf_len;
   uint8_t *dst_buf;
   // calc size of audio_buf including needed conversion
   {
-    int64_t tmp_len = calcBufSizeOGG(vf, channels, true); 
+    int64_t tmp_len = calcBufSizeOGG(vf, channels, true, dst_freq); 
     if (tmp_len > MAX_BUFF_SIZE) {
       return false;
     }
@@ -226,8 +423,7 @@ bool SoundBuffer::loadOGG(const char *filename)
         // freq is different in this stream than last, or reached end of
         // physical straem so convert all data not converted yet if necessary 
         if (src_freq != last_src_freq || stream_idx == 0) {
-          const int dst_freq = KameMix_getFrequency();
-          const SDL_AudioFormat dst_format = getOutputFormat();
+          const SDL_AudioFormat dst_format = outFormatToSDL(format);
           SDL_AudioCVT cvt;
           if (SDL_BuildAudioCVT(&cvt, AUDIO_F32SYS, channels, last_src_freq, 
                                 dst_format, channels, dst_freq) < 0) {
@@ -240,7 +436,7 @@ bool SoundBuffer::loadOGG(const char *filename)
             if (SDL_ConvertAudio(&cvt) < 0) {
               return false;
             }
-            const int block_size = channels * KameMix_getFormatSize();
+            const int block_size = channels * formatSize(format);
             cvt_buf += (cvt.len_cvt / block_size) * block_size;
             dst = (float*)cvt_buf;
           }
@@ -273,17 +469,211 @@ bool SoundBuffer::loadOGG(const char *filename)
   this->buffer = audio_buf;
   this->buffer_size = audio_buf_len; 
   this->channels = channels;
+  this->rate_ = dst_freq;
+  this->format_ = format;
   dst_buf_cleanup.cancel(); // don't free dst_buf
 
   return true;
 }
 
+bool SoundBuffer::loadCompressedOGG(DataSource &src)
+{
+  release();
+  auto src_cleanup = makeScopeExit([&src]() { closeSource(src); });
+
+  if (seekSource(src, 0, SEEK_END) != 0) {
+    return false;
+  }
+  const int64_t file_len = tellSource(src);
+  if (file_len <= 0 || file_len > MAX_BUFF_SIZE) {
+    return false;
+  }
+  if (seekSource(src, 0, SEEK_SET) != 0) {
+    return false;
+  }
+
+  uint8_t *dst_buf = (uint8_t*)km_malloc_((size_t)file_len);
+  if (!dst_buf) {
+    return false;
+  }
+  auto dst_buf_cleanup = makeScopeExit([&dst_buf]() { km_free(dst_buf); });
+
+  if (readSource(src, dst_buf, 1, (size_t)file_len) != (size_t)file_len) {
+    return false;
+  }
+
+  // Make sure data can be decoded, and get number of channels
+  DataSource mem_src;
+  if (!openMemSource(mem_src, dst_buf, (size_t)file_len)) {
+    return false;
+  }
+  OggVorbis_File vf;
+  if (openOGG(vf, mem_src) != 0) { // closes mem_src on error
+    return false;
+  }
+  const bool seekable = ov_seekable(&vf) != 0;
+  const int channels = isMonoOGG(vf) ? 1 : 2;
+  ov_clear(&vf);
+  // must be seekable to loop and play at different positions
+  if (!seekable) {
+    return false;
+  }
+
+  this->buffer = dst_buf;
+  this->buffer_size = (int)file_len;
+  this->channels = channels;
+  this->rate_ = KameMix_getFrequency(); // decoded in output frequency
+  this->format_ = KameMix_OutputFloat; // decoded as float
+  this->compressed = true;
+  dst_buf_cleanup.cancel(); // don't free dst_buf
+  return true;
+}
+
+// Allocates buffer for the whole file, and starts decoding into it in a 
+// background thread. The file is read by the thread, so it's only supported
+// when loading from a file name.
+bool SoundBuffer::loadProgressiveOGG(const char *filename, int flags)
+{
+  release();
+  ProgressiveLoad *load = 
+    (ProgressiveLoad*)km_malloc_(sizeof(ProgressiveLoad));
+  if (!load) {
+    return false;
+  }
+  new (load) ProgressiveLoad();
+  bool vf_open = false;
+  auto load_cleanup = makeScopeExit([&load, &vf_open]() { 
+    if (vf_open) {
+      ov_clear(&load->vf);
+    }
+    km_delete(load);
+  });
+
+  if (!openFileSource(load->src, filename)) {
+    return false;
+  }
+  if (openOGG(load->vf, load->src) != 0) { // closes src on error
+    return false;
+  }
+  vf_open = true;
+
+  OggVorbis_File &vf = load->vf;
+  ov_pcm_seek(&vf, 0);
+  const KameMix_OutputFormat format = storageFormat(flags);
+  const int channels = isMonoOGG(vf) ? 1 : 2;
+  const int dst_freq = storageRate(flags, ov_info(&vf, 0)->rate);
+  const int64_t buf_len = 
+    calcBufSizeOGG(vf, channels, format == KameMix_OutputFloat, dst_freq); 
+  if (buf_len <= 0 || buf_len > MAX_BUFF_SIZE) {
+    return false;
+  }
+  uint8_t *dst_buf = (uint8_t*)km_malloc_((size_t)buf_len);
+  if (!dst_buf) {
+    return false;
+  }
+
+  load->dst = dst_buf;
+  load->dst_size = (int)buf_len;
+  load->channels = channels;
+  load->dst_freq = dst_freq;
+  load->format = format;
+  running_loads.fetch_add(1, std::memory_order_relaxed);
+  load->thread = std::thread([load]() {
+    decodeProgressive(*load);
+    releaseLoad(load);
+    running_loads.fetch_sub(1, std::memory_order_release);
+  });
+
+  this->buffer = dst_buf;
+  this->buffer_size = (int)buf_len; // not shrunk, since played while decoded
+  this->channels = channels;
+  this->rate_ = dst_freq;
+  this->format_ = format;
+  this->progressive = load;
+  load_cleanup.cancel(); // freed in release
+  return true;
+}
+
+void SoundBuffer::waitForReleasedLoads()
+{
+  while (running_loads.load(std::memory_order_acquire) > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+bool SoundBuffer::isLoading() const
+{
+  return progressive && !progressive->done.load(std::memory_order_acquire);
+}
+
+int SoundBuffer::readySize(bool &loading) const
+{
+  if (!progressive) {
+    loading = false;
+    return buffer_size;
+  }
+  // check done first, so ready_size is final if done
+  loading = !progressive->done.load(std::memory_order_acquire);
+  return progressive->ready_size.load(std::memory_order_acquire);
+}
+
+// Replaces loaded S16 samples with IMA ADPCM blocks. Releases buffer on
+// error.
+bool SoundBuffer::transcodeADPCM()
+{
+  assert(format_ == KameMix_OutputS16);
+  const int frames = buffer_size / sampleBlockSize();
+  const int adpcm_size = adpcmEncodedSize(frames, channels);
+  uint8_t *dst_buf = (uint8_t*)km_malloc_(adpcm_size);
+  if (!dst_buf) {
+    release();
+    return false;
+  }
+
+  adpcmEncode((int16_t*)buffer, frames, channels, dst_buf);
+  km_free(buffer);
+
+  this->buffer = dst_buf;
+  this->buffer_size = adpcm_size;
+  this->adpcm_frames = frames;
+  this->adpcm = true;
+  return true;
+}
+
 void SoundBuffer::release()
 {
+  if (progressive) {
+    // Decoding writes into buffer, so the load frees it once its thread 
+    // stops. Not joined, since this can run on the audio thread when the 
+    // last ref to a Sound is freed.
+    progressive->cancel.store(true, std::memory_order_relaxed);
+    progressive->thread.detach();
+    buffer = nullptr;
+    releaseLoad(progressive);
+    progressive = nullptr;
+  }
   if (buffer != nullptr) {
     km_free(buffer);
     buffer = nullptr;
   }
+  buffer_size = 0;
+  channels = 0;
+  compressed = false;
+  adpcm = false;
+  adpcm_frames = 0;
+}
+
+void SoundBuffer::swap(SoundBuffer &other)
+{
+  std::swap(buffer, other.buffer);
+  std::swap(buffer_size, other.buffer_size);
+  std::swap(channels, other.channels);
+  std::swap(rate_, other.rate_);
+  std::swap(adpcm_frames, other.adpcm_frames);
+  std::swap(format_, other.format_);
+  std::swap(compressed, other.compressed);
+  std::swap(adpcm, other.adpcm);
+  std::swap(progressive, other.progressive);
 }
 
 } // end namespace KameMix
@@ -2,50 +2,112 @@
 #define KAMEMIX_SOUND_BUFFER_H
 
 #include "KameMix.h"
+#include "data_source.h"
+#include "sdl_helper.h"
 #include <cstdint>
 #include <cstddef>
 #include <atomic>
 
 namespace KameMix {
 
+// Background decoding state of a Sound loaded with KameMix_SoundProgressive
+struct ProgressiveLoad;
+
 class SoundBuffer {
 public:
   SoundBuffer()
-    : buffer{nullptr}, buffer_size{0}, channels{0} { }
+    : buffer{nullptr}, buffer_size{0}, channels{0}, rate_{0}, adpcm_frames{0},
+      format_{KameMix_OutputFloat}, compressed{false}, adpcm{false},
+      progressive{nullptr} { }
 
-  SoundBuffer(const char *filename) 
-    : buffer{nullptr}, buffer_size{0}, channels{0} 
-  { load(filename); }
+  SoundBuffer(const char *filename, int flags = KameMix_SoundDefault) 
+    : buffer{nullptr}, buffer_size{0}, channels{0}, rate_{0}, adpcm_frames{0},
+      format_{KameMix_OutputFloat}, compressed{false}, adpcm{false},
+      progressive{nullptr}
+  { load(filename, flags); }
 
   ~SoundBuffer() { release(); }
 
-  bool load(const char *filename);
-  bool loadOGG(const char *filename);
-  bool loadWAV(const char *filename);
+  // flags are KameMix_SoundFlags.
+  bool load(const char *filename, int flags = KameMix_SoundDefault);
+  bool loadOGG(const char *filename, int flags = KameMix_SoundDefault);
+  bool loadWAV(const char *filename, int flags = KameMix_SoundDefault);
+  // Load from src, which is always closed before return. The file type is
+  // detected from the header in load(src).
+  bool load(DataSource &src, int flags = KameMix_SoundDefault);
+  bool loadOGG(DataSource &src, int flags = KameMix_SoundDefault);
+  bool loadWAV(DataSource &src, int flags = KameMix_SoundDefault);
   bool isLoaded() const { return buffer != nullptr; }
-  // Frees loaded audio data. isLoaded() returns false after this.
+  // Frees loaded audio data, after stopping any background decoding. 
+  // isLoaded() returns false after this.
   void release();
+  // Exchanges loaded audio data and its format with other.
+  void swap(SoundBuffer &other);
+  // Waits for background decoding of released Sounds to stop, which is 
+  // soon after release. Called by KameMix_shutdown, so nothing is freed 
+  // after it.
+  static void waitForReleasedLoads();
+
+  // true if data() is an OGG file to be decoded by a VorbisDecoder while
+  // playing, instead of samples in output format.
+  bool isCompressed() const { return compressed; }
+
+  // true if data() is IMA ADPCM blocks from adpcmEncode, to be decoded by
+  // an AdpcmDecoder while playing.
+  bool isADPCM() const { return adpcm; }
+
+  // true while an OGG file loaded with KameMix_SoundProgressive is still 
+  // being decoded into data() in a background thread.
+  bool isLoading() const;
+
+  // Returns size in bytes of data() that's decoded and can be played, and 
+  // sets loading to isLoading(). Until loading is false, more data can be 
+  // decoded past the returned size, up to size(). Safe to call from any 
+  // thread.
+  int readySize(bool &loading) const;
+
+  // Returns number of sample frames in ADPCM data(), or 0 if not ADPCM.
+  int numADPCMFrames() const { return adpcm_frames; }
 
   // Returns pointer to currently loaded audio data, or nullptr if not loaded.
   uint8_t* data() { return buffer; }
 
   // Returns size in bytes of audio data in data() buffer, or 0 if not loaded.
+  // This is the allocated size while isLoading(), see readySize().
   int size() const { return buffer_size; }
 
   // Returns 1 for mono, 2 for stereo, or 0 if not loaded.
   int numChannels() const { return channels; }
 
+  // Returns format of samples in data(). This is the output format, unless
+  // loaded with KameMix_SoundS16. Samples are converted to float while mixing.
+  KameMix_OutputFormat format() const { return format_; }
+
+  // Returns sample rate of data(). This is the output frequency, unless 
+  // loaded with KameMix_SoundNativeRate. Resampled while mixing if different.
+  int rate() const { return rate_; }
+
   // Returns size of audio format * number of channels in bytes, 
   // or 0 if not loaded.
-  int sampleBlockSize() const { return channels * KameMix_getFormatSize(); }
+  int sampleBlockSize() const { return channels * formatSize(format_); }
 
 private:
   SoundBuffer(const SoundBuffer &other) = delete;
   SoundBuffer& operator=(const SoundBuffer &other) = delete;
 
+  bool loadCompressedOGG(DataSource &src);
+  bool loadProgressiveOGG(const char *filename, int flags);
+  bool transcodeADPCM();
+
   uint8_t *buffer;
   int buffer_size;
   int channels;
+  int rate_;
+  int adpcm_frames;
+  KameMix_OutputFormat format_;
+  bool compressed;
+  bool adpcm;
+  ProgressiveLoad *progressive; // nullptr unless loaded progressively
 };
 
 } // end namespace KameMix
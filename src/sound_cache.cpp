@@ -0,0 +1,374 @@
+#include "sound_cache.h"
+#include "sound_handle.h"
+#include "rt_check.h"
+#include "audio_guard.h"
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+
+// Increments refcount unless it already reached 0, since then sound is 
+// being freed. Returns false if sound is being freed.
+bool incRefIfAlive(KameMix_Sound *sound)
+{
+  int count = sound->refcount.load(std::memory_order_relaxed);
+  while (count != 0) {
+    if (sound->refcount.compare_exchange_weak(count, count + 1, 
+                                              std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // end anon namespace
+
+namespace KameMix {
+
+// FNV-1a hash of path and flags
+size_t SoundCacheKeyHash::operator()(const SoundCacheKey &key) const
+{
+  uint32_t hash = 2166136261u;
+  for (char c : key.path) {
+    hash = (hash ^ (uint8_t)c) * 16777619u;
+  }
+  hash = (hash ^ (uint32_t)key.flags) * 16777619u;
+  return hash;
+}
+
+SoundCache::SoundCache()
+  : budget{0}, resident_bytes{0}, tick{0}, 
+    reload_policy{KameMix_ReloadDelay}, hits{0}, misses{0}, evictions{0},
+    reloads{0}, reload_queue{nullptr}, quit{false}
+{
+  // started last, after everything it uses is set
+  loader = std::thread(&SoundCache::loaderMain, this);
+}
+
+SoundCache::~SoundCache()
+{
+  {
+    std::lock_guard<std::mutex> lock(loader_mutex);
+    quit.store(true, std::memory_order_relaxed);
+  }
+  reload_wanted.notify_one();
+  loader.join();
+}
+
+KameMix_Sound* SoundCache::load(const char *path, int flags, 
+                                LoadFunc load_func)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  SoundCacheKey key = { CacheString(path), flags };
+  Map::iterator iter;
+
+  while (true) {
+    iter = entries.find(key);
+    if (iter == entries.end()) {
+      iter = entries.insert(MapValue(key, Entry{nullptr})).first;
+      break;
+    }
+
+    KameMix_Sound *sound = iter->second.sound;
+    if (!sound) { // loading in another thread
+      load_done.wait(lock);
+      continue;
+    }
+    if (incRefIfAlive(sound)) {
+      touch(sound);
+      hits.fetch_add(1, std::memory_order_relaxed);
+      return sound;
+    }
+    // Sound is being freed, so load it again in its entry. Unset its key,
+    // so freeing it doesn't remove the new Sound.
+    sound->cache_key = nullptr;
+    iter->second.sound = nullptr;
+    break;
+  }
+
+  // Entry with nullptr sound is only removed here, so iter stays valid 
+  // while unlocked.
+  lock.unlock();
+  KameMix_Sound *sound = load_func(path, flags);
+  lock.lock();
+
+  misses.fetch_add(1, std::memory_order_relaxed);
+  if (sound) {
+    sound->cache_key = &iter->first;
+    sound->cached = true;
+    touch(sound);
+    resident_bytes.fetch_add(sound->mem_size.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+    iter->second.sound = sound;
+  } else {
+    entries.erase(iter);
+  }
+  load_done.notify_all();
+  lock.unlock();
+
+  if (sound) {
+    enforceBudget(sound);
+  }
+  return sound;
+}
+
+void SoundCache::remove(KameMix_Sound *sound)
+{
+  if (sound->isResident()) {
+    resident_bytes.fetch_sub(sound->mem_size.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+  }
+
+  rtLock(mutex); // reports waiting in audio thread
+  std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+  if (sound->cache_key) {
+    Map::iterator iter = entries.find(*sound->cache_key);
+    if (iter != entries.end() && iter->second.sound == sound) {
+      entries.erase(iter);
+    }
+    sound->cache_key = nullptr;
+  }
+}
+
+inline
+void SoundCache::touch(KameMix_Sound *sound)
+{
+  const unsigned now = tick.fetch_add(1, std::memory_order_relaxed) + 1;
+  sound->last_used.store(now, std::memory_order_relaxed);
+}
+
+bool SoundCache::prepareToPlay(KameMix_Sound *sound)
+{
+  touch(sound);
+  if (sound->isResident()) {
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  misses.fetch_add(1, std::memory_order_relaxed);
+  startReload(sound);
+
+  KameMix_ReloadPolicy policy = getReloadPolicy();
+  std::unique_lock<std::mutex> lock(mutex);
+  if (policy == KameMix_ReloadDelay && sound->cache_key &&
+      (sound->cache_key->flags & KameMix_SoundCompressed)) {
+    // compressed Sounds need their data to open a decoder when played
+    policy = KameMix_ReloadBlock;
+  }
+
+  switch (policy) {
+  case KameMix_ReloadSkip:
+    return false;
+  case KameMix_ReloadDelay:
+    return true;
+  case KameMix_ReloadBlock:
+    break;
+  }
+
+  reload_done.wait(lock, [sound]() { 
+    return sound->residency.load(std::memory_order_acquire) != 
+      SoundReloading; 
+  });
+  return sound->isResident();
+}
+
+void SoundCache::startReload(KameMix_Sound *sound)
+{
+  int state = sound->residency.load(std::memory_order_acquire);
+  while (state == SoundEvicted || state == SoundReloadFailed) {
+    if (sound->residency.compare_exchange_weak(state, SoundReloading,
+                                               std::memory_order_acq_rel)) {
+      // ref is kept until the loader thread is done with sound
+      KameMix_incSoundRef(sound);
+      KameMix_Sound *head = reload_queue.load(std::memory_order_relaxed);
+      do {
+        sound->next_reload = head;
+      } while (!reload_queue.compare_exchange_weak(
+                 head, sound, std::memory_order_release, 
+                 std::memory_order_relaxed));
+      // Not locking loader_mutex can miss the wakeup, so the loader also 
+      // checks the queue every LOADER_POLL.
+      reload_wanted.notify_one();
+      return;
+    }
+  }
+}
+
+void SoundCache::loaderMain()
+{
+  const std::chrono::milliseconds LOADER_POLL(20);
+  while (true) {
+    KameMix_Sound *sound = 
+      reload_queue.exchange(nullptr, std::memory_order_acquire);
+    if (!sound) {
+      if (quit.load(std::memory_order_relaxed)) {
+        break;
+      }
+      std::unique_lock<std::mutex> lock(loader_mutex);
+      reload_wanted.wait_for(lock, LOADER_POLL, [this]() {
+        return quit.load(std::memory_order_relaxed) ||
+          reload_queue.load(std::memory_order_relaxed) != nullptr;
+      });
+      continue;
+    }
+
+    // reload oldest first
+    KameMix_Sound *oldest = nullptr;
+    while (sound) {
+      KameMix_Sound *next = sound->next_reload;
+      sound->next_reload = oldest;
+      oldest = sound;
+      sound = next;
+    }
+    while (oldest) {
+      KameMix_Sound *next = oldest->next_reload;
+      oldest->next_reload = nullptr;
+      reload(oldest); // fails once quit, to drain the queue
+      KameMix_freeSound(oldest);
+      oldest = next;
+    }
+  }
+}
+
+void SoundCache::reload(KameMix_Sound *sound)
+{
+  SoundCacheKey key;
+  key.flags = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sound->cache_key) {
+      key = *sound->cache_key;
+    }
+  }
+
+  SoundBuffer new_buf;
+  const bool loaded = !quit.load(std::memory_order_relaxed) &&
+    !key.path.empty() && new_buf.load(key.path.c_str(), key.flags);
+  const size_t new_size = (size_t)new_buf.size();
+  {
+    AudioGuard audio_guard;
+    if (loaded) {
+      sound->buffer.swap(new_buf);
+      sound->mem_size.store(new_size, std::memory_order_relaxed);
+      resident_bytes.fetch_add(new_size, std::memory_order_relaxed);
+    }
+    sound->residency.store(loaded ? SoundResident : SoundReloadFailed,
+                           std::memory_order_release);
+  }
+
+  if (loaded) {
+    reloads.fetch_add(1, std::memory_order_relaxed);
+  }
+  {
+    // lock so waiters can't miss notify between checking residency and 
+    // waiting
+    std::lock_guard<std::mutex> lock(mutex);
+  }
+  reload_done.notify_all();
+
+  if (loaded) {
+    enforceBudget(sound);
+  }
+}
+
+void SoundCache::setBudget(size_t bytes)
+{
+  budget.store(bytes, std::memory_order_relaxed);
+  enforceBudget(nullptr);
+}
+
+void SoundCache::enforceBudget(KameMix_Sound *keep)
+{
+  const size_t max_bytes = getBudget();
+  if (max_bytes == 0 || memoryUsed() <= max_bytes) {
+    return;
+  }
+
+  typedef std::vector<KameMix_Sound*, Alloc<KameMix_Sound*>> SoundList;
+  SoundList candidates;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    candidates.reserve(entries.size());
+    for (MapValue &value : entries) {
+      KameMix_Sound *sound = value.second.sound;
+      if (sound && sound != keep && sound->isResident() &&
+          incRefIfAlive(sound)) {
+        candidates.push_back(sound);
+      }
+    }
+  }
+
+  // least recently used first; compare difference so tick can wrap
+  std::sort(candidates.begin(), candidates.end(), 
+    [](const KameMix_Sound *a, const KameMix_Sound *b) {
+      const unsigned a_used = a->last_used.load(std::memory_order_relaxed);
+      const unsigned b_used = b->last_used.load(std::memory_order_relaxed);
+      return (int)(a_used - b_used) < 0;
+    });
+
+  for (KameMix_Sound *sound : candidates) {
+    if (memoryUsed() > max_bytes) {
+      evict(sound);
+    }
+    KameMix_freeSound(sound);
+  }
+}
+
+bool SoundCache::evict(KameMix_Sound *sound)
+{
+  SoundBuffer old_buf; // frees data after the audio lock is released
+  {
+    AudioGuard audio_guard;
+    if (sound->voices != 0 || !sound->isResident()) {
+      return false;
+    }
+    sound->residency.store(SoundEvicted, std::memory_order_relaxed);
+    sound->buffer.swap(old_buf);
+    resident_bytes.fetch_sub(sound->mem_size.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+    sound->mem_size.store(0, std::memory_order_relaxed);
+  }
+
+  evictions.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+int SoundCache::forEach(KameMix_CachedSoundFunc func, void *userdata)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  int count = 0;
+  for (const MapValue &value : entries) {
+    KameMix_Sound *sound = value.second.sound;
+    if (!sound) {
+      continue;
+    }
+    ++count;
+    if (func) {
+      func(value.first.path.c_str(), value.first.flags, 
+           sound->refcount.load(std::memory_order_relaxed),
+           sound->mem_size.load(std::memory_order_relaxed), userdata);
+    }
+  }
+  return count;
+}
+
+void SoundCache::getStats(KameMix_SoundCacheStats &stats) const
+{
+  stats.hits = hits.load(std::memory_order_relaxed);
+  stats.misses = misses.load(std::memory_order_relaxed);
+  stats.evictions = evictions.load(std::memory_order_relaxed);
+  stats.reloads = reloads.load(std::memory_order_relaxed);
+  stats.resident_bytes = memoryUsed();
+  stats.budget = getBudget();
+}
+
+void SoundCache::resetStats()
+{
+  hits.store(0, std::memory_order_relaxed);
+  misses.store(0, std::memory_order_relaxed);
+  evictions.store(0, std::memory_order_relaxed);
+  reloads.store(0, std::memory_order_relaxed);
+}
+
+} // end namespace KameMix
@@ -0,0 +1,146 @@
+#ifndef KAME_MIX_SOUND_CACHE_H
+#define KAME_MIX_SOUND_CACHE_H
+
+#include "KameMix.h"
+#include "audio_mem.h"
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+
+namespace KameMix {
+
+typedef std::basic_string<char, std::char_traits<char>, Alloc<char>> 
+  CacheString;
+
+// Sounds are cached by file path and the KameMix_SoundFlags they were 
+// loaded with, since flags change how samples are stored.
+struct SoundCacheKey {
+  CacheString path;
+  int flags;
+};
+
+inline
+bool operator==(const SoundCacheKey &a, const SoundCacheKey &b)
+{
+  return a.flags == b.flags && a.path == b.path;
+}
+
+struct SoundCacheKeyHash {
+  size_t operator()(const SoundCacheKey &key) const;
+};
+
+/*
+Cache of loaded Sounds, so loading the same file again returns the same 
+KameMix_Sound. The cache doesn't own a reference to its Sounds: an entry is
+removed when its Sound's refcount reaches 0. 
+
+With a memory budget, the audio data of least recently used Sounds that 
+aren't playing is evicted when resident data is over budget. Evicted Sounds
+are reloaded when played again, one at a time, by a loader thread that 
+runs until the cache is destroyed. All functions are thread safe. The audio
+lock must not be held when calling them, except remove and startReload, 
+which may also be called on the audio thread.
+*/
+class SoundCache {
+public:
+  typedef KameMix_Sound* (*LoadFunc)(const char *path, int flags);
+
+  // The audio lock is taken with AudioGuard while evicting or replacing a 
+  // Sound's data, and while checking its playing channels.
+  SoundCache();
+  // Joins the loader thread. Sounds still waiting to reload fail.
+  ~SoundCache();
+
+  // Returns cached Sound for path and flags with its refcount incremented.
+  // Otherwise loads it with load_func and adds it to cache. If another 
+  // thread is loading the same Sound, waits for it to finish instead of
+  // loading it twice. Returns nullptr on error.
+  KameMix_Sound* load(const char *path, int flags, LoadFunc load_func);
+
+  // Removes sound from cache. Must be called when its refcount reaches 0.
+  void remove(KameMix_Sound *sound);
+
+  // Called before playing a cached sound. Marks it as used, and starts 
+  // reloading it if evicted. Returns false if it shouldn't be played 
+  // because of the reload policy, or reloading failed with 
+  // KameMix_ReloadBlock.
+  bool prepareToPlay(KameMix_Sound *sound);
+
+  // Queues sound for the loader thread if evicted or its last reload 
+  // failed. Doesn't allocate or lock, so it's safe on the audio thread 
+  // with the audio lock held.
+  void startReload(KameMix_Sound *sound);
+
+  // Calls func for each loaded Sound. Returns number of Sounds.
+  int forEach(KameMix_CachedSoundFunc func, void *userdata);
+
+  // Returns total bytes of audio data of resident Sounds.
+  size_t memoryUsed() const { 
+    return resident_bytes.load(std::memory_order_relaxed); 
+  }
+
+  void setBudget(size_t bytes);
+  size_t getBudget() const { return budget.load(std::memory_order_relaxed); }
+
+  void setReloadPolicy(KameMix_ReloadPolicy policy) { 
+    reload_policy.store(policy, std::memory_order_relaxed); 
+  }
+  KameMix_ReloadPolicy getReloadPolicy() const { 
+    return (KameMix_ReloadPolicy)reload_policy.load(
+      std::memory_order_relaxed); 
+  }
+
+  void getStats(KameMix_SoundCacheStats &stats) const;
+  void resetStats();
+
+private:
+  SoundCache(const SoundCache &other) = delete;
+  SoundCache& operator=(const SoundCache &other) = delete;
+
+  // sound is nullptr while being loaded
+  struct Entry {
+    KameMix_Sound *sound;
+  };
+
+  typedef std::pair<const SoundCacheKey, Entry> MapValue;
+  typedef std::unordered_map<SoundCacheKey, Entry, SoundCacheKeyHash,
+                             std::equal_to<SoundCacheKey>, 
+                             Alloc<MapValue>> Map;
+
+  void touch(KameMix_Sound *sound);
+  void reload(KameMix_Sound *sound);
+  // Reloads queued Sounds until quit.
+  void loaderMain();
+  // Evicts least recently used Sounds until under budget, except keep.
+  void enforceBudget(KameMix_Sound *keep);
+  bool evict(KameMix_Sound *sound);
+
+  Map entries;
+  std::mutex mutex;
+  std::condition_variable load_done; // notified when a load finishes
+  std::condition_variable reload_done; // notified when a reload finishes
+  std::atomic<size_t> budget; // 0 for no budget
+  std::atomic<size_t> resident_bytes;
+  std::atomic<unsigned> tick; // incremented for each use of a Sound
+  std::atomic<int> reload_policy;
+  std::atomic<unsigned> hits;
+  std::atomic<unsigned> misses;
+  std::atomic<unsigned> evictions;
+  std::atomic<unsigned> reloads;
+
+  // loader thread
+  // Sounds queued by startReload, newest first, linked by next_reload
+  std::atomic<KameMix_Sound*> reload_queue;
+  std::mutex loader_mutex;
+  std::condition_variable reload_wanted; // notified when queued or quit
+  std::atomic<bool> quit;
+  std::thread loader;
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef KAME_MIX_SOUND_HANDLE_H
+#define KAME_MIX_SOUND_HANDLE_H
+
+#include "KameMix.h"
+#include "sound_buffer.h"
+#include <atomic>
+#include <cstddef>
+
+namespace KameMix {
+
+struct SoundCacheKey;
+
+// Whether a cached Sound's audio data is in memory. Sounds not in the 
+// cache are always SoundResident.
+enum SoundResidency {
+  SoundResident,
+  SoundEvicted, // freed to stay under cache budget
+  SoundReloading, // being loaded again in another thread
+  SoundReloadFailed
+};
+
+}
+
+// Loaded Sound shared by the user and playing channels, and freed when
+// refcount reaches 0.
+struct KameMix_Sound {
+  KameMix_Sound() 
+    : cache_key{nullptr}, cached{false}, voices{0}, coalesce_frames{0}, 
+      voice_limit{0}, last_start{0}, mem_size{0}, last_used{0}, 
+      residency{KameMix::SoundResident}, refcount{1}, next_reload{nullptr}
+  { 
+    KameMix_unsetChannel(last_channel);
+  }
+  KameMix_Sound(const char *file, int flags) 
+    : buffer{file, flags}, cache_key{nullptr}, cached{false}, voices{0},
+      coalesce_frames{0}, voice_limit{0}, last_start{0},
+      mem_size{(size_t)buffer.size()}, last_used{0}, 
+      residency{KameMix::SoundResident}, refcount{1}, next_reload{nullptr}
+  { 
+    KameMix_unsetChannel(last_channel);
+  }
+
+  bool isResident() const { 
+    return residency.load(std::memory_order_acquire) == 
+      KameMix::SoundResident; 
+  }
+
+  KameMix::SoundBuffer buffer;
+  // Key of entry in SoundCache, or nullptr if not cached. Only used with
+  // SoundCache's mutex locked.
+  const KameMix::SoundCacheKey *cache_key;
+  bool cached; // set before sound is shared, so safe to read without lock
+  int voices; // number of channels playing sound; used with audio_mutex
+  // From KameMix_setSoundCoalesce, and the last voice started for merging
+  // plays into. Used with audio_mutex.
+  uint64_t coalesce_frames; // 0 to not merge
+  int voice_limit; // 0 for no limit
+  KameMix_Channel last_channel;
+  uint64_t last_start; // mixer clock frame last_channel starts at
+  std::atomic<size_t> mem_size; // bytes of audio data, 0 if evicted
+  std::atomic<unsigned> last_used; // SoundCache tick of last load or play
+  std::atomic<int> residency; // SoundResidency
+  std::atomic<int> refcount;
+  KameMix_Sound *next_reload; // in SoundCache's queue of Sounds to reload
+};
+
+#endif
@@ -24,9 +24,14 @@ int readMoreWAV(KameMix_WavFile &wf, uint8_t *buffer, int buf_len,
 
 namespace KameMix {
 
+int StreamBuffer::dataSize()
+{
+  return STREAM_SIZE * 2;
+}
+
 bool StreamBuffer::allocData()
 {
-  buffer = (uint8_t*)km_malloc_(STREAM_SIZE * 2);
+  buffer = (uint8_t*)km_pool_alloc(dataSize());
   if (!buffer) {
     return false;
   }
@@ -53,7 +58,7 @@ void StreamBuffer::release()
     }
 
     uint8_t *buf = buffer < buffer2 ? buffer : buffer2;
-    km_free(buf); 
+    km_pool_free(buf, dataSize()); 
     buffer = nullptr;
     buffer2 = nullptr;
     buffer_size = 0;
@@ -63,52 +68,69 @@ void StreamBuffer::release()
 
 bool StreamBuffer::load(const char *filename, double sec)
 {
-  int dot_idx = -1;
-  int size = 0;
-  const char *iter = filename;
-
-  while (*iter != '\0') {
-    if (*iter == '.') {
-      dot_idx = (int)(iter - filename);
-    }
-    ++iter;
-    ++size;
-  }
-
-  // (size - dot_idx - 1) is num chars past last dot
-  if (dot_idx == -1 || (size - dot_idx - 1) != 3 ){
-    return false;
+  switch (fileTypeFromName(filename)) {
+  case OggFileType:
+    return loadOGG(filename, sec);
+  case WavFileType:
+    return loadWAV(filename, sec);
+  case UnknownFileType:
+    break;
   }
 
-  iter = filename + dot_idx + 1; // 1 past last dot
-  char prefix[4]; 
-  prefix[0] = (char)tolower(iter[0]);
-  prefix[1] = (char)tolower(iter[1]);
-  prefix[2] = (char)tolower(iter[2]);
-  prefix[3] = '\0';
+  return false;
+}
 
-  if (strcmp(prefix, "ogg") == 0) {
-    return loadOGG(filename, sec);
-  } else if (strcmp(prefix, "wav") == 0) {
-    return loadWAV(filename);
+bool StreamBuffer::load(DataSource &src, double sec)
+{
+  switch (fileTypeFromData(src)) {
+  case OggFileType:
+    return loadOGG(src, sec);
+  case WavFileType:
+    return loadWAV(src, sec);
+  case UnknownFileType:
+    break;
   }
 
+  closeSource(src);
   return false;
 }
 
 bool StreamBuffer::loadWAV(const char *filename, double sec)
+{
+  DataSource src;
+  if (!openFileSource(src, filename)) {
+    release();
+    return false;
+  }
+  return loadWAV(src, sec);
+}
+
+bool StreamBuffer::loadOGG(const char *filename, double sec)
+{
+  DataSource src;
+  if (!openFileSource(src, filename)) {
+    release();
+    return false;
+  }
+  return loadOGG(src, sec);
+}
+
+bool StreamBuffer::loadWAV(DataSource &src, double sec)
 {
   // Release and alloc new sdata. This will be sole owner
   // of sdata so no lock is needed.
   release();
   if (!allocData()) { // failed to allocate
+    closeSource(src);
     return false;
   }
 
   // call release on error
   auto err_cleanup = makeScopeExit([this]() { release(); });
 
-  KameMix_WavResult wav_result = KameMix_wavOpen(&wf, filename);
+  // closes src on error
+  KameMix_WavResult wav_result = KameMix_wavOpenIO(&wf, &src.io, 
+                                                   src.userdata);
   if (wav_result != KameMix_WAV_OK) {
     return false;
   }
@@ -146,18 +168,21 @@ bool StreamBuffer::loadWAV(const char *filename, double sec)
   return false;
 }
 
-bool StreamBuffer::loadOGG(const char *filename, double sec)
+bool StreamBuffer::loadOGG(DataSource &src, double sec)
 {
   // Release and alloc new sdata. This will be sole owner
   // of sdata so no lock is needed.
   release();
   if (!allocData()) { // failed to allocate
+    closeSource(src);
     return false;
   }
   // call release on error
   auto err_cleanup = makeScopeExit([this]() { release(); });
 
-  if (ov_fopen(filename, &vf) != 0) {
+  // vf keeps a pointer to vorbis_src, and closes it in ov_clear
+  vorbis_src = src;
+  if (openOGG(vf, vorbis_src) != 0) { // closes vorbis_src on error
     return false;
   }
 
@@ -204,7 +229,7 @@ bool StreamBuffer::loadOGG(const char *filename, double sec)
 void StreamBuffer::calcTime()
 {
   const double freq = KameMix_getFrequency();
-  const int block_size = KameMix_getFormatSize() * channels;
+  const int block_size = sampleBlockSize();
 
   // stream ended in buffer2
   if (end_pos2 != -1) {
@@ -416,7 +441,8 @@ StreamResult StreamBuffer::swapBuffers()
 
 void StreamBuffer::swapBuffersImpl() 
 {
-  std::lock_guard<std::mutex> guard(mutex);
+  rtLock(mutex); // reports waiting in audio thread
+  std::lock_guard<std::mutex> guard(mutex, std::adopt_lock);
   time = time2;
   time2 = 0.0;
   end_pos = end_pos2;
@@ -439,11 +465,11 @@ int readMoreOGG(OggVorbis_File &vf, uint8_t *buffer, int buf_len,
   using namespace KameMix;
   end_pos = -1;
   const int dst_freq = KameMix_getFrequency();
-  // Only float output supported for now
+  // Only converts frequency, since streams are stored as float
   const SDL_AudioFormat src_format = AUDIO_F32SYS;
-  const SDL_AudioFormat dst_format = getOutputFormat();
+  const SDL_AudioFormat dst_format = AUDIO_F32SYS;
   const int bytes_per_src_block = sizeof(float) * channels;
-  const int bytes_per_dst_block = KameMix_getFormatSize() * channels;
+  const int bytes_per_dst_block = sizeof(float) * channels;
 
   int stream_idx; 
   int64_t offset;
@@ -597,8 +623,8 @@ int readMoreWAV(KameMix_WavFile &wf, uint8_t *buffer, int buf_len,
   end_pos = -1;
   const int dst_freq = KameMix_getFrequency();
   const SDL_AudioFormat src_format = WAV_formatToSDL(wf.format);
-  const SDL_AudioFormat dst_format = getOutputFormat();
-  const int bytes_per_block = KameMix_getFormatSize() * channels;
+  const SDL_AudioFormat dst_format = AUDIO_F32SYS;
+  const int bytes_per_block = sizeof(float) * channels;
 
   SDL_AudioCVT cvt;
   if (SDL_BuildAudioCVT(&cvt, src_format, wf.num_channels, wf.sample_rate, 
@@ -3,6 +3,7 @@
 
 #include "KameMix.h"
 #include "wav_loader.h"
+#include "data_source.h"
 #include <vorbis/vorbisfile.h>
 #include <cstdint>
 #include <cstddef>
@@ -39,13 +40,13 @@ readMore/setPos: time2, buffer2, buffer_size2, end_pos2, pos_set, error
 
 class StreamBuffer {
 public:
-  StreamBuffer() : total_time{0.0}, time{0.0}, time2{0.0}, buffer{nullptr},
+  StreamBuffer() : type{InvalidType}, total_time{0.0}, time{0.0}, time2{0.0}, buffer{nullptr},
     buffer2{nullptr}, buffer_size{0}, buffer_size2{0}, end_pos{-1}, 
     end_pos2{-1}, channels{0}, fully_buffered{false}, 
     pos_set{false}, error{false}  {  }
 
   explicit StreamBuffer(const char *filename, double sec = 0.0) 
-    : total_time{0.0}, time{0.0}, time2{0.0}, buffer{nullptr},
+    : type{InvalidType}, total_time{0.0}, time{0.0}, time2{0.0}, buffer{nullptr},
     buffer2{nullptr}, buffer_size{0}, buffer_size2{0}, end_pos{-1}, 
     end_pos2{-1}, channels{0}, fully_buffered{false}, 
     pos_set{false}, error{false}  
@@ -65,14 +66,23 @@ public:
 
   // Load WAV file starting as position 'sec' in seconds. 
   // Returns true on success.
-
   bool loadWAV(const char *filename, double sec = 0.0);
+
+  // Load audio file read from src starting at position 'sec' in seconds.
+  // The file type is detected from its header. src is owned by the
+  // StreamBuffer on success, and closed on error. Returns true on success.
+  bool load(DataSource &src, double sec = 0.0);
+  bool loadOGG(DataSource &src, double sec = 0.0);
+  bool loadWAV(DataSource &src, double sec = 0.0);
   
   bool isLoaded() const { return buffer != nullptr; }
 
   // Frees loaded audio data. isLoaded() returns false after this.
   void release();
 
+  // Size in bytes of audio data allocated by each loaded StreamBuffer.
+  static int dataSize();
+
   // true if entire file is buffered. readMore()/setPos() do nothing if true.
   bool fullyBuffered() const { return fully_buffered; }
 
@@ -117,8 +127,9 @@ public:
   // Returns 1 for mono, 2 for stereo.
   int numChannels() const { return channels; }
 
-  // Returns size of audio format * number of channels in bytes.
-  int sampleBlockSize() const { return channels * KameMix_getFormatSize(); }
+  // Returns size of float * number of channels in bytes. Streams are always
+  // stored as float samples, which are mixed without conversion.
+  int sampleBlockSize() const { return channels * (int)sizeof(float); }
 
   // Lock to safely call data(), size(), time(), endPos(), startPos(),
   // or getPos(), while an advance(), updatePos(), or swapBuffers() may be
@@ -186,6 +197,8 @@ private:
     OggVorbis_File vf;
     KameMix_WavFile wf;
   };
+  DataSource vorbis_src; // read by vf, which must not be moved
+
   double total_time; // total stream time in seconds
   double time; // current time in seconds
   double time2; // current time of buffer2 in seconds
@@ -0,0 +1,186 @@
+#include "voice_filter.h"
+#include "audio_mem.h"
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+namespace {
+
+using namespace KameMix;
+
+// Passes audio through unchanged
+const FilterCoeffs IDENTITY_COEFFS = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+
+// State below this is flushed to 0, so filters ringing down to silence
+// don't slow down on denormals.
+const float STATE_FLOOR = 1e-15f;
+
+// coeffs within this of passing through are done turning off
+const float IDENTITY_EPSILON = 1e-4f;
+
+// Returns coefficients of type at cutoff and q. Biquads are from the
+// Audio EQ Cookbook, by Robert Bristow-Johnson.
+FilterCoeffs filterCoeffs(KameMix_FilterType type, float cutoff, float q,
+                          int frequency)
+{
+  const double pi = 3.14159265358979323846;
+  cutoff = std::min(std::max(cutoff, 10.0f), frequency * 0.49f);
+  q = std::max(q, 0.1f);
+  const double w0 = 2.0 * pi * cutoff / frequency;
+  FilterCoeffs c = IDENTITY_COEFFS;
+
+  if (type == KameMix_FilterLowPass1 || type == KameMix_FilterHighPass1) {
+    // y[n] = y[n-1] + a*(x[n] - y[n-1]), and high pass is x minus that
+    const float pole = (float)std::exp(-w0);
+    if (type == KameMix_FilterLowPass1) {
+      c.b0 = 1.0f - pole;
+      c.b1 = 0.0f;
+    } else {
+      c.b0 = pole;
+      c.b1 = -pole;
+    }
+    c.a1 = -pole;
+    return c;
+  } else if (type == KameMix_FilterNone) {
+    return c;
+  }
+
+  const double cos_w0 = std::cos(w0);
+  const double alpha = std::sin(w0) / (2.0 * q);
+  const double a0 = 1.0 + alpha;
+  double b0, b1, b2;
+  switch (type) {
+  case KameMix_FilterLowPass:
+    b0 = (1.0 - cos_w0) / 2.0;
+    b1 = 1.0 - cos_w0;
+    b2 = b0;
+    break;
+  case KameMix_FilterHighPass:
+    b0 = (1.0 + cos_w0) / 2.0;
+    b1 = -(1.0 + cos_w0);
+    b2 = b0;
+    break;
+  default: // KameMix_FilterBandPass, 0 dB peak
+    b0 = alpha;
+    b1 = 0.0;
+    b2 = -alpha;
+    break;
+  }
+  c.b0 = (float)(b0 / a0);
+  c.b1 = (float)(b1 / a0);
+  c.b2 = (float)(b2 / a0);
+  c.a1 = (float)(-2.0 * cos_w0 / a0);
+  c.a2 = (float)((1.0 - alpha) / a0);
+  return c;
+}
+
+inline
+float approach(float from, float to, float amount)
+{
+  return from + (to - from) * amount;
+}
+
+inline
+bool isNear(const FilterCoeffs &a, const FilterCoeffs &b)
+{
+  return std::abs(a.b0 - b.b0) < IDENTITY_EPSILON &&
+    std::abs(a.b1 - b.b1) < IDENTITY_EPSILON &&
+    std::abs(a.b2 - b.b2) < IDENTITY_EPSILON &&
+    std::abs(a.a1 - b.a1) < IDENTITY_EPSILON &&
+    std::abs(a.a2 - b.a2) < IDENTITY_EPSILON;
+}
+
+inline
+float flushTiny(float val)
+{
+  return std::abs(val) < STATE_FLOOR ? 0.0f : val;
+}
+
+} // end anon namespace
+
+namespace KameMix {
+
+void VoiceFilter::reset()
+{
+  type = KameMix_FilterNone;
+  cutoff = 0.0f;
+  q = 0.0f;
+  target = IDENTITY_COEFFS;
+  coeffs = IDENTITY_COEFFS;
+  memset(&state, 0, sizeof(state));
+  active = false;
+}
+
+void VoiceFilter::set(KameMix_FilterType type_, float cutoff_, float q_,
+                      int frequency)
+{
+  type = type_;
+  cutoff = cutoff_;
+  q = q_;
+  target = filterCoeffs(type, cutoff, q, frequency);
+  if (!active && type != KameMix_FilterNone) {
+    coeffs = target;
+    memset(&state, 0, sizeof(state));
+    active = true;
+  }
+}
+
+void VoiceFilter::smooth(float amount)
+{
+  coeffs.b0 = approach(coeffs.b0, target.b0, amount);
+  coeffs.b1 = approach(coeffs.b1, target.b1, amount);
+  coeffs.b2 = approach(coeffs.b2, target.b2, amount);
+  coeffs.a1 = approach(coeffs.a1, target.a1, amount);
+  coeffs.a2 = approach(coeffs.a2, target.a2, amount);
+  if (type == KameMix_FilterNone && isNear(coeffs, IDENTITY_COEFFS)) {
+    reset(); // done turning off
+  }
+}
+
+FilterBatch::FilterBatch() : num{0}, block_frames{0}
+{
+  for (float *&buf : bufs) {
+    buf = nullptr;
+  }
+}
+
+FilterBatch::~FilterBatch()
+{
+  for (float *buf : bufs) {
+    km_free(buf);
+  }
+}
+
+void FilterBatch::init(int block_frames_)
+{
+  block_frames = block_frames_;
+  for (float *&buf : bufs) {
+    buf = (float*)km_malloc(block_frames * 2 * sizeof(float));
+  }
+}
+
+float* FilterBatch::add(const VoiceFilter &filter)
+{
+  assert(!isFull());
+  coeffs[num] = filter.coeffs;
+  state[num] = filter.state;
+  float *buf = bufs[num++];
+  memset(buf, 0, block_frames * 2 * sizeof(float));
+  return buf;
+}
+
+void FilterBatch::run(const MixKernels &kernels, int frames)
+{
+  kernels.filter_voices(bufs, coeffs, state, num, frames);
+}
+
+void FilterBatch::saveState(int i, VoiceFilter &filter) const
+{
+  for (int c = 0; c < 2; ++c) {
+    filter.state.z1[c] = flushTiny(state[i].z1[c]);
+    filter.state.z2[c] = flushTiny(state[i].z2[c]);
+  }
+}
+
+} // end namespace KameMix
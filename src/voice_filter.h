@@ -0,0 +1,75 @@
+#ifndef KAME_MIX_VOICE_FILTER_H
+#define KAME_MIX_VOICE_FILTER_H
+
+#include "KameMix.h"
+#include "mix_kernels.h"
+
+namespace KameMix {
+
+/*
+Filter stage of a voice from KameMix_setFilter. Every type is a biquad, so
+voices with different types can be filtered together. Setting the filter
+only changes target, and coeffs move toward it each block, so changing the
+cutoff every frame, like for distance, doesn't click. Turning the filter
+off moves coeffs toward passing audio through, and then deactivates it.
+*/
+struct VoiceFilter {
+  // Deactivates, with state cleared.
+  void reset();
+  // Sets target coefficients for type at cutoff Hz, with q for biquad
+  // types, at frequency. Starts at target if not active.
+  void set(KameMix_FilterType type, float cutoff, float q, int frequency);
+  // Moves coeffs amount of the way to target. Called once per block mixed.
+  void smooth(float amount);
+  bool isActive() const { return active; }
+
+  KameMix_FilterType type;
+  float cutoff;
+  float q;
+  FilterCoeffs target;
+  FilterCoeffs coeffs;
+  FilterState state;
+  bool active; // filtering, or smoothing toward no filter
+};
+
+/*
+Filtered voices mixed on one thread, copied to their own block buffers, so
+they can be filtered together with MixKernels::filter_voices. Each voice's
+samples are at its place in the block, with silence around them, so all
+are filtered for the whole block.
+*/
+class FilterBatch {
+public:
+  static const int MAX_VOICES = 8; // largest filtered together by kernels
+
+  FilterBatch();
+  ~FilterBatch();
+
+  // Allocates buffers of block_frames stereo frames.
+  void init(int block_frames);
+  int size() const { return num; }
+  bool isFull() const { return num == MAX_VOICES; }
+  // Adds voice filtered with filter's coeffs and state, and returns its
+  // silent block buffer. Must not be full.
+  float* add(const VoiceFilter &filter);
+  float* buffer(int i) { return bufs[i]; }
+  // Filters frames of each voice's buffer.
+  void run(const MixKernels &kernels, int frames);
+  // Copies state of voice i after run to filter.
+  void saveState(int i, VoiceFilter &filter) const;
+  void clear() { num = 0; }
+
+private:
+  FilterBatch(const FilterBatch &other) = delete;
+  FilterBatch& operator=(const FilterBatch &other) = delete;
+
+  float *bufs[MAX_VOICES];
+  FilterCoeffs coeffs[MAX_VOICES];
+  FilterState state[MAX_VOICES];
+  int num;
+  int block_frames;
+};
+
+} // end namespace KameMix
+
+#endif
@@ -0,0 +1,161 @@
+#include "vorbis_decoder.h"
+#include "vorbis_helper.h"
+#include "audio_mem.h"
+#include "sdl_helper.h"
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+// Number of sample frames decoded at once, before conversion.
+const int DECODE_FRAMES = 2048;
+
+} // end anon namespace
+
+namespace KameMix {
+
+bool VorbisDecoder::open(const uint8_t *data, int size, int channels_,
+                         double sec)
+{
+  release();
+  if (!openMemSource(src, data, size)) {
+    return false;
+  }
+
+  if (openOGG(vf, src) != 0) { // closes src on error
+    return false;
+  }
+  is_open = true;
+  channels = channels_;
+
+  // Size buffer for the largest conversion of all logical streams, so it
+  // never needs to grow while playing.
+  int max_len_mult = 1;
+  for (int i = 0, num_streams = ov_streams(&vf); i < num_streams; ++i) {
+    SDL_AudioCVT tmp_cvt;
+    if (!buildCVT(i, tmp_cvt)) {
+      release();
+      return false;
+    }
+    if (tmp_cvt.len_mult > max_len_mult) {
+      max_len_mult = tmp_cvt.len_mult;
+    }
+  }
+
+  buffer_size = DECODE_FRAMES * sizeof(float) * channels * max_len_mult;
+  buffer = (uint8_t*)km_malloc_(buffer_size);
+  if (!buffer) {
+    release();
+    return false;
+  }
+
+  if (sec > 0.0 && sec < ov_time_total(&vf, -1)) {
+    if (ov_time_seek(&vf, sec) != 0) {
+      release();
+      return false;
+    }
+  }
+
+  pos = 0;
+  end = 0;
+  bitstream = -1;
+  at_end = false;
+  return true;
+}
+
+void VorbisDecoder::release()
+{
+  if (is_open) {
+    ov_clear(&vf); // closes src
+    is_open = false;
+  }
+  km_free(buffer);
+  buffer = nullptr;
+  buffer_size = 0;
+  pos = 0;
+  end = 0;
+}
+
+bool VorbisDecoder::buildCVT(int stream_idx, SDL_AudioCVT &cvt_out)
+{
+  const int src_freq = ov_info(&vf, stream_idx)->rate;
+  return SDL_BuildAudioCVT(&cvt_out, AUDIO_F32SYS, channels, src_freq,
+                           AUDIO_F32SYS, channels, 
+                           KameMix_getFrequency()) >= 0;
+}
+
+bool VorbisDecoder::decode()
+{
+  pos = 0;
+  end = 0;
+  // pointer to array of channels, each channel is array of floats
+  float **channel_buf;
+  int stream_idx;
+  long samples_read;
+
+  do {
+    samples_read = ov_read_float(&vf, &channel_buf, DECODE_FRAMES,
+                                 &stream_idx);
+  } while (samples_read == OV_HOLE); // skip over corrupt data
+
+  if (samples_read == 0) {
+    at_end = true;
+    return true;
+  } else if (samples_read < 0) {
+    return false;
+  }
+
+  if (stream_idx != bitstream) {
+    if (!buildCVT(stream_idx, cvt)) {
+      return false;
+    }
+    bitstream = stream_idx;
+  }
+
+  float *dst = (float*)buffer;
+  if (channels == 1) { // src has only mono streams, so store as mono
+    memcpy(dst, *channel_buf, samples_read * sizeof(float));
+  } else if (ov_info(&vf, stream_idx)->channels > 1) {
+    // more than 1 channel but only care about 2
+    float *chan = *channel_buf;
+    float *chan2 = channel_buf[1];
+    float *chan_end = chan + samples_read;
+    while (chan != chan_end) {
+      *dst++ = *chan++;
+      *dst++ = *chan2++;
+    }
+  } else {
+    // this stream is mono, but store as stereo
+    float *chan = *channel_buf;
+    float *chan_end = chan + samples_read;
+    while (chan != chan_end) {
+      *dst++ = *chan;
+      *dst++ = *chan++;
+    }
+  }
+
+  const int src_len = (int)samples_read * sizeof(float) * channels;
+  if (cvt.needed) {
+    cvt.buf = buffer;
+    cvt.len = src_len;
+    if (SDL_ConvertAudio(&cvt) < 0) {
+      return false;
+    }
+    const int block_size = channels * sizeof(float);
+    end = (cvt.len_cvt / block_size) * block_size;
+  } else {
+    end = src_len;
+  }
+
+  return true;
+}
+
+bool VorbisDecoder::rewind()
+{
+  pos = 0;
+  end = 0;
+  at_end = false;
+  return ov_pcm_seek(&vf, 0) == 0;
+}
+
+} // end namespace KameMix
@@ -0,0 +1,74 @@
+#ifndef KAME_MIX_VORBIS_DECODER_H
+#define KAME_MIX_VORBIS_DECODER_H
+
+#include "KameMix.h"
+#include "data_source.h"
+#include <SDL_audio.h>
+#include <vorbis/vorbisfile.h>
+#include <cstdint>
+
+namespace KameMix {
+
+/*
+Decodes OGG Vorbis file data kept in memory in small chunks, for playing
+compressed Sounds. Each playing channel has its own VorbisDecoder, so the
+same Sound can be played many times at different positions. Decoded data is
+float samples in output frequency, with the number of channels passed to 
+open.
+*/
+class VorbisDecoder {
+public:
+  VorbisDecoder() : buffer{nullptr}, buffer_size{0}, pos{0}, end{0},
+    channels{0}, bitstream{-1}, at_end{false}, is_open{false} { }
+
+  ~VorbisDecoder() { release(); }
+
+  // Opens OGG file data, which must stay valid until release() is called,
+  // and seeks to 'sec' position in seconds. channels is 1 for mono or 2 for
+  // stereo output. Returns false on error.
+  bool open(const uint8_t *data, int size, int channels, double sec = 0.0);
+
+  // Closes file and frees decode buffer.
+  void release();
+
+  // Decodes next chunk into data(), replacing any data not consumed yet.
+  // Returns false on error. If the end of file was reached then atEnd()
+  // is true and size() is 0.
+  bool decode();
+
+  // Seeks to start of file. Returns false on error.
+  bool rewind();
+
+  bool atEnd() const { return at_end; }
+
+  // Returns pointer to decoded data not yet consumed.
+  uint8_t* data() { return buffer + pos; }
+
+  // Returns size in bytes of decoded data not yet consumed.
+  int size() const { return end - pos; }
+
+  // Marks len bytes of data() as used.
+  void consume(int len) { pos += len; }
+
+private:
+  VorbisDecoder(const VorbisDecoder &other) = delete;
+  VorbisDecoder& operator=(const VorbisDecoder &other) = delete;
+
+  bool buildCVT(int stream_idx, SDL_AudioCVT &cvt_out);
+
+  OggVorbis_File vf;
+  DataSource src; // read by vf
+  SDL_AudioCVT cvt; // converts from current bitstream's frequency
+  uint8_t *buffer;
+  int buffer_size;
+  int pos; // byte pos of first unused decoded sample
+  int end; // byte pos past last decoded sample
+  int channels;
+  int bitstream; // current logical stream, or -1 if not decoded yet
+  bool at_end;
+  bool is_open;
+};
+
+} // end namespace KameMix
+
+#endif
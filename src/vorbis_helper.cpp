@@ -7,9 +7,8 @@ namespace {
 
 inline
 int64_t convertedSize(int src_freq, SDL_AudioFormat src_format, 
-                      int channels, int64_t blocks)
+                      int channels, int64_t blocks, int dst_freq)
 {
-  const int dst_freq = KameMix_getFrequency(); 
   const SDL_AudioFormat dst_format = KameMix::getOutputFormat();
   const int format_size = SDL_AUDIO_BITSIZE(src_format) / 8;
   const int bytes_per_block = channels * format_size;
@@ -23,10 +22,49 @@ int64_t convertedSize(int src_freq, SDL_AudioFormat src_format,
   return blocks * bytes_per_block * cvt.len_mult;
 }
 
+size_t readOGG(void *ptr, size_t size, size_t nmemb, void *datasource)
+{
+  return KameMix::readSource(*(KameMix::DataSource*)datasource, 
+                             ptr, size, nmemb);
+}
+
+int seekOGG(void *datasource, ogg_int64_t offset, int whence)
+{
+  return KameMix::seekSource(*(KameMix::DataSource*)datasource, 
+                             offset, whence);
+}
+
+int closeOGG(void *datasource)
+{
+  KameMix::closeSource(*(KameMix::DataSource*)datasource);
+  return 0;
+}
+
+long tellOGG(void *datasource)
+{
+  return (long)KameMix::tellSource(*(KameMix::DataSource*)datasource);
+}
+
 } // end anon namespace
 
 namespace KameMix {
 
+int openOGG(OggVorbis_File &vf, DataSource &src)
+{
+  ov_callbacks callbacks;
+  callbacks.read_func = readOGG;
+  callbacks.seek_func = seekOGG;
+  callbacks.close_func = closeOGG;
+  callbacks.tell_func = tellOGG;
+
+  int result = ov_open_callbacks(&src, &vf, NULL, 0, callbacks);
+  // src isn't closed by libvorbisfile on failure
+  if (result != 0) {
+    closeSource(src);
+  }
+  return result;
+}
+
 void getStreamAndOffset(OggVorbis_File &vf, int &bitstream, int64_t &offset)
 {
   const int num_bitstreams = ov_streams(&vf);
@@ -56,7 +94,7 @@ bool isMonoOGG(OggVorbis_File &vf)
 // return bufsize to fill data from OGG file.
 // returns -1 if an error occured
 int64_t calcBufSizeOGG(OggVorbis_File &vf, int channels, 
-                       bool float_format)
+                       bool float_format, int dst_freq)
 {
   SDL_AudioFormat format = float_format ? AUDIO_F32SYS : AUDIO_S16SYS;
   int64_t buf_len = 0;
@@ -65,14 +103,16 @@ int64_t calcBufSizeOGG(OggVorbis_File &vf, int channels,
   for (int i = 1, end = ov_streams(&vf); i < end; ++i) {
     int src_freq = ov_info(&vf, i)->rate;
     if (src_freq != last_src_freq) {
-      buf_len += convertedSize(last_src_freq, format, channels, num_blocks);
+      buf_len += convertedSize(last_src_freq, format, channels, num_blocks,
+                               dst_freq);
       num_blocks = 0;
       last_src_freq = src_freq;
     }
     num_blocks += ov_pcm_total(&vf, i);
   }
 
-  buf_len += convertedSize(last_src_freq, format, channels, num_blocks);
+  buf_len += convertedSize(last_src_freq, format, channels, num_blocks,
+                           dst_freq);
   return buf_len;
 }
 
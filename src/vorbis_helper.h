@@ -1,16 +1,23 @@
 #ifndef KAME_MIX_VORBIS_HELPER_H
 #define KAME_MIX_VORBIS_HELPER_H
 
+#include "data_source.h"
 #include <vorbis/vorbisfile.h>
 
 namespace KameMix {
 
+// Opens vf reading from src with ov_open_callbacks. src must stay valid until
+// ov_clear is called, which closes src. src is closed on error.
+// Returns 0 on success, like ov_open_callbacks.
+int openOGG(OggVorbis_File &vf, DataSource &src);
+
 void getStreamAndOffset(OggVorbis_File &vf, int &bitstream, 
                         int64_t &offset);
 bool isMonoOGG(OggVorbis_File &vf);
-// return bufsize to fill data from OGG file.
+// return bufsize to fill data from OGG file converted to dst_freq.
 // returns -1 if an error occured
-int64_t calcBufSizeOGG(OggVorbis_File &vf, int channels, bool float_format);
+int64_t calcBufSizeOGG(OggVorbis_File &vf, int channels, bool float_format,
+                       int dst_freq);
 
 } // namespace KameMix
 
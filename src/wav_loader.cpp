@@ -1,39 +1,58 @@
-#define _FILE_OFFSET_BITS 64 // for fseeko
-
 #include "wav_loader.h"
+#include "data_source.h"
+#include "audio_mem.h"
+#include "adpcm.h"
 #include "scope_exit.h"
 #include <cstring>
 #include <cstdio>
 
 using namespace KameMix;
 
+const uint16_t WAV_FMT_PCM = 1;
+const uint16_t WAV_FMT_MS_ADPCM = 2;
+const uint16_t WAV_FMT_FLOAT = 3;
+const uint16_t WAV_FMT_IMA_ADPCM = 17;
+
+struct KameMix_WavADPCM {
+  uint8_t *block; // ADPCM block read from file
+  int16_t *pcm; // decoded block
+  uint32_t data_size; // size of ADPCM data chunk
+  uint32_t data_pos; // byte pos in ADPCM data chunk
+  uint32_t pcm_pos; // byte pos of first unread sample in pcm
+  uint32_t pcm_len; // bytes decoded in pcm
+  uint16_t fmt_code;
+  uint16_t block_align;
+  int block_frames;
+  int num_coefs; // only for MS ADPCM
+  int16_t coefs[MS_ADPCM_MAX_COEFS][2];
+};
+
 namespace {
 
 inline
-int64_t fseekWrapper(FILE *file, int64_t offset, int origin)
+size_t wavReadRaw(KameMix_WavFile &wf, void *ptr, size_t len)
 {
-#ifdef _WIN32
-  return _fseeki64(file, offset, origin);
-#else
-  return fseeko(file, offset, origin); 
-#endif
+  return wf.io.read(ptr, 1, len, wf.userdata);
 }
 
 inline
-int64_t ftellWrapper(FILE *file)
+int wavSeekRaw(KameMix_WavFile &wf, int64_t offset, int whence)
 {
-#ifdef _WIN32
-  return _ftelli64(file);
-#else
-  return ftello(file); 
-#endif
+  return wf.io.seek(wf.userdata, offset, whence);
+}
+
+inline
+void wavCloseRaw(KameMix_WavFile &wf)
+{
+  if (wf.io.close) {
+    wf.io.close(wf.userdata);
+  }
 }
 
 bool readID(KameMix_WavFile &wf, const char *id)
 {
   char chunk_id[5];
-  FILE *file = (FILE*)wf.file;
-  size_t num_read = fread(chunk_id, 1, 4, file);
+  size_t num_read = wavReadRaw(wf, chunk_id, 4);
   if (num_read != 4) {
     return false;
   }
@@ -47,8 +66,7 @@ bool readID(KameMix_WavFile &wf, const char *id)
 template <class T>
 bool readNum(KameMix_WavFile &wf, T &out)
 {
-  FILE *file = (FILE*)wf.file;
-  size_t num_read = fread(&out, 1, sizeof(T), file);
+  size_t num_read = wavReadRaw(wf, &out, sizeof(T));
   if (num_read != sizeof(T)) {
     return false;
   }
@@ -56,11 +74,163 @@ bool readNum(KameMix_WavFile &wf, T &out)
   return true;
 }
 
+void freeADPCM(KameMix_WavFile &wf)
+{
+  if (wf.adpcm) {
+    km_free(wf.adpcm->block);
+    km_free(wf.adpcm->pcm);
+    km_free(wf.adpcm);
+    wf.adpcm = nullptr;
+  }
+}
+
+// Reads rest of ADPCM format chunk after bits_per_sample, and allocates
+// wf.adpcm. bytes_read is set to number of bytes read from chunk.
+KameMix_WavResult readADPCMFormat(KameMix_WavFile &wf, uint16_t fmt_code,
+                                  uint16_t block_align, 
+                                  uint16_t bits_per_sample, 
+                                  uint32_t &bytes_read)
+{
+  bytes_read = 0;
+  if (bits_per_sample != 4 || wf.num_channels > 2) {
+    return KameMix_WAV_UnsupportedFormat;
+  }
+
+  const int block_frames = fmt_code == WAV_FMT_IMA_ADPCM ?
+    imaWavBlockFrames(block_align, wf.num_channels) :
+    msWavBlockFrames(block_align, wf.num_channels);
+  if (block_frames == 0) {
+    return KameMix_WAV_BadHeader;
+  }
+
+  // cbSize then samples per block, which is calculated from block_align
+  uint16_t extra_size;
+  uint16_t samples_per_block;
+  if (!readNum(wf, extra_size) || !readNum(wf, samples_per_block)) {
+    return KameMix_WAV_BadHeader;
+  }
+  bytes_read += 4;
+
+  wf.adpcm = (KameMix_WavADPCM*)km_malloc_(sizeof(KameMix_WavADPCM));
+  if (!wf.adpcm) {
+    return KameMix_WAV_UnsupportedFormat;
+  }
+  KameMix_WavADPCM &adpcm = *wf.adpcm;
+  adpcm.block = nullptr;
+  adpcm.pcm = nullptr;
+  adpcm.data_size = 0;
+  adpcm.data_pos = 0;
+  adpcm.pcm_pos = 0;
+  adpcm.pcm_len = 0;
+  adpcm.fmt_code = fmt_code;
+  adpcm.block_align = block_align;
+  adpcm.block_frames = block_frames;
+  adpcm.num_coefs = 0;
+
+  if (fmt_code == WAV_FMT_MS_ADPCM) {
+    uint16_t num_coefs;
+    if (!readNum(wf, num_coefs) || num_coefs == 0 ||
+        num_coefs > MS_ADPCM_MAX_COEFS) {
+      return KameMix_WAV_BadHeader;
+    }
+    bytes_read += 2;
+    for (int i = 0; i < num_coefs; ++i) {
+      if (!readNum(wf, adpcm.coefs[i][0]) || 
+          !readNum(wf, adpcm.coefs[i][1])) {
+        return KameMix_WAV_BadHeader;
+      }
+      bytes_read += 4;
+    }
+    adpcm.num_coefs = num_coefs;
+  }
+
+  adpcm.block = (uint8_t*)km_malloc_(block_align);
+  adpcm.pcm = 
+    (int16_t*)km_malloc_(block_frames * wf.num_channels * sizeof(int16_t));
+  if (!adpcm.block || !adpcm.pcm) {
+    return KameMix_WAV_UnsupportedFormat;
+  }
+
+  return KameMix_WAV_OK;
+}
+
+// Returns number of frames in a block of block_bytes from data chunk. Last
+// block can be shorter than block_align.
+int adpcmBlockFrames(const KameMix_WavFile &wf, int block_bytes)
+{
+  if (wf.adpcm->fmt_code == WAV_FMT_IMA_ADPCM) {
+    return imaWavBlockFrames(block_bytes, wf.num_channels);
+  }
+  return msWavBlockFrames(block_bytes, wf.num_channels);
+}
+
+// Reads and decodes next ADPCM block into wf.adpcm->pcm. Returns false
+// at end of data or on error.
+bool adpcmReadBlock(KameMix_WavFile &wf)
+{
+  KameMix_WavADPCM &adpcm = *wf.adpcm;
+  adpcm.pcm_pos = 0;
+  adpcm.pcm_len = 0;
+
+  uint32_t block_bytes = adpcm.data_size - adpcm.data_pos;
+  if (block_bytes > adpcm.block_align) {
+    block_bytes = adpcm.block_align;
+  }
+  if (block_bytes == 0) {
+    return false;
+  }
+
+  const size_t num_read = wavReadRaw(wf, adpcm.block, block_bytes);
+  adpcm.data_pos += (uint32_t)num_read;
+  int frames;
+  if (adpcm.fmt_code == WAV_FMT_IMA_ADPCM) {
+    frames = decodeImaWavBlock(adpcm.block, (int)num_read, wf.num_channels, 
+                               adpcm.pcm);
+  } else {
+    frames = decodeMsWavBlock(adpcm.block, (int)num_read, wf.num_channels, 
+                              adpcm.coefs, adpcm.num_coefs, adpcm.pcm);
+  }
+  if (frames <= 0) {
+    return false;
+  }
+
+  adpcm.pcm_len = frames * wf.num_channels * sizeof(int16_t);
+  return true;
+}
+
+int64_t adpcmRead(KameMix_WavFile &wf, uint8_t *buf, uint32_t buf_len)
+{
+  KameMix_WavADPCM &adpcm = *wf.adpcm;
+  uint32_t total_read = 0;
+
+  while (total_read < buf_len) {
+    if (adpcm.pcm_pos == adpcm.pcm_len) {
+      if (!adpcmReadBlock(wf)) {
+        // file is shorter than its data chunk size, or has a bad block, 
+        // so treat as end of data
+        wf.stream_size = wf.stream_pos + total_read;
+        break;
+      }
+    }
+
+    uint32_t len = adpcm.pcm_len - adpcm.pcm_pos;
+    if (len > buf_len - total_read) {
+      len = buf_len - total_read;
+    }
+    memcpy(buf + total_read, (uint8_t*)adpcm.pcm + adpcm.pcm_pos, len);
+    adpcm.pcm_pos += len;
+    total_read += len;
+  }
+
+  wf.stream_pos += total_read;
+  return total_read;
+}
+
 KameMix_WavResult readHeaders(KameMix_WavFile &wf)
 {
-  FILE *file = (FILE*)wf.file;
-  auto file_cleanup = makeScopeExit([file]() {
-    fclose(file);
+  auto file_cleanup = makeScopeExit([&wf]() {
+    freeADPCM(wf);
+    wavCloseRaw(wf);
   });
 
   if (!readID(wf, "RIFF")) {
@@ -81,7 +251,7 @@ KameMix_WavResult readHeaders(KameMix_WavFile &wf)
     if (!readNum(wf, chunk_size)) {
       return KameMix_WAV_BadHeader;
     }
-    fseekWrapper(file, chunk_size, SEEK_CUR);
+    wavSeekRaw(wf, chunk_size, SEEK_CUR);
   }
 
   // after 'fmt ' now
@@ -89,21 +259,28 @@ KameMix_WavResult readHeaders(KameMix_WavFile &wf)
     return KameMix_WAV_BadHeader;
   }
 
-  if (chunk_size != 16 && chunk_size != 18 && chunk_size != 40) {
-    return KameMix_WAV_BadHeader;
-  }
-  
+  const uint32_t fmt_size = chunk_size;
   uint16_t fmt_code;
   if (!readNum(wf, fmt_code)) {
     return KameMix_WAV_BadHeader;
   }
-  // not PCM or float
-  if (fmt_code != 1 && fmt_code != 3) {
+
+  const bool is_adpcm = 
+    fmt_code == WAV_FMT_MS_ADPCM || fmt_code == WAV_FMT_IMA_ADPCM;
+  if (is_adpcm) {
+    if (fmt_size < 20) {
+      return KameMix_WAV_BadHeader;
+    }
+  } else if (fmt_code == WAV_FMT_PCM || fmt_code == WAV_FMT_FLOAT) {
+    if (fmt_size != 16 && fmt_size != 18 && fmt_size != 40) {
+      return KameMix_WAV_BadHeader;
+    }
+  } else {
     return KameMix_WAV_UnsupportedFormat;
   }
  
   uint16_t num_channels;
-  if (!readNum(wf, num_channels)) {
+  if (!readNum(wf, num_channels) || num_channels == 0) {
     return KameMix_WAV_BadHeader;
   }
   wf.num_channels = (uint8_t)num_channels;
@@ -128,7 +305,17 @@ KameMix_WavResult readHeaders(KameMix_WavFile &wf)
   if (!readNum(wf, bits_per_sample)) {
     return KameMix_WAV_BadHeader;
   }
-  if (fmt_code == 1) {
+  uint32_t fmt_read = 16; // bytes of format chunk read
+  if (is_adpcm) {
+    uint32_t bytes_read;
+    KameMix_WavResult result = readADPCMFormat(wf, fmt_code, block_align,
+                                               bits_per_sample, bytes_read);
+    if (result != KameMix_WAV_OK) {
+      return result;
+    }
+    fmt_read += bytes_read;
+    wf.format = KameMix_WAV_S16; // decoded while reading
+  } else if (fmt_code == WAV_FMT_PCM) {
     if (bits_per_sample == 8) {
       wf.format = KameMix_WAV_U8;
     } else if (bits_per_sample == 16) {
@@ -145,8 +332,8 @@ KameMix_WavResult readHeaders(KameMix_WavFile &wf)
   }
 
   // if there was extension data in format chunk, just skip it
-  if (chunk_size > 16) {
-    fseekWrapper(file, chunk_size-16, SEEK_CUR);
+  if (fmt_size > fmt_read) {
+    wavSeekRaw(wf, fmt_size - fmt_read, SEEK_CUR);
   }
 
   // skip all chunks until 'data'
@@ -154,14 +341,27 @@ KameMix_WavResult readHeaders(KameMix_WavFile &wf)
     if (!readNum(wf, chunk_size)) {
       return KameMix_WAV_BadHeader;
     }
-    fseekWrapper(file, chunk_size, SEEK_CUR);
+    wavSeekRaw(wf, chunk_size, SEEK_CUR);
   }
 
   if (!readNum(wf, chunk_size)) {
     return KameMix_WAV_BadHeader;
   }
-  wf.stream_size = chunk_size;
-  int64_t stream_start = ftellWrapper(file);
+  if (wf.adpcm) {
+    // stream_size is size of decoded samples, and last ADPCM block can be 
+    // shorter than block_align
+    const uint32_t block_align = wf.adpcm->block_align;
+    const uint32_t last_block = chunk_size % block_align;
+    const uint32_t frames = (chunk_size / block_align) * 
+      wf.adpcm->block_frames + adpcmBlockFrames(wf, last_block);
+    wf.adpcm->data_size = chunk_size;
+    wf.stream_size = frames * KameMix_wavBlockSize(&wf);
+  } else {
+    // ignore partial block at end, so stream_pos can reach stream_size
+    wf.stream_size = 
+      (chunk_size / KameMix_wavBlockSize(&wf)) * KameMix_wavBlockSize(&wf);
+  }
+  int64_t stream_start = wf.io.tell(wf.userdata);
   if (stream_start < 0) {
     return KameMix_WAV_BadHeader;
   }
@@ -177,18 +377,28 @@ extern "C" {
 
 KameMix_WavResult KameMix_wavOpen(KameMix_WavFile *wf, const char *filename)
 {
-  FILE *file = fopen(filename, "rb");
-  if (!file) {
+  DataSource src;
+  if (!openFileSource(src, filename)) {
     return KameMix_WAV_FileOpenError;
   }
   
-  wf->file = file;
-  return readHeaders(*wf); // calls flose on erro
+  return KameMix_wavOpenIO(wf, &src.io, src.userdata);
+}
+
+KameMix_WavResult KameMix_wavOpenIO(KameMix_WavFile *wf, const KameMix_IO *io,
+                                    void *userdata)
+{
+  wf->io = *io;
+  wf->userdata = userdata;
+  wf->adpcm = NULL;
+  wf->stream_pos = 0;
+  return readHeaders(*wf); // calls io->close on error
 }
 
 void KameMix_wavClose(KameMix_WavFile *wf)
 {
-  fclose((FILE*)wf->file);
+  freeADPCM(*wf);
+  wavCloseRaw(*wf);
 }
 
 int KameMix_wavBlockSeek(KameMix_WavFile *wf, uint32_t block)
@@ -196,11 +406,33 @@ int KameMix_wavBlockSeek(KameMix_WavFile *wf, uint32_t block)
   uint32_t byte_offset = KameMix_wavBlockSize(wf) * block;
   if (byte_offset >= wf->stream_size) {
     byte_offset = 0;
+    block = 0;
+  }
+
+  if (wf->adpcm) {
+    // seek to start of ADPCM block, and skip frames before block in it
+    KameMix_WavADPCM &adpcm = *wf->adpcm;
+    const uint32_t adpcm_block = block / adpcm.block_frames;
+    adpcm.data_pos = adpcm_block * adpcm.block_align;
+    adpcm.pcm_pos = 0;
+    adpcm.pcm_len = 0;
+    if (wavSeekRaw(*wf, (int64_t)wf->stream_start + adpcm.data_pos, 
+                   SEEK_SET) != 0) {
+      return 0;
+    }
+    if (!adpcmReadBlock(*wf)) {
+      return 0;
+    }
+    adpcm.pcm_pos = (block % adpcm.block_frames) * KameMix_wavBlockSize(wf);
+    if (adpcm.pcm_pos > adpcm.pcm_len) {
+      return 0;
+    }
+    wf->stream_pos = byte_offset;
+    return 1;
   }
 
-  FILE *file = (FILE*)wf->file;
-  if (fseekWrapper(file, wf->stream_start + byte_offset, SEEK_SET) != 0) {
-    clearerr(file);
+  if (wavSeekRaw(*wf, (int64_t)wf->stream_start + byte_offset, 
+                 SEEK_SET) != 0) {
     return 0;
   }
 
@@ -213,15 +445,21 @@ int64_t KameMix_wavRead(KameMix_WavFile *wf, uint8_t *buf,
 {
   const int block_size = KameMix_wavBlockSize(wf);
   buf_len = (buf_len / block_size) * block_size;
-  FILE *file = (FILE*)wf->file;
-  uint32_t num_read = (uint32_t)fread(buf, 1, buf_len, file);
+  // don't read past data chunk into trailing chunks
+  const uint32_t bytes_left = wf->stream_size - wf->stream_pos;
+  if (buf_len > bytes_left) {
+    buf_len = (bytes_left / block_size) * block_size;
+  }
+  if (wf->adpcm) {
+    return adpcmRead(*wf, buf, buf_len);
+  }
+
+  uint32_t num_read = (uint32_t)wavReadRaw(*wf, buf, buf_len);
   
+  // file is shorter than its data chunk size, so treat as end of data
   if (num_read < buf_len) {
-    if (feof(file) == 0) { // not eof, so there was an error
-      clearerr(file);
-      return -1;
-    }
-    clearerr(file); // clear eof
+    num_read = (num_read / block_size) * block_size;
+    wf->stream_size = wf->stream_pos + num_read;
   }
 
   wf->stream_pos += num_read;
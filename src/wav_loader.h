@@ -1,6 +1,8 @@
 #ifndef KAME_MIX_WAV_LOADER_H
 #define KAME_MIX_WAV_LOADER_H
 
+#include "KameMix.h"
+
 #ifdef __cplusplus
 
 #include <cstdint>
@@ -14,12 +16,17 @@ extern "C" {
 #endif
 
 
+// Format of samples returned by KameMix_wavRead. ADPCM files are decoded
+// to KameMix_WAV_S16 while reading.
 enum KameMix_WavFormat {
   KameMix_WAV_U8,
   KameMix_WAV_S16, // Little endian
   KameMix_WAV_Float // Little endian
 };
 
+// Decoder state for IMA or Microsoft ADPCM files
+struct KameMix_WavADPCM;
+
 enum KameMix_WavResult {
   KameMix_WAV_OK = 0,
   KameMix_WAV_FileOpenError = -1,
@@ -43,8 +50,11 @@ const char* KameMix_wavErrStr(KameMix_WavResult result)
   return "";
 }
 
+// stream_size and stream_pos are in bytes of decoded samples.
 struct KameMix_WavFile {
-  void *file;  
+  KameMix_IO io;
+  void *userdata;
+  KameMix_WavADPCM *adpcm; // NULL if not ADPCM
   uint32_t stream_start;
   uint32_t stream_size;
   uint32_t stream_pos;
@@ -54,6 +64,9 @@ struct KameMix_WavFile {
 };
 
 KameMix_WavResult KameMix_wavOpen(KameMix_WavFile *wf, const char *file);
+// io->close is called with userdata on error, or in KameMix_wavClose.
+KameMix_WavResult KameMix_wavOpenIO(KameMix_WavFile *wf, const KameMix_IO *io,
+                                    void *userdata);
 void KameMix_wavClose(KameMix_WavFile *wf); 
 
 int64_t KameMix_wavRead(KameMix_WavFile *wf, uint8_t *buf, uint32_t buf_len);
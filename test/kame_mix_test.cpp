@@ -2,10 +2,16 @@
 #include "KameMix/sound.hpp"
 #include "KameMix/stream.hpp"
 #include <cmath>
+#include <cstdlib>
 #include <cassert>
 #include <thread>
 #include <chrono>
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <atomic>
 
 using KameMix::Sound;
 using KameMix::Stream;
@@ -31,6 +37,42 @@ void test4();
 void test5();
 void test6();
 void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+
+// Like assert, but also checked when built with NDEBUG, like the makefile 
+// does, so calls and results only kept to check aren't compiled out
+inline
+void check(bool ok, const char *what)
+{
+  if (!ok) {
+    cerr << "Check failed: " << what << "\n";
+    exit(EXIT_FAILURE);
+  }
+}
 
 inline
 void sleep_ms(double msec)
@@ -39,11 +81,25 @@ void sleep_ms(double msec)
   std::this_thread::sleep_for(sleep_duration);
 }
 
+void getTestInitOptions(KameMix_InitOptions *options)
+{
+  KameMix_getDefaultInitOptions(options);
+  //options->format = KameMix_OutputS16;
+  options->use_pool = 1;
+  options->pool_streams = 2;
+  options->max_voices = 32;
+  options->max_groups = 8;
+  options->debug_alloc_check = 1;
+  // small device buffer, with 1024 frames mixed ahead in blocks of 128
+  options->sample_buf_size = 512;
+  options->mix_ahead_frames = 1024;
+}
+
 int main(int argc, char *argv[])
 {
-  //KameMix_OutputFormat format = KameMix_OutputS16;
-  KameMix_OutputFormat format = KameMix_OutputFloat;
-  if (!KameMix_init(44100, 2048, format)) {
+  KameMix_InitOptions options;
+  getTestInitOptions(&options);
+  if (!KameMix_initEx(&options)) {
     cout << "System::init failed\n";
     return 1;
   }
@@ -87,6 +143,31 @@ int main(int argc, char *argv[])
   test5();
   test6();
   test7();
+  test8();
+  test9();
+  test10();
+  test11();
+  test12();
+  test13();
+  test14();
+  test15();
+  test16();
+  test17();
+  test18();
+  test19();
+  test20();
+  test21();
+  test22();
+  test23();
+  test24();
+  test25();
+  test26();
+  test27();
+  test28();
+  test29();
+  test30();
+  test31();
+  test32();
 
   cout << "Test complete\n";
 
@@ -500,3 +581,1054 @@ void test7()
   sleep_ms(10000);
   cout << "Test7 complete\n";
 }
+
+static std::vector<char> readFile(const char *file_path)
+{
+  std::ifstream file(file_path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(file),
+                           std::istreambuf_iterator<char>());
+}
+
+void test8()
+{
+  cout << "\nTest 8: Tests loading sounds and streams from memory\n";
+
+  std::vector<char> cow_data = readFile("sound/cow.ogg");
+  std::vector<char> spell_data = readFile("sound/spell3.wav");
+  assert(!cow_data.empty() && !spell_data.empty());
+
+  Sound cow_mem;
+  cow_mem.loadMem(cow_data.data(), cow_data.size());
+  assert(cow_mem.isLoaded());
+  cow_data.clear(); // Sound data isn't needed after load
+
+  Stream spell_mem;
+  spell_mem.loadMem(spell_data.data(), spell_data.size());
+  assert(spell_mem.isLoaded());
+
+  assert(!Sound().loadMem("not audio", 9));
+
+  cout << "Play cow from memory twice\n";
+  cow_mem.play(1);
+  assert(cow_mem.isPlaying());
+  while (cow_mem.isPlaying()) {
+    sleep_ms(frame_ms);
+  }
+
+  cout << "Play spell3 stream from memory twice\n";
+  spell_mem.play(1);
+  assert(spell_mem.isPlaying());
+  while (spell_mem.isPlaying()) {
+    sleep_ms(frame_ms);
+  }
+
+  cout << "Test8 complete\n";
+}
+
+void test9()
+{
+  cout << "\nTest 9: Tests compressed sounds decoded while playing\n";
+
+  KameMix_setSoundFlags(KameMix_SoundCompressed);
+  Sound music_ogg("sound/a new beginning.ogg");
+  KameMix_setSoundFlags(KameMix_SoundDefault);
+  assert(music_ogg.isLoaded());
+
+  cout << "Play compressed music2 for 5 secs\n";
+  music_ogg.play();
+  assert(music_ogg.isPlaying());
+  sleep_ms(5000);
+
+  cout << "Play it again at 30 secs for 5 secs along with first play\n";
+  Sound music_copy(music_ogg); // shares KameMix_Sound
+  music_copy.playAt(30.0);
+  assert(music_copy.isPlaying());
+  assert(music_ogg.isPlaying());
+  sleep_ms(5000);
+
+  cout << "Stop both\n";
+  music_ogg.release();
+  music_copy.release();
+  sleep_ms(1000);
+
+  cout << "Test9 complete\n";
+}
+
+void test10()
+{
+  cout << "\nTest 10: Tests sounds stored as S16 in their native rate\n";
+
+  KameMix_setSoundFlags(KameMix_SoundS16 | KameMix_SoundNativeRate);
+  Sound duck_native("sound/duck.ogg");
+  Sound spell_native("sound/spell3.wav");
+  KameMix_setSoundFlags(KameMix_SoundDefault);
+  assert(duck_native.isLoaded() && spell_native.isLoaded());
+
+  cout << "Play duck resampled while mixing twice\n";
+  duck_native.play(1);
+  assert(duck_native.isPlaying());
+  while (duck_native.isPlaying()) {
+    sleep_ms(frame_ms);
+  }
+
+  cout << "Play spell3 resampled while mixing from 0.5 secs\n";
+  spell_native.playAt(0.5);
+  assert(spell_native.isPlaying());
+  while (spell_native.isPlaying()) {
+    sleep_ms(frame_ms);
+  }
+
+  cout << "Test10 complete\n";
+}
+
+void test11()
+{
+  cout << "\nTest 11: Tests sounds encoded as ADPCM when loaded\n";
+
+  KameMix_setSoundFlags(KameMix_SoundADPCM);
+  Sound music_adpcm("sound/a new beginning.ogg");
+  Sound spell_adpcm("sound/spell1.wav");
+  KameMix_setSoundFlags(KameMix_SoundADPCM | KameMix_SoundNativeRate);
+  Sound duck_adpcm("sound/duck.ogg");
+  KameMix_setSoundFlags(KameMix_SoundDefault);
+  assert(music_adpcm.isLoaded() && spell_adpcm.isLoaded() && 
+         duck_adpcm.isLoaded());
+
+  cout << "Play ADPCM music2 at 30 secs for 5 secs\n";
+  music_adpcm.playAt(30.0);
+  assert(music_adpcm.isPlaying());
+  sleep_ms(5000);
+  music_adpcm.halt();
+
+  cout << "Play ADPCM spell1 and native rate duck together\n";
+  spell_adpcm.play();
+  duck_adpcm.play(1);
+  while (spell_adpcm.isPlaying() || duck_adpcm.isPlaying()) {
+    sleep_ms(frame_ms);
+  }
+
+  cout << "Test11 complete\n";
+}
+
+void printCachedSound(const char *path, int flags, int refcount, 
+                      size_t mem_size, void *userdata)
+{
+  cout << "  " << path << ": flags " << flags << ", refcount " << refcount
+       << ", " << mem_size << " bytes\n";
+}
+
+void test12()
+{
+  cout << "\nTest 12: Tests sound cache\n";
+
+  KameMix_setSoundCacheEnabled(1);
+  KameMix_Sound *cow1 = KameMix_loadSound("sound/cow.ogg");
+  KameMix_Sound *cow2 = KameMix_loadSound("sound/cow.ogg");
+  KameMix_setSoundFlags(KameMix_SoundS16);
+  KameMix_Sound *cow_s16 = KameMix_loadSound("sound/cow.ogg");
+  KameMix_setSoundFlags(KameMix_SoundDefault);
+  assert(cow1 && cow1 == cow2);
+  assert(cow_s16 && cow_s16 != cow1);
+
+  cout << "Cached sounds:\n";
+  check(KameMix_forEachCachedSound(printCachedSound, NULL) == 2, 
+        "2 cached Sounds");
+  assert(KameMix_getSoundCacheMemory() == 
+         KameMix_getSoundMemory(cow1) + KameMix_getSoundMemory(cow_s16));
+
+  KameMix_freeSound(cow1);
+  KameMix_freeSound(cow2);
+  KameMix_freeSound(cow_s16);
+  check(KameMix_forEachCachedSound(NULL, NULL) == 0, "no cached Sounds");
+  KameMix_setSoundCacheEnabled(0);
+
+  cout << "Test12 complete\n";
+}
+
+void printCacheStats()
+{
+  KameMix_SoundCacheStats stats;
+  KameMix_getSoundCacheStats(&stats);
+  cout << "  hits " << stats.hits << ", misses " << stats.misses 
+       << ", evictions " << stats.evictions << ", reloads " << stats.reloads
+       << ", " << stats.resident_bytes << " of " << stats.budget 
+       << " bytes\n";
+}
+
+void test13()
+{
+  cout << "\nTest 13: Tests sound cache budget\n";
+
+  KameMix_setSoundCacheEnabled(1);
+  KameMix_resetSoundCacheStats();
+  KameMix_Sound *cow = KameMix_loadSound("sound/cow.ogg");
+  KameMix_Sound *duck = KameMix_loadSound("sound/duck.ogg");
+  assert(cow && duck);
+  const size_t cow_size = KameMix_getSoundMemory(cow);
+  const size_t duck_size = KameMix_getSoundMemory(duck);
+  const size_t budget = cow_size > duck_size ? cow_size : duck_size;
+
+  // only room for one, so least recently used cow is evicted
+  KameMix_setSoundCacheBudget(budget);
+  assert(KameMix_getSoundCacheBudget() == budget);
+  assert(KameMix_getSoundMemory(cow) == 0);
+  printCacheStats();
+
+  cout << "Play evicted cow, started when reloaded\n";
+  KameMix_setReloadPolicy(KameMix_ReloadDelay);
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  c = KameMix_playSound(cow, c, 0.0, 0, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1, 0);
+  assert(KameMix_isChannelSet(c));
+  while (KameMix_isPlaying(c)) {
+    sleep_ms(frame_ms);
+  }
+  assert(KameMix_getSoundMemory(cow) == cow_size);
+
+  cout << "Play evicted duck, blocked until reloaded\n";
+  KameMix_setReloadPolicy(KameMix_ReloadBlock);
+  KameMix_unsetChannel(c);
+  c = KameMix_playSound(duck, c, 0.0, 0, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1, 0);
+  assert(KameMix_getSoundMemory(duck) != 0);
+  while (KameMix_isPlaying(c)) {
+    sleep_ms(frame_ms);
+  }
+  printCacheStats();
+
+  KameMix_SoundCacheStats stats;
+  KameMix_getSoundCacheStats(&stats);
+  assert(stats.misses == 4 && stats.evictions >= 2 && stats.reloads == 2);
+
+  KameMix_setReloadPolicy(KameMix_ReloadDelay);
+  KameMix_setSoundCacheBudget(0);
+  KameMix_freeSound(cow);
+  KameMix_freeSound(duck);
+  assert(KameMix_getSoundCacheMemory() == 0);
+  KameMix_setSoundCacheEnabled(0);
+
+  cout << "Test13 complete\n";
+}
+
+void test14()
+{
+  cout << "\nTest 14: Tests sounds decoded progressively\n";
+
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point load_start = Clock::now();
+  KameMix_setSoundFlags(KameMix_SoundProgressive);
+  KameMix_Sound *music = KameMix_loadSound("sound/dark fallout.ogg");
+  KameMix_setSoundFlags(KameMix_SoundProgressive | KameMix_SoundS16 |
+                        KameMix_SoundNativeRate);
+  KameMix_Sound *music2 = KameMix_loadSound("sound/a new beginning.ogg");
+  KameMix_setSoundFlags(KameMix_SoundDefault);
+  const std::chrono::duration<double, std::milli> load_ms = 
+    Clock::now() - load_start;
+  assert(music && music2);
+  cout << "Loaded in " << load_ms.count() << " ms, still decoding: " 
+       << KameMix_isSoundLoading(music) << " " 
+       << KameMix_isSoundLoading(music2) << "\n";
+
+  cout << "Play music while decoded for 5 secs\n";
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  c = KameMix_playSound(music, c, 0.0, 0, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                        -1, 0);
+  assert(KameMix_isPlaying(c));
+  sleep_ms(5000);
+  KameMix_halt(c);
+
+  cout << "Play S16 native rate music2 while decoded for 5 secs\n";
+  c = KameMix_playSound(music2, c, 0.0, 0, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                        -1, 0);
+  sleep_ms(5000);
+  KameMix_halt(c);
+
+  KameMix_freeSound(music);
+  KameMix_freeSound(music2);
+
+  cout << "Test14 complete\n";
+}
+
+void test15()
+{
+  cout << "\nTest 15: Tests pooled allocation of sounds and streams\n";
+
+  // streams and sounds loaded and freed repeatedly reuse the same blocks
+  for (int i = 0; i < 10; ++i) {
+    KameMix_Stream *stream = KameMix_loadStream("sound/dark fallout.ogg");
+    KameMix_Sound *sound = KameMix_loadSound("sound/spell1.wav");
+    assert(stream && sound);
+    KameMix_freeStream(stream);
+    KameMix_freeSound(sound);
+  }
+
+  KameMix_PoolStats stats[16];
+  const int num_classes = KameMix_getPoolStats(stats, 16);
+  assert(num_classes > 0 && num_classes <= 16);
+  for (int i = 0; i < num_classes; ++i) {
+    if (stats[i].allocs == 0) {
+      continue;
+    }
+    cout << "  " << stats[i].block_size << " byte blocks: " 
+         << stats[i].blocks_used << " used of " << stats[i].blocks_total
+         << ", peak " << stats[i].peak_used << ", " << stats[i].allocs 
+         << " allocs, " << stats[i].slab_allocs << " slabs\n";
+  }
+
+  cout << "Test15 complete\n";
+}
+
+void test16()
+{
+  cout << "\nTest 16: Tests fixed voice capacity\n";
+
+  cout << "Play spell1 on all 32 voices\n";
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  assert(spell);
+  KameMix_Channel channels[33];
+  for (int i = 0; i < 33; ++i) {
+    KameMix_unsetChannel(channels[i]);
+    channels[i] = KameMix_playSound(spell, channels[i], 0.0, 0, 0.05f, 
+                                    0.0f, 0.0f, 0.0f, 0.0f, -1, 0);
+  }
+  assert(KameMix_isChannelSet(channels[31]));
+  assert(!KameMix_isChannelSet(channels[32]));
+  assert(KameMix_numberPlaying() == 32);
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+  KameMix_freeSound(spell);
+
+  cout << "Test16 complete\n";
+}
+
+void printRtViolation(const char *what, const char *file, int line,
+                      unsigned count, void *userdata)
+{
+  cout << "  " << what << " at " << file << ":" << line << " x" << count 
+       << "\n";
+}
+
+void test17()
+{
+  cout << "\nTest 17: Reports unsafe calls on audio thread\n";
+  cout << "Only found when KameMix is built with KAMEMIX_RT_CHECK\n";
+
+  // all tests above ran with audio thread mixing
+  const int num = KameMix_forEachRtViolation(printRtViolation, nullptr);
+  cout << num << " call sites found\n";
+
+  cout << "Test17 complete\n";
+}
+
+void test18()
+{
+  cout << "\nTest 18: Tests mixing with SIMD instruction set\n";
+
+  const char *names[] = { "none", "SSE2", "AVX2", "AVX-512" };
+  cout << "Mixing with " << names[KameMix_getSimdLevel()] << "\n";
+
+  // steady volume without position, then ramping with position
+  cout << "Play cow at listener, then duck fading in to the right\n";
+  KameMix_setListenerPos(.5f, .5f);
+  cow.setMaxDistance(0.0f);
+  cow.play();
+  while (cow.isPlaying()) {
+    sleep_ms(frame_ms);
+  }
+  duck.setMaxDistance(1.0f);
+  duck.setPos(.75f, .5f);
+  duck.fadein(1.0f);
+  while (duck.isPlaying()) {
+    sleep_ms(frame_ms);
+  }
+  duck.setMaxDistance(0.0f);
+  KameMix_setListenerPos(0.0f, 0.0f);
+
+  cout << "Test18 complete\n";
+}
+
+void test19()
+{
+  cout << "\nTest 19: Tests mixing many voices around listener\n";
+
+  cout << "Play spell1 and spell3 on 24 voices spread around listener\n";
+  KameMix_setListenerPos(.5f, .5f);
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  KameMix_Sound *spell3_snd = KameMix_loadSound("sound/spell3.wav");
+  assert(spell && spell3_snd);
+  for (int i = 0; i < 24; ++i) {
+    KameMix_Channel c;
+    KameMix_unsetChannel(c);
+    const float x = .5f + (i % 6 - 2.5f) * .1f;
+    const float y = .5f + (i / 6 - 1.5f) * .1f;
+    c = KameMix_playSound(i % 2 ? spell : spell3_snd, c, 0.0, 0, 0.04f, 
+                          (float)(i % 3) * .1f, x, y, 1.0f, -1, 0);
+    assert(KameMix_isChannelSet(c));
+  }
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+  KameMix_freeSound(spell);
+  KameMix_freeSound(spell3_snd);
+  KameMix_setListenerPos(0.0f, 0.0f);
+
+  cout << "Test19 complete\n";
+}
+
+void test20()
+{
+  cout << "\nTest 20: Tests mixing ahead of audio device\n";
+
+  KameMix_MixAheadStats stats;
+  if (!KameMix_getMixAheadStats(&stats)) {
+    cout << "Not mixing ahead\n";
+    return;
+  }
+
+  cout << "Play music1 for 5 secs\n";
+  KameMix_resetMixAheadStats();
+  music1.play();
+  for (int i = 0; i < 5; ++i) {
+    sleep_ms(1000);
+    assert(KameMix_getMixAheadStats(&stats));
+    cout << "fill " << stats.fill_frames << "/" << stats.capacity_frames 
+         << " min " << stats.min_fill_frames 
+         << " underruns " << stats.underruns 
+         << " blocks " << stats.blocks_mixed << "\n";
+  }
+  music1.stop();
+  assert(stats.block_frames == 128);
+  assert(stats.capacity_frames == 1024);
+
+  cout << "Test20 complete\n";
+}
+
+void test21()
+{
+  cout << "\nTest 21: Tests volume changes more often than callbacks\n";
+
+  // volume is updated each 128 frame block, so each change is heard
+  cout << "Play music2 switching volume every 20ms for 3 secs\n";
+  music2.play();
+  for (int i = 0; i < 150; ++i) {
+    music2.setVolume(i % 2 ? 0.2f : 1.0f);
+    sleep_ms(20);
+  }
+  music2.stop();
+  music2.setVolume(1.0f);
+
+  cout << "Test21 complete\n";
+}
+
+void test22()
+{
+  cout << "\nTest 22: Tests playing and stopping at mixer clock frames\n";
+
+  const uint64_t start_clock = KameMix_getClock();
+  sleep_ms(100);
+  check(KameMix_getClock() > start_clock, "mixer clock advanced");
+
+  cout << "Play spell1 8 times exactly 250ms apart, and stop cow after 2 "
+          "secs\n";
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  KameMix_Sound *cow_snd = KameMix_loadSound("sound/cow.ogg");
+  assert(spell && cow_snd);
+  const uint64_t beat = KameMix_getFrequency() / 4;
+  // start far enough ahead to not miss the first beat
+  const uint64_t first = KameMix_getClock() + KameMix_getFrequency() / 10;
+  KameMix_Channel c;
+  for (int i = 0; i < 8; ++i) {
+    KameMix_unsetChannel(c);
+    c = KameMix_playSoundAt(spell, c, first + i * beat, 0.0, 0, 0.5f, 0.0f,
+                            0.0f, 0.0f, 0.0f, -1, 0);
+    assert(KameMix_isChannelSet(c));
+  }
+  KameMix_unsetChannel(c);
+  c = KameMix_playSoundAt(cow_snd, c, first, 0.0, -1, 0.5f, 0.0f, 
+                          0.0f, 0.0f, 0.0f, -1, 0);
+  KameMix_stopAt(c, first + 8 * beat);
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+  assert(!KameMix_isPlaying(c));
+  KameMix_freeSound(spell);
+  KameMix_freeSound(cow_snd);
+
+  cout << "Test22 complete\n";
+}
+
+void test23()
+{
+  cout << "\nTest 23: Tests batched position and volume changes\n";
+
+  cout << "Play spell3 on 16 voices circling listener for 5 secs, moved "
+          "together each frame\n";
+  KameMix_setListenerPos(.5f, .5f);
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell3.wav");
+  assert(spell);
+  const int num = 16;
+  KameMix_Channel channels[num];
+  float xs[num], ys[num], volumes[num];
+  for (int i = 0; i < num; ++i) {
+    KameMix_unsetChannel(channels[i]);
+    channels[i] = KameMix_playSound(spell, channels[i], 0.0, -1, 0.05f, 
+                                    0.0f, .5f, .5f, 1.0f, -1, 0);
+    assert(KameMix_isChannelSet(channels[i]));
+  }
+
+  double total_time = 0;
+  while (total_time < 5000) {
+    const float angle = (float)(total_time / 1000);
+    for (int i = 0; i < num; ++i) {
+      const float a = angle + i * 2 * 3.14159265f / num;
+      xs[i] = .5f + .5f * std::cos(a);
+      ys[i] = .5f + .5f * std::sin(a);
+      volumes[i] = i == (int)total_time / 500 % num ? 0.2f : 0.05f;
+    }
+    KameMix_setPositions(channels, xs, ys, num);
+    KameMix_setVolumes(channels, volumes, num);
+    sleep_ms(frame_ms);
+    total_time += frame_ms;
+  }
+
+  // changes in a batch are applied by the next block mixed
+  KameMix_beginBatch();
+  for (int i = 0; i < num; ++i) {
+    KameMix_setVolume(channels[i], 0.0f);
+  }
+  assert(KameMix_getVolume(channels[0]) == 0.05f || 
+         KameMix_getVolume(channels[0]) == 0.2f);
+  KameMix_commitBatch();
+  sleep_ms(100);
+  assert(KameMix_getVolume(channels[0]) == 0.0f);
+
+  for (int i = 0; i < num; ++i) {
+    KameMix_halt(channels[i]);
+  }
+  KameMix_freeSound(spell);
+  KameMix_setListenerPos(0.0f, 0.0f);
+
+  cout << "Test23 complete\n";
+}
+
+void test24()
+{
+  cout << "\nTest 24: Tests volume and position ramps on audio thread\n";
+
+  KameMix_setListenerPos(.5f, .5f);
+  KameMix_Stream *music = KameMix_loadStream("sound/dark fallout.ogg");
+  assert(music);
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  c = KameMix_playStream(music, c, 0.0, -1, 1.0f, 0.0f, 0.0f, .5f, 
+                         1.0f, -1, 0);
+  assert(KameMix_isChannelSet(c));
+
+  cout << "Ramp music1 volume down to 10% over 3 secs, and back up\n";
+  KameMix_rampVolume(c, 0.1f, 3.0f, KameMix_RampExponential);
+  sleep_ms(1500);
+  const float mid_volume = KameMix_getVolume(c);
+  check(mid_volume < 1.0f && mid_volume > 0.1f, "volume ramping");
+  sleep_ms(1700);
+  assert(KameMix_getVolume(c) == 0.1f);
+  KameMix_rampVolume(c, 1.0f, 2.0f, KameMix_RampSmooth);
+  sleep_ms(2200);
+  assert(KameMix_getVolume(c) == 1.0f);
+
+  cout << "Move music1 from left to right over 4 secs\n";
+  KameMix_rampPos(c, 1.0f, .5f, 4.0f, KameMix_RampSmooth);
+  sleep_ms(4200);
+  float x, y;
+  KameMix_getPos(c, &x, &y);
+  assert(x == 1.0f && y == .5f);
+
+  cout << "Move music1 back left at velocity -0.25 for 4 secs\n";
+  KameMix_setVelocity(c, -0.25f, 0.0f);
+  sleep_ms(4000);
+  KameMix_setVelocity(c, 0.0f, 0.0f);
+  KameMix_getPos(c, &x, &y);
+  assert(x < .5f);
+
+  cout << "Fade group to 0% over 2 secs\n";
+  const int group = 0; // group1 from main
+  KameMix_setGroup(c, group);
+  const float group_volume = KameMix_getGroupVolume(group);
+  KameMix_rampGroupVolume(group, 0.0f, 2.0f, KameMix_RampLinear);
+  sleep_ms(2200);
+  assert(KameMix_getGroupVolume(group) == 0.0f);
+
+  KameMix_halt(c);
+  KameMix_freeStream(music);
+  KameMix_setGroupVolume(group, group_volume);
+  KameMix_setListenerPos(0.0f, 0.0f);
+
+  cout << "Test24 complete\n";
+}
+
+void test25()
+{
+  cout << "\nTest 25: Tests events sent by mixer\n";
+
+  KameMix_Event events[16];
+  while (KameMix_pollEvents(events, 16) > 0) { } // from earlier tests
+  const unsigned dropped = KameMix_getDroppedEvents();
+
+  cout << "Play duck twice, and spell1 4 times 200ms apart\n";
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  KameMix_Sound *duck_snd = KameMix_loadSound("sound/duck.ogg");
+  assert(spell && duck_snd);
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  KameMix_Channel duck_c = KameMix_playSound(duck_snd, c, 0.0, 1, 1.0f, 
+                                             0.0f, 0.0f, 0.0f, 0.0f, -1, 0);
+  int playing = 1;
+  for (int i = 0; i < 4; ++i) {
+    KameMix_unsetChannel(c);
+    c = KameMix_playSound(spell, c, 0.0, 0, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                          -1, 0);
+    playing += 1;
+    sleep_ms(200);
+  }
+
+  // wait for events instead of checking each channel
+  int loops = 0;
+  while (playing > 0) {
+    const int num = KameMix_pollEvents(events, 16);
+    for (int i = 0; i < num; ++i) {
+      const KameMix_Event &e = events[i];
+      if (e.type == KameMix_EventFinished) {
+        cout << "  channel " << e.channel.idx << " finished\n";
+        playing -= 1;
+      } else if (e.type == KameMix_EventLooped) {
+        check(e.channel.idx == duck_c.idx && e.channel.id == duck_c.id,
+              "duck looped");
+        loops += 1;
+      }
+    }
+    sleep_ms(frame_ms);
+  }
+  check(loops == 1, "duck looped once");
+  check(KameMix_getDroppedEvents() == dropped, "no events dropped");
+  KameMix_freeSound(spell);
+  KameMix_freeSound(duck_snd);
+
+  cout << "Test25 complete\n";
+}
+
+void test26()
+{
+  cout << "\nTest 26: Tests emitters played only near listener\n";
+
+  // 2000 emitters on a 100 x 20 grid, 1 unit apart, heard 1.5 units away
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell3.wav");
+  KameMix_Sound *duck_snd = KameMix_loadSound("sound/duck.ogg");
+  assert(spell && duck_snd);
+  KameMix_Event events[16];
+  while (KameMix_pollEvents(events, 16) > 0) { } // from earlier tests
+  std::vector<int> emitters;
+  for (int i = 0; i < 2000; ++i) {
+    const int emitter = KameMix_addEmitter(i % 2 ? spell : duck_snd, 
+                                           (float)(i % 100), 
+                                           (float)(i / 100), 1.5f, 
+                                           0.1f, -1);
+    assert(emitter != -1);
+    emitters.push_back(emitter);
+  }
+  check(KameMix_addEmitter(spell, 0.0f, 0.0f, 0.0f, 1.0f, -1) == -1,
+        "emitter with 0 max_distance rejected");
+
+  cout << "Move listener along emitters for 8 secs\n";
+  KameMix_setListenerPos(0.0f, 10.0f);
+  double total_time = 0;
+  int max_playing = 0;
+  while (total_time < 8000) {
+    float x, y;
+    KameMix_getListenerPos(&x, &y);
+    KameMix_setListenerPos(x + (float)(frame_ms / 1000), y);
+    const int playing = KameMix_updateEmitters();
+    max_playing = std::max(max_playing, playing);
+    sleep_ms(frame_ms);
+    total_time += frame_ms;
+  }
+  // only those within 1.5 units, plus ones being demoted
+  cout << "At most " << max_playing << " emitters playing\n";
+  assert(max_playing > 0 && max_playing <= 20);
+
+  cout << "Move listener away from all emitters\n";
+  KameMix_setListenerPos(-100.0f, -100.0f);
+  check(KameMix_updateEmitters() == 0, "no emitters playing");
+
+  for (int emitter : emitters) {
+    KameMix_removeEmitter(emitter);
+  }
+  KameMix_freeSound(spell);
+  KameMix_freeSound(duck_snd);
+  KameMix_setListenerPos(0.0f, 0.0f);
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+  // emitter voices weren't played by the app, so don't send events
+  check(KameMix_pollEvents(events, 16) == 0, "no events from emitters");
+
+  cout << "Test26 complete\n";
+}
+
+void test27()
+{
+  cout << "\nTest 27: Tests merging plays of a sound in a burst\n";
+
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  assert(spell);
+
+  cout << "Play spell1 20 times at once, merged into one voice\n";
+  KameMix_setSoundCoalesce(spell, 0.02f, 0);
+  KameMix_Channel first;
+  KameMix_unsetChannel(first);
+  first = KameMix_playSound(spell, first, 0.0, 0, 0.02f, 0.0f, 0.0f, 0.0f,
+                            0.0f, -1, 0);
+  for (int i = 1; i < 20; ++i) {
+    KameMix_Channel c;
+    KameMix_unsetChannel(c);
+    c = KameMix_playSound(spell, c, 0.0, 0, 0.02f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                          -1, 0);
+    assert(c.idx == first.idx && c.id == first.id);
+  }
+  assert(KameMix_numberPlaying() == 1);
+  assert(std::abs(KameMix_getVolume(first) - 0.4f) < 0.001f);
+  // a play at another position isn't merged, so it's heard from there
+  KameMix_Channel other;
+  KameMix_unsetChannel(other);
+  other = KameMix_playSound(spell, other, 0.0, 0, 0.02f, 0.0f, 5.0f, 0.0f, 
+                            10.0f, -1, 0);
+  assert(KameMix_isChannelSet(other) && other.idx != first.idx);
+  assert(KameMix_numberPlaying() == 2);
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+
+  cout << "Play spell1 10 times 100ms apart, at most 3 voices\n";
+  KameMix_setSoundCoalesce(spell, 0.0f, 3);
+  for (int i = 0; i < 10; ++i) {
+    KameMix_Channel c;
+    KameMix_unsetChannel(c);
+    c = KameMix_playSound(spell, c, 0.0, 0, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                          -1, 0);
+    assert(KameMix_isChannelSet(c));
+    sleep_ms(100);
+    // replaced voices can still be fading out
+    assert(KameMix_numberPlaying() <= 4);
+  }
+
+  cout << "Quieter play is rejected at the limit\n";
+  KameMix_Channel loud[3];
+  for (int i = 0; i < 3; ++i) {
+    KameMix_unsetChannel(loud[i]);
+    loud[i] = KameMix_playSound(spell, loud[i], 0.0, -1, 0.5f, 0.0f, 0.0f, 
+                                0.0f, 0.0f, -1, 0);
+  }
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  c = KameMix_playSound(spell, c, 0.0, 0, 0.1f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                        -1, 0);
+  assert(!KameMix_isChannelSet(c));
+  for (int i = 0; i < 3; ++i) {
+    KameMix_stop(loud[i]);
+  }
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+  KameMix_freeSound(spell);
+
+  cout << "Test27 complete\n";
+}
+
+// Meters a bus: records its peak sample since last read
+void busPeakEffect(float *buf, int frames, void *userdata)
+{
+  std::atomic<float> &peak = *(std::atomic<float>*)userdata;
+  float max = peak.load(std::memory_order_relaxed);
+  for (int i = 0; i < frames * 2; ++i) {
+    max = std::max(max, std::abs(buf[i]));
+  }
+  peak.store(max, std::memory_order_relaxed);
+}
+
+// Halves a bus's volume, as a stand-in for a filter or compressor
+void busHalfEffect(float *buf, int frames, void *userdata)
+{
+  for (int i = 0; i < frames * 2; ++i) {
+    buf[i] *= 0.5f;
+  }
+}
+
+void test28()
+{
+  cout << "\nTest 28: Tests submix buses with effects\n";
+
+  const int sfx_bus = KameMix_createBus(-1);
+  const int hits_bus = KameMix_createBus(sfx_bus); // nested in sfx_bus
+  assert(sfx_bus != -1 && hits_bus != -1);
+  std::atomic<float> peak(0.0f);
+  KameMix_setBusEffect(sfx_bus, busPeakEffect, &peak);
+  KameMix_setBusEffect(hits_bus, busHalfEffect, nullptr);
+
+  cout << "Play cow in nested bus at half volume, then fade bus out\n";
+  KameMix_Sound *cow_snd = KameMix_loadSound("sound/cow.ogg");
+  assert(cow_snd);
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  c = KameMix_playSound(cow_snd, c, 0.0, -1, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                        hits_bus, 0);
+  sleep_ms(2000);
+  cout << "Peak of sfx bus " << peak.load() << "\n";
+  assert(peak.load() > 0.0f && peak.load() <= 0.5f);
+  KameMix_rampGroupVolume(hits_bus, 0.0f, 2.0f, KameMix_RampExponential);
+  sleep_ms(2500);
+  KameMix_halt(c);
+  KameMix_setBusEffect(sfx_bus, nullptr, nullptr);
+  KameMix_freeSound(cow_snd);
+
+  cout << "Test28 complete\n";
+}
+
+void test29()
+{
+  cout << "\nTest 29: Tests convolution reverb on a send bus\n";
+
+  KameMix_Reverb *reverb = 
+    KameMix_loadReverb("sound/hall ir.wav", KameMix_ReverbDefault);
+  assert(reverb);
+  const int reverb_bus = KameMix_createBus(-1);
+  const int sfx_group = KameMix_createGroup();
+  assert(reverb_bus != -1 && sfx_group != -1);
+  KameMix_setBusEffect(reverb_bus, KameMix_reverbEffect, reverb);
+  KameMix_setGroupVolume(reverb_bus, 0.5f);
+
+  cout << "Play spell1 sending to the reverb\n";
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  KameMix_Sound *cow_snd = KameMix_loadSound("sound/cow.ogg");
+  assert(spell && cow_snd);
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  c = KameMix_playSound(spell, c, 0.0, 0, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                        -1, 0);
+  KameMix_setSend(c, reverb_bus, 0.7f);
+  sleep_ms(3000);
+
+  cout << "Play cow in a group sending to the reverb\n";
+  KameMix_setGroupSend(sfx_group, reverb_bus, 1.0f);
+  c = KameMix_playSound(cow_snd, c, 0.0, 1, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                        sfx_group, 0);
+  sleep_ms(3000);
+  cout << "Blocks without their tail: " 
+       << KameMix_getReverbLateBlocks(reverb) << "\n";
+  KameMix_halt(c);
+  KameMix_setGroupSend(sfx_group, -1, 0.0f);
+  KameMix_setBusEffect(reverb_bus, nullptr, nullptr);
+  KameMix_freeReverb(reverb);
+  KameMix_freeSound(spell);
+  KameMix_freeSound(cow_snd);
+
+  // benchmark on this thread, so the tail can't fall behind
+  reverb = KameMix_loadReverb("sound/hall ir.wav", KameMix_ReverbNoThread);
+  assert(reverb);
+  const int frames = 256;
+  const double audio_secs = 10.0;
+  const int blocks = (int)(audio_secs * KameMix_getFrequency() / frames);
+  std::vector<float> input(frames * 2);
+  for (float &sample : input) {
+    sample = (float)(rand() % 2001 - 1000) / 1000.0f;
+  }
+  std::vector<float> buf(frames * 2);
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point start = Clock::now();
+  for (int i = 0; i < blocks; ++i) {
+    std::copy(input.begin(), input.end(), buf.begin());
+    KameMix_reverbEffect(buf.data(), frames, reverb);
+  }
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+  // fraction of a core used per second of audio, for each second of IR
+  const double ir_secs = KameMix_getReverbLength(reverb);
+  const double cost = elapsed.count() / audio_secs / ir_secs;
+  cout << "Reverb benchmark: " << ir_secs << " sec IR, " 
+       << cost * 100.0 << "% of a core per sec of IR\n";
+  KameMix_freeReverb(reverb);
+
+  cout << "Test29 complete\n";
+}
+
+void test30()
+{
+  cout << "\nTest 30: Tests per-voice filters\n";
+
+  cout << "Move cow away, muffling it more with distance\n";
+  KameMix_Sound *cow_snd = KameMix_loadSound("sound/cow.ogg");
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  assert(cow_snd && spell);
+  KameMix_setListenerPos(0.0f, 0.0f);
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  c = KameMix_playSound(cow_snd, c, 0.0, -1, 1.0f, 0.0f, 0.0f, 0.0f, 40.0f, 
+                        -1, 0);
+  c = KameMix_setFilter(c, KameMix_FilterLowPass1, 20000.0f, 0.0f);
+  assert(KameMix_isChannelSet(c));
+  const int move_frames = 4 * frames_per_sec;
+  for (int i = 0; i < move_frames; ++i) {
+    const float distance = 30.0f * i / move_frames;
+    KameMix_setPos(c, distance, 0.0f);
+    // each unit of distance drops cutoff by a tenth
+    KameMix_setFilter(c, KameMix_FilterLowPass1, 
+                      20000.0f * std::pow(0.9f, distance), 0.0f);
+    sleep_ms(frame_ms);
+  }
+
+  cout << "Move it back behind a wall, then out from behind it\n";
+  KameMix_setPos(c, 5.0f, 0.0f);
+  KameMix_setFilter(c, KameMix_FilterLowPass, 500.0f, 0.707f);
+  sleep_ms(2000);
+  KameMix_setFilter(c, KameMix_FilterNone, 0.0f, 0.0f);
+  sleep_ms(2000);
+  KameMix_halt(c);
+
+  cout << "Play spell1 on 12 voices with different filters\n";
+  const KameMix_FilterType types[] = {
+    KameMix_FilterLowPass1, KameMix_FilterHighPass1, KameMix_FilterLowPass,
+    KameMix_FilterHighPass, KameMix_FilterBandPass
+  };
+  for (int i = 0; i < 12; ++i) {
+    KameMix_Channel spell_c;
+    KameMix_unsetChannel(spell_c);
+    spell_c = KameMix_playSound(spell, spell_c, 0.0, 0, 0.1f, 0.0f, 0.0f, 
+                                0.0f, 0.0f, -1, 0);
+    KameMix_setFilter(spell_c, types[i % 5], 300.0f + 400.0f * i, 2.0f);
+  }
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+  KameMix_freeSound(cow_snd);
+  KameMix_freeSound(spell);
+
+  cout << "Test30 complete\n";
+}
+
+void test31()
+{
+  cout << "\nTest 31: Tests pitch of Sounds and Streams\n";
+
+  cout << "Play spell1 8 times at random pitches, like footsteps\n";
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  KameMix_Sound *cow_snd = KameMix_loadSound("sound/cow.ogg");
+  KameMix_Stream *duck_stream = KameMix_loadStream("sound/duck.ogg");
+  assert(spell && cow_snd && duck_stream);
+  KameMix_Channel c;
+  KameMix_unsetChannel(c);
+  for (int i = 0; i < 8; ++i) {
+    KameMix_unsetChannel(c);
+    c = KameMix_playSound(spell, c, 0.0, 0, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                          -1, 0);
+    const float ratio = 0.8f + 0.4f * (rand() % 101) / 100.0f;
+    c = KameMix_setPitch(c, ratio);
+    assert(KameMix_isChannelSet(c));
+    assert(KameMix_getPitch(c) == ratio);
+    sleep_ms(250);
+  }
+
+  cout << "Loop cow, sweeping pitch down an octave and back up\n";
+  KameMix_unsetChannel(c);
+  c = KameMix_playSound(cow_snd, c, 0.0, -1, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 
+                        -1, 0);
+  const int sweep_frames = 3 * frames_per_sec;
+  for (int i = 0; i <= sweep_frames; ++i) {
+    KameMix_setPitch(c, std::pow(2.0f, -(float)i / sweep_frames));
+    sleep_ms(frame_ms);
+  }
+  for (int i = sweep_frames; i >= 0; --i) {
+    KameMix_setPitch(c, std::pow(2.0f, -(float)i / sweep_frames));
+    sleep_ms(frame_ms);
+  }
+  KameMix_halt(c);
+
+  cout << "Play duck stream twice at 1.5x pitch\n";
+  KameMix_unsetChannel(c);
+  c = KameMix_playStream(duck_stream, c, 0.0, 1, 1.0f, 0.0f, 0.0f, 0.0f, 
+                         0.0f, -1, 0);
+  KameMix_setPitch(c, 1.5f);
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+  assert(KameMix_getPitch(c) == 0.0f); // finished
+
+  KameMix_freeSound(spell);
+  KameMix_freeSound(cow_snd);
+  KameMix_freeStream(duck_stream);
+
+  cout << "Test31 complete\n";
+}
+
+void test32()
+{
+  cout << "\nTest 32: Tests mixing voices and buses on multiple threads\n";
+
+  // mix_threads is only set by init, so restart with mix workers
+  releaseAudio();
+  KameMix_shutdown();
+  KameMix_InitOptions options;
+  getTestInitOptions(&options);
+  options.mix_threads = 2;
+  if (!KameMix_initEx(&options) || !loadAudio()) {
+    cout << "KameMix_initEx failed\n";
+    exit(EXIT_FAILURE);
+  }
+
+  KameMix_Reverb *reverb = 
+    KameMix_loadReverb("sound/hall ir.wav", KameMix_ReverbDefault);
+  const int sfx_bus = KameMix_createBus(-1);
+  const int reverb_bus = KameMix_createBus(-1);
+  assert(reverb && sfx_bus != -1 && reverb_bus != -1);
+  std::atomic<float> peak(0.0f);
+  KameMix_setBusEffect(sfx_bus, busPeakEffect, &peak);
+  KameMix_setBusEffect(reverb_bus, KameMix_reverbEffect, reverb);
+  KameMix_setGroupSend(sfx_bus, reverb_bus, 0.5f);
+
+  cout << "Play spell1 and spell3 on 24 filtered voices in a bus sending " 
+          "to the reverb\n";
+  KameMix_Sound *spell = KameMix_loadSound("sound/spell1.wav");
+  KameMix_Sound *spell3_snd = KameMix_loadSound("sound/spell3.wav");
+  assert(spell && spell3_snd);
+  const KameMix_FilterType types[] = {
+    KameMix_FilterNone, KameMix_FilterLowPass1, KameMix_FilterHighPass1, 
+    KameMix_FilterLowPass, KameMix_FilterBandPass
+  };
+  for (int i = 0; i < 24; ++i) {
+    KameMix_Channel c;
+    KameMix_unsetChannel(c);
+    const float x = (i % 6 - 2.5f) * .1f;
+    const float y = (i / 6 - 1.5f) * .1f;
+    c = KameMix_playSound(i % 2 ? spell : spell3_snd, c, 0.0, 0, 0.04f, 
+                          0.0f, x, y, 1.0f, sfx_bus, 0);
+    assert(KameMix_isChannelSet(c));
+    KameMix_setFilter(c, types[i % 5], 400.0f + 300.0f * i, 1.0f);
+  }
+  while (KameMix_numberPlaying() > 0) {
+    sleep_ms(frame_ms);
+  }
+  cout << "Peak of sfx bus " << peak.load() << "\n";
+  assert(peak.load() > 0.0f);
+
+  KameMix_setGroupSend(sfx_bus, -1, 0.0f);
+  KameMix_setBusEffect(sfx_bus, nullptr, nullptr);
+  KameMix_setBusEffect(reverb_bus, nullptr, nullptr);
+  KameMix_freeReverb(reverb);
+  KameMix_freeSound(spell);
+  KameMix_freeSound(spell3_snd);
+
+  // restarted without groups, so buses are the only ones created
+  cout << "Create the rest of max_groups\n";
+  for (int i = 2; i < options.max_groups; ++i) {
+    check(KameMix_createGroup() != -1, "group created");
+  }
+  check(KameMix_createGroup() == -1, "no groups past max_groups");
+
+  cout << "Test32 complete\n";
+}